@@ -0,0 +1,561 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/*
+ * the benchmark suite; when compiled with BENCH_MAIN defined, this also
+ * provides a standalone benchmark program
+ */
+
+/*
+ * include section follows
+ */
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libgdb.h"
+#include "devctl.h"
+#include "devices.h"
+#include "bench.h"
+
+enum
+{
+	/*! default number of measured repetitions */
+	DEFAULT_NR_REPEATS		= 20,
+	/*! default number of warm-up repetitions */
+	DEFAULT_NR_WARMUPS		= 2,
+	/*! default number of measured repetitions of flash operations */
+	DEFAULT_NR_FLASH_REPEATS	= 3,
+	/*! the transfer size used when sweeping the transfer chunk size, in bytes */
+	CHUNK_SWEEP_XFER_SIZE		= 16 * 1024,
+	/*! the minimum size of the benchmark scratch area, in bytes */
+	MIN_SCRATCH_LEN			= CHUNK_SWEEP_XFER_SIZE / 4,
+};
+
+/*! transfer chunk sizes swept, in words; zero terminated */
+static const int chunk_sizes[] = { 16, 32, 64, 128, 256, 512, 768, 1024, 1536, 2048, 0, };
+/*! transfer sizes swept, in bytes; zero terminated */
+static const int xfer_sizes[] = { 4, 64, 256, 1024, 4 * 1024, 16 * 1024, 64 * 1024, 0, };
+
+/*! benchmark result reporting state */
+struct bench_report
+{
+	/*! output format */
+	enum BENCH_FORMAT format;
+	/*! output stream */
+	FILE	* out;
+	/*! number of results reported so far */
+	int	nr_results;
+};
+
+static uint64_t get_usec(void)
+{
+struct timeval tv;
+
+	gettimeofday(& tv, 0);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int cmp_samples(const void * a, const void * b)
+{
+uint64_t x = * (const uint64_t *) a, y = * (const uint64_t *) b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/* sorts the samples, and reports their median and 95th percentile */
+static void report(struct bench_report * r, const char * group, const char * op, int param,
+		int bytes, uint64_t * samples, int nr_samples)
+{
+uint64_t median, p95;
+uint32_t bps;
+int i;
+
+	if (!nr_samples)
+		return;
+	qsort(samples, nr_samples, sizeof * samples, cmp_samples);
+	median = samples[nr_samples / 2];
+	i = (nr_samples * 95 + 99) / 100 - 1;
+	p95 = samples[i < 0 ? 0 : i];
+	bps = median ? (uint64_t) bytes * 1000000 / median : 0;
+
+	switch (r->format)
+	{
+		case BENCH_FORMAT_TEXT:
+			if (!r->nr_results)
+				fprintf(r->out, "%-14s %-8s %8s %10s %6s %12s %12s %14s\n",
+						"group", "op", "param", "bytes", "n", "median-usec", "p95-usec", "bytes/second");
+			fprintf(r->out, "%-14s %-8s %8i %10i %6i %12u %12u %14u\n",
+					group, op, param, bytes, nr_samples, (unsigned) median, (unsigned) p95, (unsigned) bps);
+			break;
+		case BENCH_FORMAT_CSV:
+			if (!r->nr_results)
+				fprintf(r->out, "group,op,param,bytes,n,median_usec,p95_usec,bytes_per_sec\n");
+			fprintf(r->out, "%s,%s,%i,%i,%i,%u,%u,%u\n",
+					group, op, param, bytes, nr_samples, (unsigned) median, (unsigned) p95, (unsigned) bps);
+			break;
+		case BENCH_FORMAT_JSON:
+			fprintf(r->out, "%s\n  { \"group\": \"%s\", \"op\": \"%s\", \"param\": %i, \"bytes\": %i, \"n\": %i, "
+					"\"median_usec\": %u, \"p95_usec\": %u, \"bytes_per_sec\": %u }",
+					r->nr_results ? "," : "[",
+					group, op, param, bytes, nr_samples, (unsigned) median, (unsigned) p95, (unsigned) bps);
+			break;
+	}
+	r->nr_results ++;
+	fflush(r->out);
+}
+
+/* measures reading and writing 'bytes' bytes of the scratch area with the current transfer chunk size;
+ * the data in 'buf' is written, and read back in 'rbuf'; returns -1 on a target access error,
+ * -2 if the data read back does not match the data written */
+static int bench_mem_xfer(struct libgdb_ctx * ctx, const struct bench_options * opts, struct bench_report * r,
+		const char * group, int param, int bytes, uint32_t * buf, uint32_t * rbuf, uint64_t * samples)
+{
+int i, wordcnt;
+uint64_t t;
+
+	wordcnt = bytes / sizeof(uint32_t);
+	for (i = 0; i < opts->nr_warmups + opts->nr_repeats; i ++)
+	{
+		t = get_usec();
+		if (libgdb_writewords(ctx, opts->scratch_addr, wordcnt, buf))
+			return -1;
+		t = get_usec() - t;
+		if (i >= opts->nr_warmups)
+			samples[i - opts->nr_warmups] = t;
+	}
+	report(r, group, "write", param, bytes, samples, opts->nr_repeats);
+	for (i = 0; i < opts->nr_warmups + opts->nr_repeats; i ++)
+	{
+		memset(rbuf, 0, wordcnt * sizeof(uint32_t));
+		t = get_usec();
+		if (libgdb_readwords(ctx, opts->scratch_addr, wordcnt, rbuf))
+			return -1;
+		t = get_usec() - t;
+		if (memcmp(buf, rbuf, wordcnt * sizeof(uint32_t)))
+		{
+			eprintf("fatal error: data written and data read do not match!!!\n");
+			return -2;
+		}
+		if (i >= opts->nr_warmups)
+			samples[i - opts->nr_warmups] = t;
+	}
+	report(r, group, "read", param, bytes, samples, opts->nr_repeats);
+	return 0;
+}
+
+static int bench_flash(struct libgdb_ctx * ctx, struct struct_devctl * dev, const struct bench_options * opts,
+		struct bench_report * r, uint64_t * samples)
+{
+const struct struct_memarea * m;
+uint32_t addr, len, * buf;
+uint64_t t, * prog_samples;
+int i, n;
+
+	if (!dev->flash_erase_sector || !dev->flash_program_words)
+	{
+		eprintf("device '%s' does not support flash sector erasing and programming\n", dev->name);
+		return -1;
+	}
+	/* locate the sector */
+	len = 0;
+	for (n = 0, m = dev->flash_areas; m->len && !len; m ++)
+		for (addr = m->start, i = 0; m->sizes[i]; addr += m->sizes[i ++], n ++)
+			if (n == opts->flash_sector_nr)
+			{
+				len = m->sizes[i];
+				break;
+			}
+	if (!len)
+	{
+		eprintf("invalid flash sector number %i\n", opts->flash_sector_nr);
+		return -1;
+	}
+	if (!(buf = malloc(len)) || !(prog_samples = malloc(opts->nr_flash_repeats * sizeof * prog_samples)))
+	{
+		free(buf);
+		eprintf("out of core\n");
+		return -1;
+	}
+	for (i = 0; i < len / sizeof(uint32_t); i ++)
+		buf[i] = i * 0x9e3779b9;
+	if (dev->flash_unlock_area && dev->flash_unlock_area(dev, ctx, 0))
+	{
+		eprintf("error unlocking target flash\n");
+		goto error;
+	}
+	for (i = 0; i < opts->nr_flash_repeats; i ++)
+	{
+		t = get_usec();
+		/* the erase routine may return with the erase still in progress,
+		 * see the 'flash_wait_idle' field of struct struct_devctl */
+		if (dev->flash_erase_sector(dev, ctx, opts->flash_sector_nr)
+				|| (dev->flash_wait_idle && dev->flash_wait_idle(dev, ctx)))
+			goto error;
+		samples[i] = get_usec() - t;
+		t = get_usec();
+		if (dev->flash_program_words(dev, ctx, addr, buf, len / sizeof(uint32_t)))
+			goto error;
+		prog_samples[i] = get_usec() - t;
+	}
+	report(r, "flash", "erase", opts->flash_sector_nr, len, samples, opts->nr_flash_repeats);
+	report(r, "flash", "program", opts->flash_sector_nr, len, prog_samples, opts->nr_flash_repeats);
+	free(prog_samples);
+	free(buf);
+	return 0;
+error:
+	eprintf("flash benchmark failed\n");
+	free(prog_samples);
+	free(buf);
+	return -1;
+}
+
+void bench_init_options(struct bench_options * opts)
+{
+	memset(opts, 0, sizeof * opts);
+	opts->nr_repeats = DEFAULT_NR_REPEATS;
+	opts->nr_warmups = DEFAULT_NR_WARMUPS;
+	opts->nr_flash_repeats = DEFAULT_NR_FLASH_REPEATS;
+	opts->format = BENCH_FORMAT_TEXT;
+	opts->out = stdout;
+	opts->flash_sector_nr = -1;
+}
+
+const struct struct_memarea * bench_get_scratch_area(struct struct_devctl * dev)
+{
+const struct struct_memarea * m, * best;
+
+	if (!dev->ram_areas)
+		return 0;
+	for (best = 0, m = dev->ram_areas; m->len; m ++)
+		if (!best || m->len > best->len)
+			best = m;
+	return best;
+}
+
+int bench_run(struct libgdb_ctx * ctx, struct struct_devctl * dev, const struct bench_options * opts)
+{
+struct bench_report r;
+uint32_t * buf, * rbuf, x;
+uint64_t * samples, t;
+int i, n, bytes, prev_nr_words, res, saved_stdout;
+bool is_annotation_enabled;
+
+	if (opts->nr_repeats <= 0)
+	{
+		eprintf("invalid number of benchmark repetitions (%i)\n", opts->nr_repeats);
+		return -1;
+	}
+	if (opts->scratch_len < MIN_SCRATCH_LEN)
+	{
+		eprintf("benchmark scratch area too small (%u bytes), at least %u bytes of target ram are needed\n",
+				(unsigned) opts->scratch_len, (unsigned) MIN_SCRATCH_LEN);
+		return -1;
+	}
+	n = opts->nr_warmups + opts->nr_repeats;
+	if (n < opts->nr_flash_repeats)
+		n = opts->nr_flash_repeats;
+	buf = malloc(opts->scratch_len);
+	rbuf = malloc(opts->scratch_len);
+	samples = malloc(n * sizeof * samples);
+	if (!buf || !rbuf || !samples)
+	{
+		free(buf);
+		free(rbuf);
+		free(samples);
+		eprintf("out of core\n");
+		return -1;
+	}
+	for (i = 0; i < opts->scratch_len / sizeof(uint32_t); i ++)
+		buf[i] = i;
+	r.format = opts->format;
+	r.out = opts->out;
+	r.nr_results = 0;
+	saved_stdout = -1;
+	if (r.out == stdout)
+	{
+		/* keep the results apart from anything else printed while benchmarking
+		 * (e.g. device driver progress messages), so that they can be parsed -
+		 * the results are printed to the standard output, everything else is
+		 * diverted to the standard error stream */
+		fflush(stdout);
+		if ((saved_stdout = dup(1)) == -1 || !(r.out = fdopen(dup(saved_stdout), "w")))
+		{
+			if (saved_stdout != -1)
+				close(saved_stdout);
+			free(buf);
+			free(rbuf);
+			free(samples);
+			eprintf("error duplicating the standard output\n");
+			return -1;
+		}
+		dup2(2, 1);
+	}
+	res = -1;
+	is_annotation_enabled = libgdb_set_annotation(ctx, false);
+
+	/* sweep the transfer chunk size */
+	bytes = (opts->scratch_len < CHUNK_SWEEP_XFER_SIZE) ? opts->scratch_len & ~ 3 : CHUNK_SWEEP_XFER_SIZE;
+	prev_nr_words = libgdb_set_max_nr_words_xferred(ctx, 0);
+	for (i = 0; chunk_sizes[i]; i ++)
+	{
+		if (libgdb_set_max_nr_words_xferred(ctx, chunk_sizes[i]) == -1)
+			break;
+		if ((n = bench_mem_xfer(ctx, opts, & r, "chunk-size", chunk_sizes[i], bytes, buf, rbuf, samples)) == -2)
+		{
+			libgdb_set_max_nr_words_xferred(ctx, prev_nr_words);
+			goto out;
+		}
+		else if (n)
+		{
+			/* the gdbserver does not support this chunk size */
+			eprintf("chunk size %i words failed, not trying larger chunk sizes\n", chunk_sizes[i]);
+			break;
+		}
+	}
+	libgdb_set_max_nr_words_xferred(ctx, prev_nr_words);
+
+	/* sweep the transfer size, using the current transfer chunk size */
+	for (i = 0; xfer_sizes[i] && xfer_sizes[i] <= opts->scratch_len; i ++)
+		if (bench_mem_xfer(ctx, opts, & r, "xfer-size", prev_nr_words, xfer_sizes[i], buf, rbuf, samples))
+			goto out;
+
+	/* register access latency */
+	for (i = 0; i < opts->nr_warmups + opts->nr_repeats; i ++)
+	{
+		t = get_usec();
+		if (libgdb_readreg(ctx, 0, & x))
+			goto out;
+		t = get_usec() - t;
+		if (i >= opts->nr_warmups)
+			samples[i - opts->nr_warmups] = t;
+	}
+	report(& r, "register", "read", 0, sizeof x, samples, opts->nr_repeats);
+	for (i = 0; i < opts->nr_warmups + opts->nr_repeats; i ++)
+	{
+		t = get_usec();
+		if (libgdb_writereg(ctx, 0, x))
+			goto out;
+		t = get_usec() - t;
+		if (i >= opts->nr_warmups)
+			samples[i - opts->nr_warmups] = t;
+	}
+	report(& r, "register", "write", 0, sizeof x, samples, opts->nr_repeats);
+
+	/* target routine call latency - the routine is a single 'bx lr' instruction;
+	 * as with the device flash routines, it returns to address 0, where the
+	 * breakpoint halting the target is set - cortex-m3/m4 cores can only set
+	 * hardware breakpoints in the code region, and not in the scratch ram area */
+	if (libgdb_writewords(ctx, opts->scratch_addr, 1, (uint32_t[1]) { 0x47704770, }))
+		goto out;
+	for (i = 0; i < opts->nr_warmups + opts->nr_repeats; i ++)
+	{
+		t = get_usec();
+		if (libgdb_armv7m_run_target_routine(ctx, opts->scratch_addr,
+					(opts->scratch_addr + opts->scratch_len) & ~ 7,
+					0, & x, 0, 0, 0, 0))
+			goto out;
+		t = get_usec() - t;
+		if (i >= opts->nr_warmups)
+			samples[i - opts->nr_warmups] = t;
+	}
+	report(& r, "routine-call", "run", 0, 0, samples, opts->nr_repeats);
+
+	if (opts->flash_sector_nr >= 0 && dev)
+		if (bench_flash(ctx, dev, opts, & r, samples))
+			goto out;
+	res = 0;
+out:
+	if (res)
+		eprintf("benchmark aborted due to a target access error\n");
+	if (r.format == BENCH_FORMAT_JSON)
+		fprintf(r.out, r.nr_results ? "\n]\n" : "[]\n");
+	if (saved_stdout != -1)
+	{
+		fflush(stdout);
+		fclose(r.out);
+		dup2(saved_stdout, 1);
+		close(saved_stdout);
+	}
+	libgdb_set_annotation(ctx, is_annotation_enabled);
+	free(samples);
+	free(rbuf);
+	free(buf);
+	return res;
+}
+
+
+#ifdef BENCH_MAIN
+
+int main(int argc, char ** argv)
+{
+struct libgdb_ctx * ctx;
+struct struct_devctl * devs, * dev, * d;
+const struct struct_memarea * m;
+struct bench_options opts;
+const char * host;
+char * s;
+int i, port;
+
+struct struct_devctl * merge_dev_lists(struct struct_devctl * l1, struct struct_devctl * l2)
+{
+	if (!l1)
+		return l2;
+	for (d = l1; d->next; d = d->next);
+	d->next = l2;
+	return l1;
+}
+
+	devs = 0;
+	devs = merge_dev_lists(devs, stm32f10x_get_devs());
+	devs = merge_dev_lists(devs, stm32f4x_get_devs());
+	devs = merge_dev_lists(devs, stm32f0x_get_devs());
+	devs = merge_dev_lists(devs, lpc17xx_get_devs());
+
+	bench_init_options(& opts);
+	host = "127.0.0.1";
+	port = 1122;
+	dev = 0;
+
+	for (i = 1; i < argc; i ++)
+	{
+		if (!strcmp(argv[i], "--host") && i + 1 < argc)
+			host = argv[++ i];
+		else if (!strcmp(argv[i], "--port") && i + 1 < argc)
+			port = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+		{
+			for (dev = devs; dev && strcmp(dev->name, argv[i + 1]); dev = dev->next);
+			if (!dev)
+			{
+				eprintf("unknown device name (%s)\n", argv[i + 1]);
+				exit(1);
+			}
+			i ++;
+		}
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			opts.nr_repeats = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+			opts.nr_warmups = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--flash-repeats") && i + 1 < argc)
+			opts.nr_flash_repeats = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--flash-sector") && i + 1 < argc)
+			opts.flash_sector_nr = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--scratch") && i + 2 < argc)
+		{
+			opts.scratch_addr = strtoul(argv[++ i], & s, 0);
+			opts.scratch_len = strtoul(argv[++ i], & s, 0);
+		}
+		else if (!strcmp(argv[i], "--format") && i + 1 < argc)
+		{
+			i ++;
+			if (!strcmp(argv[i], "text"))
+				opts.format = BENCH_FORMAT_TEXT;
+			else if (!strcmp(argv[i], "csv"))
+				opts.format = BENCH_FORMAT_CSV;
+			else if (!strcmp(argv[i], "json"))
+				opts.format = BENCH_FORMAT_JSON;
+			else
+			{
+				eprintf("unknown output format (%s)\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			if (!(opts.out = fopen(argv[++ i], "w")))
+			{
+				eprintf("error opening output file %s\n", argv[i]);
+				exit(1);
+			}
+		}
+		else
+		{
+			printf("usage: %s [--host address] [--port port] [-d device-name] [-n repeats] [--warmup repeats] "
+					"[--scratch addr len] [--flash-sector sector-number] [--flash-repeats repeats] "
+					"[--format text|csv|json] [-o outfile]\n", * argv);
+			printf("the contents of the scratch ram area (and of the flash sector, if specified) are destroyed\n");
+			exit(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") ? 0 : 1);
+		}
+	}
+	if (!opts.scratch_len)
+	{
+		if (!dev || !(m = bench_get_scratch_area(dev)))
+		{
+			eprintf("specify either a device with '-d', or a scratch ram area with '--scratch'\n");
+			exit(1);
+		}
+		opts.scratch_addr = m->start;
+		opts.scratch_len = m->len;
+	}
+	if (opts.flash_sector_nr >= 0 && !dev)
+	{
+		eprintf("flash benchmarks require a device to be specified with '-d'\n");
+		exit(1);
+	}
+
+	if (!(ctx = libgdb_init()))
+	{
+		eprintf("failed to initialize the libgdb library\n");
+		exit(1);
+	}
+	if (libgdb_connect(ctx, host, port))
+	{
+		eprintf("failed to connect to a gdb server\n");
+		exit(2);
+	}
+	libgdb_send_ack(ctx);
+	if (libgdb_attach(ctx, 0) == -1)
+	{
+		eprintf("failed to attach to the target\n");
+		exit(2);
+	}
+	libgdb_negotiate_packet_size(ctx);
+	if (libgdb_autotune_max_nr_words_xferred(ctx, opts.scratch_addr, opts.scratch_len) == -1)
+		libgdb_set_max_nr_words_xferred(ctx, 16);
+	if (opts.flash_sector_nr >= 0 && dev->dev_open && dev->dev_open(dev, ctx))
+	{
+		eprintf("error opening target, aborting\n");
+		exit(1);
+	}
+
+	i = bench_run(ctx, dev, & opts);
+	/* restore any target settings changed by opening the device (e.g. clock settings) */
+	if (opts.flash_sector_nr >= 0 && dev->dev_close && dev->dev_close(dev, ctx))
+	{
+		eprintf("error closing target, target settings may not have been restored\n");
+		i = -1;
+	}
+	if (opts.out != stdout)
+		fclose(opts.out);
+	return i ? 1 : 0;
+}
+
+#endif /* BENCH_MAIN */
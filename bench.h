@@ -0,0 +1,96 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/*! benchmark result output formats */
+enum BENCH_FORMAT
+{
+	/*! human readable table */
+	BENCH_FORMAT_TEXT	= 0,
+	/*! comma separated values, one row per measurement, preceded by a header row */
+	BENCH_FORMAT_CSV,
+	/*! a json array of objects, one object per measurement */
+	BENCH_FORMAT_JSON,
+};
+
+/*! benchmark run parameters */
+struct bench_options
+{
+	/*! the number of measured repetitions of each operation */
+	int	nr_repeats;
+	/*! the number of unmeasured (warm-up) repetitions preceding the measured ones */
+	int	nr_warmups;
+	/*! the number of measured repetitions of each flash operation */
+	int	nr_flash_repeats;
+	/*! the result output format */
+	enum BENCH_FORMAT format;
+	/*! the stream where to print the results */
+	FILE	* out;
+	/*! the start address of a target ram area that the benchmarks can freely use
+	 *
+	 * the area must be executable, as the target routine call latency
+	 * is measured by running code placed in this area */
+	uint32_t	scratch_addr;
+	/*! the length of the scratch area above, in bytes */
+	uint32_t	scratch_len;
+	/*! the number of the flash sector to use for the flash erase/program benchmarks; negative to skip these
+	 *
+	 * the contents of this sector are destroyed */
+	int	flash_sector_nr;
+};
+
+/*!
+ *	\fn	void bench_init_options(struct bench_options * opts)
+ *	\brief	fills in default benchmark run parameters
+ *
+ *	\param	opts	the structure to initialize
+ *	\return	none */
+void bench_init_options(struct bench_options * opts);
+
+/*!
+ *	\fn	int bench_run(struct libgdb_ctx * ctx, struct struct_devctl * dev, const struct bench_options * opts)
+ *	\brief	runs the benchmark suite against a connected gdbserver
+ *
+ *	measures memory read/write latency and throughput for a sweep of
+ *	transfer chunk sizes and of transfer sizes, register access latency,
+ *	target routine call latency and (optionally) flash erase and
+ *	program throughput; the median and 95th percentile of each
+ *	measurement are reported; if the results are printed to the
+ *	standard output, anything else printed there while benchmarking
+ *	(e.g. device driver progress messages) is diverted to the standard
+ *	error stream, so that the results can be parsed
+ *
+ *	\param	ctx	libgdb library context, connected to a gdbserver, with the target halted
+ *	\param	dev	the target device, can be null if no flash benchmarks are requested;
+ *			the device must have already been opened
+ *	\param	opts	benchmark run parameters
+ *	\return	0 on success, -1 if an error occurs */
+int bench_run(struct libgdb_ctx * ctx, struct struct_devctl * dev, const struct bench_options * opts);
+
+/*!
+ *	\fn	const struct struct_memarea * bench_get_scratch_area(struct struct_devctl * dev)
+ *	\brief	selects a device ram area suitable for use as a benchmark scratch area
+ *
+ *	\param	dev	the target device
+ *	\return	the largest ram area of the device, null if the device has no ram areas */
+const struct struct_memarea * bench_get_scratch_area(struct struct_devctl * dev);
@@ -0,0 +1,181 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * raw binary and uf2 image file reader
+ */
+
+/*
+ * include section follows
+ */
+#ifndef __LINUX__
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libgdb.h"
+#include "memimage.h"
+#include "filemap.h"
+#include "binreader.h"
+
+/* uf2 format definitions */
+enum
+{
+	UF2_BLOCK_SIZE		= 512,
+	UF2_MAX_PAYLOAD_SIZE	= 476,
+	UF2_MAGIC_START0	= 0x0a324655,
+	UF2_MAGIC_START1	= 0x9e5d5157,
+	UF2_MAGIC_END		= 0x0ab16f30,
+	/* blocks with this flag set are not to be written to the main flash */
+	UF2_FLAG_NOT_MAIN_FLASH	= 0x00000001,
+};
+
+struct uf2_block
+{
+	uint32_t	magic_start0;
+	uint32_t	magic_start1;
+	uint32_t	flags;
+	uint32_t	target_addr;
+	uint32_t	payload_size;
+	uint32_t	block_no;
+	uint32_t	num_blocks;
+	uint32_t	file_size_or_family_id;
+	uint8_t		data[UF2_MAX_PAYLOAD_SIZE];
+	uint32_t	magic_end;
+};
+
+bool uf2buf_is_uf2(const void * buf, size_t len)
+{
+struct uf2_block blk;
+
+	if (len < sizeof blk)
+		return false;
+	memcpy(& blk, buf, sizeof blk);
+	return blk.magic_start0 == UF2_MAGIC_START0 && blk.magic_start1 == UF2_MAGIC_START1
+		&& blk.magic_end == UF2_MAGIC_END;
+}
+
+struct memimage * uf2file_read(const char * fname)
+{
+struct filemap * map;
+struct uf2_block blk;
+struct memimage * image;
+const uint8_t * base;
+size_t i;
+
+	if (!(map = filemap_open(fname)))
+		return 0;
+	if (!(image = memimage_create()))
+	{
+		eprintf("out of core\n");
+		filemap_close(map);
+		return 0;
+	}
+	/* the image data is not copied, it is referred to in the file mapping */
+	image->map = map;
+	base = map->base;
+	if (map->len % UF2_BLOCK_SIZE)
+	{
+		eprintf("file %s: size is not a multiple of the uf2 block size\n", fname);
+		goto error;
+	}
+
+	for (i = 0; i < map->len; i += UF2_BLOCK_SIZE)
+	{
+		/* the host is assumed to be little endian, just as the targets are */
+		memcpy(& blk, base + i, sizeof blk);
+		if (blk.magic_start0 != UF2_MAGIC_START0 || blk.magic_start1 != UF2_MAGIC_START1
+				|| blk.magic_end != UF2_MAGIC_END)
+		{
+			eprintf("file %s: bad uf2 block at offset 0x%08x\n", fname, (unsigned) i);
+			goto error;
+		}
+		if (blk.flags & UF2_FLAG_NOT_MAIN_FLASH || !blk.payload_size)
+			continue;
+		if (blk.payload_size > UF2_MAX_PAYLOAD_SIZE
+				|| (uint64_t) blk.target_addr + blk.payload_size > (uint64_t) UINT32_MAX + 1)
+		{
+			eprintf("file %s: bad uf2 block payload at offset 0x%08x\n", fname, (unsigned) i);
+			goto error;
+		}
+		if (memimage_add_external(image, blk.target_addr,
+					base + i + offsetof(struct uf2_block, data), blk.payload_size))
+		{
+			eprintf("out of core\n");
+			goto error;
+		}
+	}
+	if (!image->nr_areas)
+	{
+		eprintf("file %s: no loadable contents found\n", fname);
+		goto error;
+	}
+	if (memimage_finish(image))
+		goto error;
+	return image;
+
+error:
+	memimage_destroy(image);
+	return 0;
+}
+
+struct memimage * binfile_read(const char * fname, uint32_t addr)
+{
+struct filemap * map;
+struct memimage * image;
+
+	if (!(map = filemap_open(fname)))
+		return 0;
+	if (!(image = memimage_create()))
+	{
+		eprintf("out of core\n");
+		filemap_close(map);
+		return 0;
+	}
+	image->map = map;
+	if (!map->len || (uint64_t) addr + map->len > (uint64_t) UINT32_MAX + 1)
+	{
+		eprintf("file %s: %s\n", fname, map->len ? "image does not fit in the target address space" : "file is empty");
+		goto error;
+	}
+	if (memimage_add_external(image, addr, map->base, map->len))
+	{
+		eprintf("out of core\n");
+		goto error;
+	}
+	if (memimage_finish(image))
+		goto error;
+	return image;
+
+error:
+	memimage_destroy(image);
+	return 0;
+}
+
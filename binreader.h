@@ -0,0 +1,65 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * raw binary and uf2 image file reader
+ */
+
+/*!
+ *	\fn	bool uf2buf_is_uf2(const void * buf, size_t len)
+ *	\brief	determines if a memory buffer starts with an uf2 block
+ *
+ *	\param	buf	the buffer to examine
+ *	\param	len	the length of the buffer, in bytes
+ *	\return	true, if the buffer starts with a valid uf2 block header */
+bool uf2buf_is_uf2(const void * buf, size_t len);
+
+/*!
+ *	\fn	struct memimage * uf2file_read(const char * fname)
+ *	\brief	reads an uf2 file
+ *
+ *	the file is mapped in memory, and the payloads of all blocks
+ *	intended for the main flash are referred to in place; as the
+ *	payloads of consecutive blocks are not contiguous in the file,
+ *	runs of adjacent payloads are merged (and copied) in single
+ *	areas by memimage_finish()
+ *
+ *	\param	fname	the name of the uf2 file to read
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * uf2file_read(const char * fname);
+
+/*!
+ *	\fn	struct memimage * binfile_read(const char * fname, uint32_t addr)
+ *	\brief	reads a raw binary file
+ *
+ *	the file is mapped in memory, and its contents make up a single
+ *	image area, referred to in place, without being copied
+ *
+ *	\param	fname	the name of the binary file to read
+ *	\param	addr	the target memory address where the file contents are to be placed
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * binfile_read(const char * fname, uint32_t addr);
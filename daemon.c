@@ -0,0 +1,331 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * scribe daemon transport
+ */
+
+/*
+ * include section follows
+ */
+#ifdef __LINUX__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#else
+#define _WIN32_WINNT	0x0501
+#include <windows.h>
+#include <winsock2.h>
+#include <direct.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libgdb.h"
+#include "daemon.h"
+
+#ifdef __LINUX__
+#define closesocket	close
+#else
+
+/*!
+ *	\fn	static int init_sockets(void)
+ *	\brief	initializes the host socket library, if necessary
+ *
+ *	\return	0 on success, -1 if an error occurs */
+static int init_sockets(void)
+{
+	static bool is_initialized;
+	WSADATA wsadata;
+
+	if (!is_initialized && WSAStartup(MAKEWORD(1, 1), & wsadata))
+	{
+		eprintf("error initializing the winsock2 library\n");
+		return -1;
+	}
+	is_initialized = true;
+	return 0;
+}
+
+#endif /* __LINUX__ */
+
+/*!
+ *	\fn	static int open_endpoint(const char * endpoint, bool is_listening)
+ *	\brief	creates a socket, and either binds it to a daemon endpoint and listens on it, or connects it to a daemon endpoint
+ *
+ *	\param	endpoint	the daemon endpoint
+ *	\param	is_listening	if true, listen on the endpoint; if false, connect to it
+ *	\return	the socket on success, -1 if an error occurs */
+static int open_endpoint(const char * endpoint, bool is_listening)
+{
+int sock, res;
+#ifdef __LINUX__
+struct sockaddr_un addr;
+struct stat st;
+
+	if (strlen(endpoint) >= sizeof addr.sun_path)
+	{
+		eprintf("daemon endpoint path too long (%s)\n", endpoint);
+		return -1;
+	}
+	memset(& addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, endpoint);
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	{
+		eprintf("socket() error\n");
+		return -1;
+	}
+	if (is_listening)
+	{
+		/* remove any stale socket left over by a previous daemon - but
+		 * never anything else that happens to live at the endpoint path */
+		if (!lstat(endpoint, & st) && S_ISSOCK(st.st_mode))
+			unlink(endpoint);
+		res = bind(sock, (struct sockaddr *) & addr, sizeof addr) || listen(sock, 4);
+	}
+	else
+		res = connect(sock, (struct sockaddr *) & addr, sizeof addr);
+#else
+struct sockaddr_in addr;
+char * s;
+
+	if (init_sockets())
+		return -1;
+	memset(& addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(strtol(endpoint, & s, 0));
+	/* only ever accept local connections */
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (* s)
+	{
+		eprintf("bad daemon endpoint (%s), a tcp port number expected\n", endpoint);
+		return -1;
+	}
+	if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+	{
+		eprintf("socket() error\n");
+		return -1;
+	}
+	if (is_listening)
+		res = bind(sock, (struct sockaddr *) & addr, sizeof addr) || listen(sock, 4);
+	else
+		res = connect(sock, (struct sockaddr *) & addr, sizeof addr);
+#endif
+	if (res)
+	{
+		eprintf("error %s daemon endpoint %s\n", is_listening ? "listening on" : "connecting to", endpoint);
+		closesocket(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/*!
+ *	\fn	static int send_all(int sock, const char * buf, int len)
+ *	\brief	sends a whole buffer over a socket
+ *
+ *	\param	sock	the socket to send the data over
+ *	\param	buf	the data to send
+ *	\param	len	the number of bytes to send
+ *	\return	0 on success, -1 if an error occurs */
+static int send_all(int sock, const char * buf, int len)
+{
+int i;
+
+	while (len)
+	{
+		if ((i = send(sock, buf, len, 0)) <= 0)
+			return -1;
+		buf += i;
+		len -= i;
+	}
+	return 0;
+}
+
+int daemon_listen(const char * endpoint)
+{
+	return open_endpoint(endpoint, true);
+}
+
+int daemon_recv_job(int listen_sock, int * job_sock, char ** cwd, int * argc, char *** argv)
+{
+int sock, len, i, n, nr_strings;
+char * buf, * p, ** args;
+#ifdef __LINUX__
+struct timeval timeout = { .tv_sec = DAEMON_JOB_RECV_TIMEOUT_SEC, };
+#else
+DWORD timeout = DAEMON_JOB_RECV_TIMEOUT_SEC * 1000;
+#endif
+
+	if ((sock = accept(listen_sock, 0, 0)) == -1)
+	{
+		eprintf("accept() error\n");
+		return -1;
+	}
+	/* do not let a client that connects, but never completes its job
+	 * submission, stall the daemon forever */
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *) & timeout, sizeof timeout))
+	{
+		eprintf("setsockopt() error\n");
+		closesocket(sock);
+		return -1;
+	}
+	if (!(buf = malloc(DAEMON_MAX_JOB_LEN)))
+	{
+		eprintf("out of core\n");
+		closesocket(sock);
+		return -1;
+	}
+	/* receive strings until an empty one is received */
+	len = nr_strings = 0;
+	while (1)
+	{
+		if (len >= 2 && !buf[len - 1] && !buf[len - 2])
+			break;
+		if (len == DAEMON_MAX_JOB_LEN || (n = recv(sock, buf + len, DAEMON_MAX_JOB_LEN - len, 0)) <= 0)
+		{
+			eprintf("error receiving job\n");
+			goto error;
+		}
+		for (i = len, len += n; i < len; i ++)
+			if (!buf[i])
+				nr_strings ++;
+	}
+	/* the argument vector is stored in the same memory block, after the strings */
+	nr_strings --;
+	if (nr_strings < 2 || !(p = realloc(buf, len + (nr_strings + 2) * sizeof * args)))
+	{
+		eprintf("%s\n", nr_strings < 2 ? "malformed job received" : "out of core");
+		goto error;
+	}
+	buf = p;
+	args = (char **) (buf + ((len + sizeof * args - 1) & ~ (sizeof * args - 1)));
+	for (i = n = 0; n < nr_strings; i += strlen(buf + i) + 1)
+		args[n ++] = buf + i;
+	* cwd = args[0];
+	* argc = nr_strings - 1;
+	memmove(args, args + 1, (nr_strings - 1) * sizeof * args);
+	args[nr_strings - 1] = 0;
+	* argv = args;
+	* job_sock = sock;
+	return 0;
+
+error:
+	free(buf);
+	closesocket(sock);
+	return -1;
+}
+
+int daemon_finish_job(int job_sock, FILE * output, int status)
+{
+char buf[1024];
+int i, res;
+
+	res = 0;
+	if (output)
+	{
+		rewind(output);
+		while ((i = fread(buf, 1, sizeof buf, output)) > 0)
+			if (send_all(job_sock, buf, i))
+			{
+				res = -1;
+				break;
+			}
+	}
+	i = sprintf(buf, "%c%i", 0, status);
+	if (send_all(job_sock, buf, i))
+		res = -1;
+	closesocket(job_sock);
+	return res;
+}
+
+int daemon_submit_job(const char * endpoint, int argc, char ** argv)
+{
+int sock, i, n;
+char buf[1024], * s;
+bool is_status;
+
+	if ((sock = open_endpoint(endpoint, false)) == -1)
+		return -1;
+	if (!getcwd(buf, sizeof buf))
+	{
+		eprintf("error retrieving the current directory\n");
+		goto error;
+	}
+	if (send_all(sock, buf, strlen(buf) + 1))
+		goto error;
+	/* empty strings terminate the job submission - skip empty arguments */
+	for (i = 0; i < argc; i ++)
+		if (* argv[i] && send_all(sock, argv[i], strlen(argv[i]) + 1))
+			goto error;
+	if (send_all(sock, "", 1))
+		goto error;
+
+	/* copy the job output to the standard output, until the null
+	 * character preceding the job status is received */
+	is_status = false;
+	n = 0;
+	while ((i = recv(sock, buf + n, sizeof buf - 1 - n, 0)) > 0)
+	{
+		if (is_status)
+		{
+			n += i;
+			continue;
+		}
+		if ((s = memchr(buf, 0, i)))
+		{
+			fwrite(buf, 1, s - buf, stdout);
+			is_status = true;
+			n = i - (s + 1 - buf);
+			memmove(buf, s + 1, n);
+		}
+		else
+			fwrite(buf, 1, i, stdout);
+	}
+	fflush(stdout);
+	closesocket(sock);
+	if (!is_status || !n)
+	{
+		eprintf("connection to the scribe daemon lost\n");
+		return -1;
+	}
+	buf[n] = 0;
+	return strtol(buf, 0, 10);
+
+error:
+	eprintf("error submitting job to the scribe daemon\n");
+	closesocket(sock);
+	return -1;
+}
+
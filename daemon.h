@@ -0,0 +1,102 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * scribe daemon transport - a local socket over which scribe jobs are
+ * submitted to a scribe daemon, and their output and completion status
+ * are returned
+ *
+ * a job is submitted as a sequence of null terminated strings - the
+ * working directory of the submitting client, followed by the job
+ * command line arguments (including argv[0]), followed by an empty
+ * string; the daemon replies with the output of the job, followed by a
+ * null character, followed by the job exit status as a decimal number,
+ * and closes the connection
+ */
+
+enum
+{
+	/*! the loopback tcp port that the scribe daemon listens on by default, on machines without unix domain sockets */
+	DAEMON_DEFAULT_PORT	= 1123,
+	/*! the maximum length of a job submission, in bytes */
+	DAEMON_MAX_JOB_LEN	= 16 * 1024,
+	/*! the time, in seconds, that the daemon waits for a client to complete a job submission */
+	DAEMON_JOB_RECV_TIMEOUT_SEC	= 5,
+};
+
+/*! the default scribe daemon endpoint - a unix domain socket path on
+ * __LINUX__, a loopback tcp port number on windows */
+#ifdef __LINUX__
+#define DAEMON_DEFAULT_ENDPOINT		"/tmp/scribe-daemon.sock"
+#else
+#define DAEMON_DEFAULT_ENDPOINT		"1123"
+#endif
+
+/*!
+ *	\fn	int daemon_listen(const char * endpoint)
+ *	\brief	creates a socket listening for job submissions at a daemon endpoint
+ *
+ *	\param	endpoint	the daemon endpoint, see DAEMON_DEFAULT_ENDPOINT
+ *	\return	the listening socket on success, -1 if an error occurs */
+int daemon_listen(const char * endpoint);
+
+/*!
+ *	\fn	int daemon_recv_job(int listen_sock, int * job_sock, char ** cwd, int * argc, char *** argv)
+ *	\brief	waits for, and receives, a job submission
+ *
+ *	\param	listen_sock	the listening socket, as returned by daemon_listen()
+ *	\param	job_sock	the socket over which to send the job output and
+ *				status is stored here; must be passed to daemon_finish_job()
+ *	\param	cwd	the working directory of the submitting client is stored here;
+ *			this must be passed to free() when the job is done - the
+ *			job command line arguments are stored in the same memory block
+ *	\param	argc	the number of job command line arguments is stored here
+ *	\param	argv	the job command line arguments are stored here
+ *	\return	0 on success, -1 if an error occurs */
+int daemon_recv_job(int listen_sock, int * job_sock, char ** cwd, int * argc, char *** argv);
+
+/*!
+ *	\fn	int daemon_finish_job(int job_sock, FILE * output, int status)
+ *	\brief	sends the output and exit status of a job to the submitting client, and closes the job socket
+ *
+ *	\param	job_sock	the job socket, as returned by daemon_recv_job()
+ *	\param	output	a stream holding the job output, positioned at its end; can be null
+ *	\param	status	the job exit status
+ *	\return	0 on success, -1 if an error occurs */
+int daemon_finish_job(int job_sock, FILE * output, int status);
+
+/*!
+ *	\fn	int daemon_submit_job(const char * endpoint, int argc, char ** argv)
+ *	\brief	submits a job to a scribe daemon, and waits for it to complete
+ *
+ *	the job output is copied to the standard output
+ *
+ *	\param	endpoint	the daemon endpoint, see DAEMON_DEFAULT_ENDPOINT
+ *	\param	argc	the number of job command line arguments
+ *	\param	argv	the job command line arguments, argv[0] included
+ *	\return	the job exit status on success, -1 if an error occurs
+ *		communicating with the daemon */
+int daemon_submit_job(const char * endpoint, int argc, char ** argv);
+
@@ -133,6 +133,10 @@ struct struct_devctl
 	 *
 	 * this can be null if no such routine is available
 	 *
+	 * this is called when the device is no longer used - at the end
+	 * of a gdbserver session, or before resuming the target; this is
+	 * the place to restore any target settings changed by 'dev_open'
+	 *
 	 * this function returns zero on success, nonzero on error */
 	int (* dev_close)(struct struct_devctl * dev, struct libgdb_ctx * ctx);
 	/*! a pointer to a function for unlocking the target flash
@@ -168,6 +172,44 @@ struct struct_devctl
 	 *
 	 * this function returns zero on success, nonzero on error */
 	int (* flash_program_words)(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t dest, uint32_t * src, int wordcnt);
+	/*! the alignment, in bytes, of the destination addresses that 'flash_program_words' above accepts
+	 *
+	 * flash programming is never split at addresses not aligned to this;
+	 * this can be zero if word alignment suffices */
+	uint32_t	program_align;
+	/*! a pointer to a function for waiting for a flash operation still in progress to complete
+	 *
+	 * a flash sector erase routine may return as soon as the erase has been
+	 * started, so that target ram can be loaded (e.g. with the flash writing
+	 * routine and the first chunks of data to program) while the flash is busy;
+	 * the flash programming routine then waits for the erase to complete on its
+	 * own, but any other access to the target flash must be preceded by a call
+	 * to this function
+	 *
+	 * this can be null if no such routine is available, in which case all
+	 * flash routines complete their operations before returning
+	 *
+	 * this function returns zero on success, nonzero on error */
+	int (* flash_wait_idle)(struct struct_devctl * dev, struct libgdb_ctx * ctx);
+	/*! the typical time it takes to erase a flash sector, in microseconds
+	 *
+	 * this is estimated as a fixed time, plus a time for each kilobyte
+	 * of the sector size; these figures, along with 'mass_erase_usec'
+	 * below, are used to select the fastest way to erase the flash
+	 * sectors that an image is programmed to; they can be zero if unknown */
+	uint32_t	sector_erase_usec, sector_erase_usec_per_kb;
+	/*! the typical time it takes to mass erase the target device, in microseconds; zero if unknown */
+	uint32_t	mass_erase_usec;
+	/*! if true, flash programming routines that support it should split their
+	 * target ram write buffer in two halves, and upload the next chunk of data
+	 * to one of them while the target is programming the data in the other one
+	 *
+	 * this only pays off with gdbservers that service memory writes while the
+	 * target is running, and is therefore only enabled on request; in all-stop
+	 * mode, the gdb remote serial protocol does not allow sending packets other
+	 * than a break request while the target is running, so whether this works
+	 * at all depends on the gdbserver */
+	bool	is_double_buffering_enabled;
 	/*! a pointer to a function for validating command line options for the specific target
 	 *
 	 * this can be null if no such routine is available
@@ -198,7 +240,8 @@ struct struct_devctl
  * set to the end of the write buffer + the desired stack size
  * (field 'stack_size'); generally, it is best to reserve an
  * adequate amount of memory for the stack, and use all remaining
- * available memory for the write buffer */
+ * available memory for the write buffer; ramplan_layout() computes
+ * such a layout from the device ram areas */
 struct pdev
 {
 	/*! base address in the target for loading flash-writing specific code */
@@ -209,4 +252,9 @@ struct pdev
 	uint32_t	write_buf_size;
 	/*! the amount of memory to use for the target stack, in bytes */
 	uint32_t	stack_size;
+	/*! if nonzero, the base address of a second write buffer, of size 'write_buf_size',
+	 * used for double buffering; if zero, the write buffer is split in two halves
+	 * when double buffering, see the 'is_double_buffering_enabled' field
+	 * of struct struct_devctl */
+	uint32_t	alt_write_buf_addr;
 };
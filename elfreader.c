@@ -0,0 +1,164 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * elf executable file reader
+ */
+
+/*
+ * include section follows
+ */
+#ifndef __LINUX__
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libgdb.h"
+#include "memimage.h"
+#include "filemap.h"
+#include "elfreader.h"
+
+/* the subset of the elf32 format definitions needed here */
+enum
+{
+	EI_NIDENT	= 16,
+	EI_CLASS	= 4,
+	EI_DATA		= 5,
+	ELFCLASS32	= 1,
+	ELFDATA2LSB	= 1,
+	PT_LOAD		= 1,
+	SELFMAG		= 4,
+};
+#define ELFMAG		"\177ELF"
+
+struct elf32_ehdr
+{
+	uint8_t		e_ident[EI_NIDENT];
+	uint16_t	e_type;
+	uint16_t	e_machine;
+	uint32_t	e_version;
+	uint32_t	e_entry;
+	uint32_t	e_phoff;
+	uint32_t	e_shoff;
+	uint32_t	e_flags;
+	uint16_t	e_ehsize;
+	uint16_t	e_phentsize;
+	uint16_t	e_phnum;
+	uint16_t	e_shentsize;
+	uint16_t	e_shnum;
+	uint16_t	e_shstrndx;
+};
+
+struct elf32_phdr
+{
+	uint32_t	p_type;
+	uint32_t	p_offset;
+	uint32_t	p_vaddr;
+	uint32_t	p_paddr;
+	uint32_t	p_filesz;
+	uint32_t	p_memsz;
+	uint32_t	p_flags;
+	uint32_t	p_align;
+};
+
+struct memimage * elffile_read(const char * fname)
+{
+struct filemap * map;
+struct elf32_ehdr ehdr;
+struct elf32_phdr phdr;
+struct memimage * image;
+const uint8_t * base;
+int i;
+
+	if (!(map = filemap_open(fname)))
+		return 0;
+	if (!(image = memimage_create()))
+	{
+		eprintf("out of core\n");
+		filemap_close(map);
+		return 0;
+	}
+	/* the image data is not copied, it is referred to in the file mapping */
+	image->map = map;
+	base = map->base;
+	if (map->len < sizeof ehdr)
+	{
+		eprintf("file %s too small to be an elf file\n", fname);
+		goto error;
+	}
+	/* the host is assumed to be little endian, just as the targets are */
+	memcpy(& ehdr, base, sizeof ehdr);
+	if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG))
+	{
+		eprintf("file %s is not an elf file\n", fname);
+		goto error;
+	}
+	if (ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB)
+	{
+		eprintf("file %s is not a little endian elf32 file\n", fname);
+		goto error;
+	}
+	if (ehdr.e_phentsize < sizeof phdr
+			|| ehdr.e_phoff > map->len
+			|| (map->len - ehdr.e_phoff) / ehdr.e_phentsize < ehdr.e_phnum)
+	{
+		eprintf("file %s: bad elf program header table\n", fname);
+		goto error;
+	}
+
+	for (i = 0; i < ehdr.e_phnum; i ++)
+	{
+		memcpy(& phdr, base + ehdr.e_phoff + i * ehdr.e_phentsize, sizeof phdr);
+		if (phdr.p_type != PT_LOAD || !phdr.p_filesz)
+			continue;
+		if (phdr.p_offset > map->len || map->len - phdr.p_offset < phdr.p_filesz)
+		{
+			eprintf("file %s: elf segment %i extends past the end of file\n", fname, i);
+			goto error;
+		}
+		if (memimage_add_external(image, phdr.p_paddr, base + phdr.p_offset, phdr.p_filesz))
+		{
+			eprintf("out of core\n");
+			goto error;
+		}
+	}
+	if (!image->nr_areas)
+	{
+		eprintf("file %s: no loadable contents found\n", fname);
+		goto error;
+	}
+	if (memimage_finish(image))
+		goto error;
+	return image;
+
+error:
+	memimage_destroy(image);
+	return 0;
+}
+
@@ -0,0 +1,45 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * elf executable file reader
+ */
+
+/*!
+ *	\fn	struct memimage * elffile_read(const char * fname)
+ *	\brief	reads the loadable contents of an elf32 file
+ *
+ *	the file is mapped in memory, and the file contents of all
+ *	nonempty PT_LOAD program segments are referred to in place, at their
+ *	physical (load) addresses - this is the same memory image
+ *	that 'objcopy -O ihex' produces; zero-initialized segment
+ *	tails (e.g. .bss) are not part of the image
+ *
+ *	\param	fname	the name of the elf file to read
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null if an error occurs, or if the
+ *		file has no loadable contents */
+struct memimage * elffile_read(const char * fname);
+
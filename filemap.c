@@ -0,0 +1,212 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * host file memory mapping
+ */
+
+/*
+ * include section follows
+ */
+#ifdef __LINUX__
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "libgdb.h"
+#include "filemap.h"
+
+struct filemap * filemap_open(const char * fname)
+{
+struct filemap * map;
+
+	if (!(map = calloc(1, sizeof * map)))
+	{
+		eprintf("out of core\n");
+		return 0;
+	}
+#ifdef __LINUX__
+	{
+		struct stat stat;
+
+		if ((map->fd = open(fname, O_RDONLY)) == -1)
+		{
+			eprintf("error opening file %s, error %i (%s)\n", fname, errno, strerror(errno));
+			free(map);
+			return 0;
+		}
+		if (fstat(map->fd, & stat))
+		{
+			eprintf("error fstat()-ing file %s\n", fname);
+			goto error;
+		}
+		if ((map->len = stat.st_size) == 0)
+			return map;
+		/* a private mapping, writable, with the modifications not
+		 * carried through to the file */
+		map->base = mmap(0, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, map->fd, 0);
+		if (map->base == MAP_FAILED)
+		{
+			eprintf("error mapping file %s, error %i (%s)\n", fname, errno, strerror(errno));
+			goto error;
+		}
+		/* the file is normally processed front to back */
+		madvise(map->base, map->len, MADV_SEQUENTIAL);
+		return map;
+error:
+		close(map->fd);
+		free(map);
+		return 0;
+	}
+#else
+	{
+		DWORD size_hi;
+
+		map->hfile = CreateFile(fname, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+		if (map->hfile == INVALID_HANDLE_VALUE)
+		{
+			eprintf("error opening file %s, error %i\n", fname, (int) GetLastError());
+			free(map);
+			return 0;
+		}
+		map->len = GetFileSize(map->hfile, & size_hi);
+		if (size_hi)
+		{
+			eprintf("file %s too large\n", fname);
+			goto error;
+		}
+		if (map->len == 0)
+			return map;
+		/* a copy-on-write mapping - the modifications are not carried through to the file */
+		if (!(map->hmap = CreateFileMapping(map->hfile, 0, PAGE_WRITECOPY, 0, 0, 0))
+				|| !(map->base = MapViewOfFile(map->hmap, FILE_MAP_COPY, 0, 0, 0)))
+		{
+			eprintf("error mapping file %s, error %i\n", fname, (int) GetLastError());
+			if (map->hmap)
+				CloseHandle(map->hmap);
+			goto error;
+		}
+		return map;
+error:
+		CloseHandle(map->hfile);
+		free(map);
+		return 0;
+	}
+#endif
+}
+
+struct filemap * filemap_create(const char * fname, size_t len)
+{
+struct filemap * map;
+
+	if (!(map = calloc(1, sizeof * map)))
+	{
+		eprintf("out of core\n");
+		return 0;
+	}
+	map->len = len;
+#ifdef __LINUX__
+	if ((map->fd = open(fname, O_CREAT | O_TRUNC | O_RDWR, 0666)) == -1)
+	{
+		eprintf("error creating file %s, error %i (%s)\n", fname, errno, strerror(errno));
+		free(map);
+		return 0;
+	}
+	if (!len)
+		return map;
+	if (ftruncate(map->fd, len))
+	{
+		eprintf("error setting the size of file %s, error %i (%s)\n", fname, errno, strerror(errno));
+		goto error;
+	}
+	map->base = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if (map->base == MAP_FAILED)
+	{
+		eprintf("error mapping file %s, error %i (%s)\n", fname, errno, strerror(errno));
+		goto error;
+	}
+	return map;
+error:
+	close(map->fd);
+	free(map);
+	return 0;
+#else
+	map->hfile = CreateFile(fname, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (map->hfile == INVALID_HANDLE_VALUE)
+	{
+		eprintf("error creating file %s, error %i\n", fname, (int) GetLastError());
+		free(map);
+		return 0;
+	}
+	if (!len)
+		return map;
+	/* the mapping object extends the file to the requested size */
+	if (!(map->hmap = CreateFileMapping(map->hfile, 0, PAGE_READWRITE, 0, len, 0))
+			|| !(map->base = MapViewOfFile(map->hmap, FILE_MAP_WRITE, 0, 0, len)))
+	{
+		eprintf("error mapping file %s, error %i\n", fname, (int) GetLastError());
+		if (map->hmap)
+			CloseHandle(map->hmap);
+		CloseHandle(map->hfile);
+		free(map);
+		return 0;
+	}
+	return map;
+#endif
+}
+
+int filemap_close(struct filemap * map)
+{
+int res;
+
+	res = 0;
+#ifdef __LINUX__
+	if (map->base && munmap(map->base, map->len))
+		res = -1;
+	if (close(map->fd))
+		res = -1;
+#else
+	if (map->base && !UnmapViewOfFile(map->base))
+		res = -1;
+	if (map->hmap)
+		CloseHandle(map->hmap);
+	if (!CloseHandle(map->hfile))
+		res = -1;
+#endif
+	free(map);
+	return res;
+}
+
@@ -0,0 +1,75 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/*! a file mapped in host memory */
+struct filemap
+{
+	/*! the start of the file mapping, null for empty files */
+	void	* base;
+	/*! the length of the file mapping, in bytes */
+	size_t	len;
+#ifdef __LINUX__
+	/*! the descriptor of the mapped file */
+	int	fd;
+#else
+	/*! the handle of the mapped file */
+	HANDLE	hfile;
+	/*! the handle of the file mapping object */
+	HANDLE	hmap;
+#endif
+};
+
+/*!
+ *	\fn	struct filemap * filemap_open(const char * fname)
+ *	\brief	maps an existing file in memory for reading
+ *
+ *	the mapping is a private, copy-on-write one - the mapped data
+ *	can be modified (some flash drivers patch the data they program),
+ *	but modifications are never written back to the file; file
+ *	pages are read on demand, when first accessed
+ *
+ *	\param	fname	the name of the file to map
+ *	\return	the file mapping on success, null if an error occurs */
+struct filemap * filemap_open(const char * fname);
+
+/*!
+ *	\fn	struct filemap * filemap_create(const char * fname, size_t len)
+ *	\brief	creates (or truncates) a file of a given length and maps it in memory for writing
+ *
+ *	data stored in the mapping is written back to the file by the
+ *	host operating system in the background
+ *
+ *	\param	fname	the name of the file to create
+ *	\param	len	the length of the file to create, in bytes
+ *	\return	the file mapping on success, null if an error occurs */
+struct filemap * filemap_create(const char * fname, size_t len);
+
+/*!
+ *	\fn	int filemap_close(struct filemap * map)
+ *	\brief	unmaps a file mapped by filemap_open() or filemap_create() and closes the file
+ *
+ *	\param	map	the file mapping to close
+ *	\return	0 on success, -1 if an error occurs flushing the mapping to the file */
+int filemap_close(struct filemap * map);
+
@@ -0,0 +1,401 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+/*
+ * a minimal simulated gdbserver, useful for benchmarking and exercising
+ * libgdb without a real target attached
+ *
+ * the simulated target has a sparse, fully populated 32 bit address space
+ * that reads as zero until written (so that flash controller status
+ * registers read as idle and unlocked), a register file, and a core that
+ * halts immediately whenever it is resumed; target routines run through
+ * libgdb_armv7m_run_target_routine() therefore always return zero; an
+ * optional per-packet delay and link bandwidth limit can be set to
+ * approximate a real debug probe
+ */
+
+/*
+ * include section follows
+ */
+#ifdef __LINUX__
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#else
+#define _WIN32_WINNT	0x0501
+#include <windows.h>
+#include <winsock2.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+enum
+{
+	/*! default tcp port to listen on */
+	DEFAULT_PORT		= 1122,
+	/*! maximum packet length accepted */
+	MAX_PACKET_LEN		= 64 * 1024,
+	/*! simulated memory page size, as a power of two */
+	PAGE_SHIFT		= 12,
+	/*! number of registers in the simulated register file */
+	NR_REGS			= 64,
+	/*! the register number holding the xpsr (as used by libgdb_armv7m_run_target_routine()) */
+	XPSR_REG_NR		= 25,
+	/*! gdb break character ascii code */
+	GDB_BREAK_CHAR		= 3,
+	/*! default packet size reported in reply to 'qSupported' requests */
+	DEFAULT_PACKET_SIZE	= 4096,
+};
+
+static const char hexchars[16] = "0123456789abcdef";
+
+/* the simulated memory - pages are allocated on first write */
+static uint8_t * pages[1 << (32 - PAGE_SHIFT)];
+static uint32_t regs[NR_REGS];
+static int sock;
+static char rxbuf[4096];
+static int rxidx, rxcnt;
+static char packet[MAX_PACKET_LEN + 1], reply[2 * MAX_PACKET_LEN + 16];
+/* simulated link characteristics */
+static int packet_delay_usec;
+static int bytes_per_sec;
+/* the packet size reported to the client */
+static int packet_size = DEFAULT_PACKET_SIZE;
+/* the simulated core is considered running from the moment a client
+ * connects until it is halted by a break request or resumed (and thus
+ * immediately halted again) */
+static bool is_running;
+/* if true, 'qCRC' requests are not supported, as is the case with some probes */
+static bool is_qcrc_disabled;
+
+static void delay_usec(int usec)
+{
+	if (usec <= 0)
+		return;
+#ifdef __LINUX__
+	usleep(usec);
+#else
+	Sleep((usec + 999) / 1000);
+#endif
+}
+
+static uint8_t mem_read(uint32_t addr)
+{
+uint8_t * p;
+
+	p = pages[addr >> PAGE_SHIFT];
+	return p ? p[addr & ((1 << PAGE_SHIFT) - 1)] : 0;
+}
+
+static void mem_write(uint32_t addr, uint8_t x)
+{
+uint8_t ** p;
+
+	p = pages + (addr >> PAGE_SHIFT);
+	if (!* p && !(* p = calloc(1, 1 << PAGE_SHIFT)))
+	{
+		fprintf(stderr, "out of core\n");
+		exit(1);
+	}
+	(* p)[addr & ((1 << PAGE_SHIFT) - 1)] = x;
+}
+
+static int hex(char c)
+{
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	return -1;
+}
+
+/* returns the next incoming character, -1 if the connection is closed */
+static int get_char(void)
+{
+	if (rxidx == rxcnt)
+	{
+		if ((rxcnt = recv(sock, rxbuf, sizeof rxbuf, 0)) <= 0)
+			return -1;
+		rxidx = 0;
+	}
+	return (unsigned char) rxbuf[rxidx ++];
+}
+
+static void send_data(const char * s, int len)
+{
+	if (bytes_per_sec)
+		delay_usec((int) ((int64_t) len * 1000000 / bytes_per_sec));
+	send(sock, s, len, 0);
+}
+
+static void put_packet(const char * s)
+{
+int i, len;
+uint8_t cksum;
+
+	delay_usec(packet_delay_usec);
+	reply[0] = '$';
+	for (cksum = 0, len = 1, i = 0; s[i]; i ++)
+		cksum += (reply[len ++] = s[i]);
+	reply[len ++] = '#';
+	reply[len ++] = hexchars[cksum >> 4];
+	reply[len ++] = hexchars[cksum & 15];
+	send_data(reply, len);
+}
+
+/* receives a packet in the 'packet' buffer; returns the packet length, -1 if the
+ * connection is closed, -2 if a break character is received */
+static int get_packet(void)
+{
+int c, i;
+uint8_t cksum, xcksum;
+
+	while (1)
+	{
+		while ((c = get_char()) != '$')
+			if (c == -1)
+				return -1;
+			else if (c == GDB_BREAK_CHAR)
+				return -2;
+		for (i = 0, cksum = 0; (c = get_char()) != '#'; cksum += c)
+		{
+			if (c == -1)
+				return -1;
+			if (i < MAX_PACKET_LEN)
+				packet[i ++] = c;
+		}
+		packet[i] = 0;
+		xcksum = hex(get_char()) << 4;
+		xcksum |= hex(get_char());
+		if (bytes_per_sec)
+			delay_usec((int) ((int64_t) (i + 4) * 1000000 / bytes_per_sec));
+		if (xcksum == cksum)
+		{
+			send(sock, "+", 1, 0);
+			return i;
+		}
+		send(sock, "-", 1, 0);
+	}
+}
+
+static void handle_packet(int len)
+{
+uint32_t addr, n, i, x;
+char * s;
+
+	switch (packet[0])
+	{
+		case '?':
+			/* like some probes, do not reply to halt status queries
+			 * while the core is running */
+			if (!is_running)
+				put_packet("S05");
+			break;
+		case 'c':
+		case 's':
+			/* the simulated core halts immediately, returning zero from any target routine run */
+			if (packet[0] == 'c')
+			{
+				regs[0] = 0;
+				regs[15] = regs[14] & ~ 1;
+			}
+			is_running = false;
+			put_packet("S05");
+			break;
+		case 'm':
+			addr = strtoul(packet + 1, & s, 16);
+			n = strtoul(s + 1, 0, 16);
+			if (n > MAX_PACKET_LEN / 2)
+			{
+				put_packet("E01");
+				break;
+			}
+			for (i = 0; i < n; i ++)
+			{
+				x = mem_read(addr + i);
+				reply[i * 2] = hexchars[x >> 4];
+				reply[i * 2 + 1] = hexchars[x & 15];
+			}
+			reply[n * 2] = 0;
+			/* the reply buffer is also used by put_packet() - move the data out of the way */
+			memmove(reply + MAX_PACKET_LEN, reply, n * 2 + 1);
+			put_packet(reply + MAX_PACKET_LEN);
+			break;
+		case 'M':
+			addr = strtoul(packet + 1, & s, 16);
+			n = strtoul(s + 1, & s, 16);
+			if (* s != ':' || len - (s + 1 - packet) < n * 2)
+			{
+				put_packet("E01");
+				break;
+			}
+			for (s ++, i = 0; i < n; i ++, s += 2)
+				mem_write(addr + i, (hex(s[0]) << 4) | hex(s[1]));
+			put_packet("OK");
+			break;
+		case 'p':
+			n = strtoul(packet + 1, 0, 16);
+			x = (n < NR_REGS) ? regs[n] : 0;
+			for (i = 0; i < 4; i ++, x >>= 8)
+			{
+				reply[MAX_PACKET_LEN + i * 2] = hexchars[(x >> 4) & 15];
+				reply[MAX_PACKET_LEN + i * 2 + 1] = hexchars[x & 15];
+			}
+			reply[MAX_PACKET_LEN + 8] = 0;
+			put_packet(reply + MAX_PACKET_LEN);
+			break;
+		case 'P':
+			n = strtoul(packet + 1, & s, 16);
+			if (* s != '=' || strlen(s + 1) < 8)
+			{
+				put_packet("E01");
+				break;
+			}
+			for (x = 0, s ++, i = 0; i < 4; i ++, s += 2)
+				x |= ((hex(s[0]) << 4) | hex(s[1])) << (i * 8);
+			if (n < NR_REGS)
+				regs[n] = x;
+			put_packet("OK");
+			break;
+		case 'q':
+			if (!strncmp(packet, "qSupported", sizeof "qSupported" - 1))
+			{
+				sprintf(reply + MAX_PACKET_LEN, "PacketSize=%x", packet_size);
+				put_packet(reply + MAX_PACKET_LEN);
+			}
+			else if (!strncmp(packet, "qCRC:", sizeof "qCRC:" - 1) && !is_qcrc_disabled)
+			{
+				/* the msb-first crc32 that gdb uses, without a final inversion */
+				addr = strtoul(packet + sizeof "qCRC:" - 1, & s, 16);
+				n = strtoul(s + 1, 0, 16);
+				for (x = 0xffffffff; n --; addr ++)
+					for (x ^= (uint32_t) mem_read(addr) << 24, i = 0; i < 8; i ++)
+						x = (x & 0x80000000) ? (x << 1) ^ 0x04c11db7 : x << 1;
+				sprintf(reply + MAX_PACKET_LEN, "C%08x", x);
+				put_packet(reply + MAX_PACKET_LEN);
+			}
+			else
+				put_packet("");
+			break;
+		case 'Z':
+		case 'z':
+			put_packet((packet[1] == '1') ? "OK" : "");
+			break;
+		default:
+			/* unsupported packet */
+			put_packet("");
+			break;
+	}
+}
+
+int main(int argc, char ** argv)
+{
+struct sockaddr_in addr;
+int i, port, listen_sock, len;
+
+	port = DEFAULT_PORT;
+	for (i = 1; i < argc; i ++)
+	{
+		if (!strcmp(argv[i], "--port") && i + 1 < argc)
+			port = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--packet-delay-usec") && i + 1 < argc)
+			packet_delay_usec = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--bytes-per-sec") && i + 1 < argc)
+			bytes_per_sec = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--packet-size") && i + 1 < argc)
+			packet_size = strtol(argv[++ i], 0, 0);
+		else if (!strcmp(argv[i], "--no-qcrc"))
+			is_qcrc_disabled = true;
+		else
+		{
+			printf("usage: %s [--port port] [--packet-delay-usec usec] [--bytes-per-sec rate] [--packet-size size] [--no-qcrc]\n", * argv);
+			exit(1);
+		}
+	}
+
+#ifndef __LINUX__
+	{
+		WSADATA wsadata;
+		if (WSAStartup(MAKEWORD(1, 1), & wsadata))
+		{
+			fprintf(stderr, "error initializing the winsock2 library\n");
+			exit(1);
+		}
+	}
+#endif
+	if ((listen_sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+	{
+		fprintf(stderr, "socket() error\n");
+		exit(1);
+	}
+	i = 1;
+	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, (const char *) & i, sizeof i);
+	memset(& addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bind(listen_sock, (struct sockaddr *) & addr, sizeof addr) || listen(listen_sock, 1))
+	{
+		fprintf(stderr, "error listening on port %i\n", port);
+		exit(1);
+	}
+	printf("simulated gdbserver listening on port %i\n", port);
+	fflush(stdout);
+
+	while (1)
+	{
+		if ((sock = accept(listen_sock, 0, 0)) == -1)
+			continue;
+		i = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *) & i, sizeof i);
+		memset(regs, 0, sizeof regs);
+		regs[XPSR_REG_NR] = regs[16] = 1 << 24;
+		rxidx = rxcnt = 0;
+		is_running = true;
+		while ((len = get_packet()) != -1)
+			if (len == -2)
+			{
+				/* break request - ignored if the core is already halted */
+				if (is_running)
+					put_packet("S02");
+				is_running = false;
+			}
+			else
+				handle_packet(len);
+#ifdef __LINUX__
+		close(sock);
+#else
+		closesocket(sock);
+#endif
+	}
+	return 0;
+}
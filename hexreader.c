@@ -22,225 +22,904 @@ SOFTWARE.
 
 */
 
-#include <ctype.h>
+
+/*
+ * intel hex and motorola s-record file reader
+ */
+
+/*
+ * include section follows
+ */
+#ifdef __LINUX__
+#include <pthread.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <stdio.h>
-#include <malloc.h>
 #include <string.h>
 
+#include "libgdb.h"
+#include "memimage.h"
 #include "hexreader.h"
+#include "filemap.h"
+
+enum
+{
+	/*! the value that hex_digits[] holds for characters that are not hexadecimal digits */
+	NOT_HEX_DIGIT		= 0x100,
+	/*! the maximum number of threads used for parsing a single file */
+	MAX_PARSE_THREADS	= 16,
+	/*! the minimum amount of text, in bytes, that hexfile_read() hands to a parsing thread */
+	MIN_PARSE_SEGMENT_LEN	= 1024 * 1024,
+};
+
+/*! intel hex record types */
+enum HEX_RECORD_TYPE
+{
+	HEX_RECORD_DATA			= 0,
+	HEX_RECORD_END_OF_FILE		= 1,
+	HEX_RECORD_EXTENDED_SEGMENT_ADDR	= 2,
+	HEX_RECORD_START_SEGMENT_ADDR	= 3,
+	HEX_RECORD_EXTENDED_LINEAR_ADDR	= 4,
+	HEX_RECORD_START_LINEAR_ADDR	= 5,
+};
+
+/*! hexadecimal digit values, indexed by character; NOT_HEX_DIGIT for characters that are not hexadecimal digits
+ *
+ * the NOT_HEX_DIGIT value is chosen so that it survives being shifted
+ * and or-ed into a decoded byte, see decode_byte() */
+static const uint16_t hex_digits[256] =
+{
+	[0 ... 255] = NOT_HEX_DIGIT,
+	['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+	['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+	['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+	['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+/*! the state of parsing a segment of intel hex text
+ *
+ * for parallel parsing, the text is split at record boundaries into
+ * segments that are parsed independently; the extended address in effect
+ * at the start of a segment is not known until all preceding segments
+ * have been parsed, so the data records preceding the first extended
+ * address record of a segment are stored, at addresses relative to
+ * the unknown extended address, in a separate memory image, which is
+ * relocated once the extended address becomes known */
+struct hex_segment
+{
+	/*! the start of the segment text */
+	const unsigned char	* start;
+	/*! the end of the segment text */
+	const unsigned char	* end;
+	/*! true if the extended address in effect at the start of the segment is known, see 'base_addr' */
+	bool		is_base_known;
+	/*! the extended address in effect - at the start of the segment, if known, and at the end of the segment, after parsing */
+	uint32_t	base_addr;
+	/*! true, if an extended address record has been seen in the segment */
+	bool		has_base_record;
+	/*! the data preceding the first extended address record of the segment, if 'is_base_known' is false */
+	struct memimage	* relative;
+	/*! all other data of the segment */
+	struct memimage	* image;
+	/*! the number of lines parsed in the segment */
+	int		nr_lines;
+	/*! true, if an end of file record has been seen in the segment */
+	bool		is_eof;
+	/*! an error message, null if the segment was parsed successfully */
+	const char	* error;
+	/*! if not null, data records are passed to this function instead of being stored in a memory image, see hexfile_stream() */
+	int		(* data_handler)(void * cookie, uint32_t addr, const uint8_t * data, unsigned len);
+	/*! a cookie passed to the 'data_handler' function above */
+	void		* cookie;
+	/*! true, if parsing was stopped by the 'data_handler' function above */
+	bool		is_aborted;
+};
 
-struct data_mem_area * hexfile_read(const char * fname)
+/*! decodes two hexadecimal digits; the result is larger than 0xff if any of the digits is invalid */
+static inline unsigned decode_byte(const unsigned char * c)
 {
-FILE * f;
-char reclen[2 + 1], offset[4 + 1], rectyp[2 + 1], data[256 + 2 + 1];
-int len, offs, rtyp, cksum;
-struct data_mem_area * s, * ss;
+	return (hex_digits[c[0]] << 4) | hex_digits[c[1]];
+}
+
+/* parses a segment of intel hex text; returns 0 on success, -1 on error, with the error recorded in the segment */
+static int parse_segment(struct hex_segment * seg)
+{
+struct memimage * image;
+const unsigned char * c, * end;
+uint8_t rec[255], * dest;
+unsigned reclen, offset, rectype, sum, x, bad, hi, lo;
 int i;
-char * endptr;
-uint32_t addr;
-int memlen;
 
+	c = seg->start;
+	end = seg->end;
+	seg->nr_lines = 0;
+	if (!(seg->image = memimage_create()) || !(seg->relative = memimage_create()))
+	{
+		seg->error = "out of core";
+		return -1;
+	}
+	image = seg->is_base_known ? seg->image : seg->relative;
 
-uint8_t dconv(unsigned char * data)
+	while (c < end)
+	{
+		switch (* c)
+		{
+			case '\n':
+				seg->nr_lines ++;
+				/* fall through */
+			case '\r': case ' ': case '\t':
+			/* some tools terminate text files with a ctrl-z character */
+			case 0x1a:
+				c ++;
+				continue;
+			case ':':
+				c ++;
+				break;
+			default:
+				seg->error = "record does not start with a ':'";
+				return -1;
+		}
+		/* decode the record header - byte count, address offset and record type */
+		if (end - c < 8)
+		{
+			seg->error = "truncated record";
+			return -1;
+		}
+		reclen = decode_byte(c);
+		hi = decode_byte(c + 2);
+		lo = decode_byte(c + 4);
+		rectype = decode_byte(c + 6);
+		if ((reclen | hi | lo | rectype) & ~0xff)
+		{
+			seg->error = "invalid hexadecimal digit";
+			return -1;
+		}
+		offset = hi << 8 | lo;
+		c += 8;
+		sum = reclen + (offset >> 8) + offset + rectype;
+		if ((size_t) (end - c) < (reclen + 1) * 2)
+		{
+			seg->error = "truncated record";
+			return -1;
+		}
+		/* decode the record data, storing data record bytes
+		 * directly to their final place */
+		if (rectype == HEX_RECORD_DATA && reclen && !seg->data_handler)
+		{
+			if (!(dest = memimage_append(image, seg->base_addr + offset, reclen)))
+			{
+				seg->error = "out of core";
+				return -1;
+			}
+		}
+		else
+			dest = rec;
+		for (bad = i = 0; i < reclen; i ++, c += 2)
+		{
+			x = decode_byte(c);
+			bad |= x;
+			sum += x;
+			dest[i] = x;
+		}
+		x = decode_byte(c);
+		c += 2;
+		if ((bad | x) & ~0xff)
+		{
+			seg->error = "invalid hexadecimal digit";
+			return -1;
+		}
+		if ((uint8_t) (sum + x))
+		{
+			seg->error = "record checksum mismatch";
+			return -1;
+		}
+		if (c != end && * c != '\r' && * c != '\n')
+		{
+			seg->error = "junk at end of record";
+			return -1;
+		}
+
+		switch (rectype)
+		{
+			case HEX_RECORD_DATA:
+				if (seg->data_handler && reclen
+						&& seg->data_handler(seg->cookie, seg->base_addr + offset, rec, reclen))
+				{
+					seg->is_aborted = true;
+					return -1;
+				}
+				break;
+			case HEX_RECORD_END_OF_FILE:
+				seg->is_eof = true;
+				return 0;
+			case HEX_RECORD_EXTENDED_SEGMENT_ADDR:
+			case HEX_RECORD_EXTENDED_LINEAR_ADDR:
+				if (reclen != 2)
+				{
+					seg->error = "bad extended address record length";
+					return -1;
+				}
+				seg->base_addr = (uint32_t) (rec[0] << 8 | rec[1]) << (rectype == HEX_RECORD_EXTENDED_SEGMENT_ADDR ? 4 : 16);
+				seg->has_base_record = true;
+				image = seg->image;
+				break;
+			case HEX_RECORD_START_SEGMENT_ADDR:
+			case HEX_RECORD_START_LINEAR_ADDR:
+				/* execution start address - not used */
+				break;
+			default:
+				seg->error = "unknown record type";
+				return -1;
+		}
+	}
+	return 0;
+}
+
+#ifdef __LINUX__
+static void * parse_segment_thread(void * arg)
 {
-int x, y;
-	x = tolower(* data ++);
-	y = tolower(* data ++);
-	x -= isdigit(x) ? '0' : 'a' - 10;
-	y -= isdigit(y) ? '0' : 'a' - 10;
-	return (x << 4) | y;
+	parse_segment(arg);
+	return 0;
 }
-uint8_t compute_cksum(void)
+#else
+static DWORD WINAPI parse_segment_thread(LPVOID arg)
 {
-int i, j;
-	j = len + (offs >> 8) + offs + rtyp;
-	for (i = 0; data[i]; i += 2)
-		j += dconv(data + i);
-	return - (uint8_t) j;
+	parse_segment(arg);
+	return 0;
 }
-int add_new_mem_area(void)
+#endif
+
+int hexreader_get_nr_cpus(void)
 {
-	if (!ss)
-		ss = s = calloc(1, sizeof * s);
-	else 	/* handle the special case of moving in an
-		 * adjacent 64 kb segment */
-		if (addr == s->addr + s->len)
-			return 1;
-	else
-		s = s->next = calloc(1, sizeof * s);
-	s->addr = addr;
-	if (!s || !ss)
-		return 0;
-	return 1;
+#ifdef __LINUX__
+long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#else
+SYSTEM_INFO info;
+
+	GetSystemInfo(& info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#endif
 }
-int add_data(void)
+
+struct memimage * hexbuf_parse_parallel(const char * buf, size_t len, const char * name, bool report_errors, int nr_threads)
 {
-void * p;
-int i;
-unsigned j;
-	if (!ss)
+struct hex_segment * segs;
+struct memimage * image;
+const unsigned char * c, * end, * p;
+int i, nr_segs, line;
+uint32_t base_addr;
+bool is_thread_started[MAX_PARSE_THREADS];
+#ifdef __LINUX__
+pthread_t threads[MAX_PARSE_THREADS];
+#else
+HANDLE threads[MAX_PARSE_THREADS];
+#endif
+
+	if (nr_threads < 1)
+		nr_threads = 1;
+	if (nr_threads > MAX_PARSE_THREADS)
+		nr_threads = MAX_PARSE_THREADS;
+	if (!(segs = calloc(nr_threads, sizeof * segs)))
 	{
-		/* memory areas not yet defined - define a new one */
-		uint32_t x;
-		x = addr;
-		addr |= offs;
-		add_new_mem_area();
-		addr = x;
-		if (!ss)
-			return 0;
+		if (report_errors)
+			eprintf("%s: out of core\n", name);
+		return 0;
 	}
-	if (!s->data)
+	image = 0;
+
+	/* split the text in segments, at line boundaries */
+	c = (const unsigned char *) buf;
+	end = c + len;
+	for (nr_segs = 0; nr_segs < nr_threads && c < end; nr_segs ++)
 	{
-		s->data = malloc(memlen = 64 * sizeof(uint32_t));
-		if (!s->data)
-			return 0;
-		s->addr = addr | offs;
+		segs[nr_segs].start = c;
+		p = (const unsigned char *) buf + len / nr_threads * (nr_segs + 1);
+		if (nr_segs == nr_threads - 1 || p <= c || !(p = memchr(p, '\n', end - p)))
+			c = end;
+		else
+			c = p + 1;
+		segs[nr_segs].end = c;
 	}
-	j = (addr | offs) - s->addr;
-	while (j + len > memlen)
+	/* the extended address in effect at the start of the text is 0 */
+	segs[0].is_base_known = true;
+
+	/* parse the segments - the first one in the calling thread */
+	for (i = 1; i < nr_segs; i ++)
 	{
-		p = realloc(s->data, memlen *= 2);
-		if (!p)
-			return 0;
-		s->data = p;
+#ifdef __LINUX__
+		is_thread_started[i] = !pthread_create(threads + i, 0, parse_segment_thread, segs + i);
+#else
+		is_thread_started[i] = !!(threads[i] = CreateThread(0, 0, parse_segment_thread, segs + i, 0, 0));
+#endif
+		if (!is_thread_started[i])
+			/* run it in this thread then */
+			parse_segment(segs + i);
 	}
+	if (nr_segs)
+		parse_segment(segs);
+	for (i = 1; i < nr_segs; i ++)
+		if (is_thread_started[i])
+		{
+#ifdef __LINUX__
+			pthread_join(threads[i], 0);
+#else
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+#endif
+		}
 
-	for (i = 0; j < memlen && data[i]; s->data[j ++] = dconv(data + i), i +=2);
-	if (j >= memlen && data[i])
+	/* resolve the extended addresses at the segment starts, and merge the
+	 * segment data, up to the first error or end of file record */
+	base_addr = 0;
+	line = 1;
+	for (i = 0; i < nr_segs; i ++)
 	{
-		printf("j i s 0x%08x memlen is 0x%08x\n", j, memlen);
-		return 0;
+		if (segs[i].error)
+		{
+			if (report_errors)
+				eprintf("%s:%i: %s\n", name, line + segs[i].nr_lines, segs[i].error);
+			goto error;
+		}
+		if (!image)
+			image = segs[i].image, segs[i].image = 0;
+		if (!segs[i].is_base_known)
+		{
+			if (memimage_merge(image, segs[i].relative, base_addr))
+				goto out_of_core;
+			segs[i].relative = 0;
+		}
+		if (segs[i].image)
+		{
+			if (memimage_merge(image, segs[i].image, 0))
+				goto out_of_core;
+			segs[i].image = 0;
+		}
+		if (segs[i].has_base_record || segs[i].is_base_known)
+			base_addr = segs[i].base_addr;
+		line += segs[i].nr_lines;
+		if (segs[i].is_eof)
+			break;
 	}
-	s->len = j;
-	return 1;
+	if (!image || !image->nr_areas)
+	{
+		if (report_errors)
+			eprintf("%s: no data records found\n", name);
+		goto error;
+	}
+	if (memimage_finish(image))
+		goto error;
+	for (i = 0; i < nr_segs; i ++)
+		memimage_destroy(segs[i].relative), memimage_destroy(segs[i].image);
+	free(segs);
+	return image;
+
+out_of_core:
+	if (report_errors)
+		eprintf("%s: out of core\n", name);
+error:
+	for (i = 0; i < nr_segs; i ++)
+		memimage_destroy(segs[i].relative), memimage_destroy(segs[i].image);
+	memimage_destroy(image);
+	free(segs);
+	return 0;
 }
 
-	if (!(f = fopen(fname, "r")))
-		return 0;
+struct memimage * hexbuf_parse(const char * buf, size_t len, const char * name, bool report_errors)
+{
+	return hexbuf_parse_parallel(buf, len, name, report_errors, 1);
+}
 
-	reclen[2] = offset[4] = rectyp[2] = 0;
-	addr = 0;
-	memlen = 0;
-	ss = s = 0;
-
-	while (!feof(f))
-	{
-		i = fscanf(f, ":%2c %4c %2c", reclen, offset, rectyp);
-		if (i != 3)
-			goto end;
-		if (!fgets(data, sizeof data, f))
-			goto end;
-		i = strlen(data);
-		if (data[i - 1] == '\n')
-			data[-- i] = 0;
-		if (i < 2 || (i & 1))
-			goto end;
-		len = strtol(reclen, & endptr, 16);
-		if (*endptr)
-			goto end;
-		offs = strtol(offset, & endptr, 16);
-		if (*endptr)
-			goto end;
-		rtyp = strtol(rectyp, & endptr, 16);
-		if (*endptr)
-			goto end;
-		cksum = strtol(data + i - 2, & endptr, 16);
-		if (*endptr)
-			goto end;
-		data[i - 2] = 0;
-		if (cksum != compute_cksum())
-			goto end;
-		i -= 2;
-		switch (rtyp)
-		{
-			case 0:
-				/* data record */
-				if (!add_data())
-					goto end;
-				break;
-			case 1:
-				/* end of file */
-				goto end;
-				break;
-			case 2:
-				/* extended segment address record */
-				if (len != 2 || i != 4)
-					goto end;
-				addr = strtol(data, & endptr, 16);
-				if (*endptr)
-					goto end;
-				addr <<= 4;
-				printf("adding area\n");
-				if (!add_new_mem_area())
-					goto end;
-				break;
-			case 3:
-				/* start segment address record */
-				goto end;
-				break;
-			case 4:
-				/* extended linear address record */
-				if (len != 2 || i != 4)
-					goto end;
-				addr = strtol(data, & endptr, 16);
-				if (*endptr)
-					goto end;
-				addr <<= 16;
-				printf("adding area\n");
-				if (!add_new_mem_area())
-					goto end;
-				break;
-			case 5:
-				/* start linear address record */
+int hexfile_stream(const char * fname, int (* data_handler)(void * cookie, uint32_t addr, const uint8_t * data, unsigned len), void * cookie)
+{
+struct filemap * map;
+struct hex_segment seg;
+int res;
+
+	if (!(map = filemap_open(fname)))
+		return -1;
+	memset(& seg, 0, sizeof seg);
+	seg.start = map->base;
+	seg.end = seg.start + map->len;
+	seg.is_base_known = true;
+	seg.data_handler = data_handler;
+	seg.cookie = cookie;
+	if ((res = parse_segment(& seg)) && !seg.is_aborted)
+		eprintf("%s:%i: %s\n", fname, seg.nr_lines + 1, seg.error);
+	memimage_destroy(seg.relative);
+	memimage_destroy(seg.image);
+	filemap_close(map);
+	return res;
+}
+
+struct memimage * srecbuf_parse(const char * buf, size_t len, const char * name, bool report_errors)
+{
+struct memimage * image;
+const unsigned char * c, * end;
+uint8_t rec[255], * dest;
+unsigned rectype, count, addr_len, sum, x, bad;
+uint32_t addr;
+const char * error;
+int i, n, line;
+
+	c = (const unsigned char *) buf;
+	end = c + len;
+	line = 1;
+	error = 0;
+	if (!(image = memimage_create()))
+	{
+		error = "out of core";
+		goto error;
+	}
+
+	while (c < end)
+	{
+		switch (* c)
+		{
+			case '\n':
+				line ++;
+				/* fall through */
+			case '\r': case ' ': case '\t': case 0x1a:
+				c ++;
+				continue;
+			case 'S':
+				c ++;
 				break;
+			default:
+				error = "record does not start with an 'S'";
+				goto error;
+		}
+		/* decode the record header - record type and byte count */
+		if (end - c < 3)
+		{
+			error = "truncated record";
+			goto error;
 		}
+		rectype = * c - '0';
+		count = decode_byte(c + 1);
+		c += 3;
+		switch (rectype)
+		{
+			case 0: case 1: case 5: case 9: addr_len = 2; break;
+			case 2: case 6: case 8: addr_len = 3; break;
+			case 3: case 7: addr_len = 4; break;
+			default:
+				error = "invalid record type";
+				goto error;
+		}
+		if (count & ~ 0xff)
+		{
+			error = "invalid hexadecimal digit";
+			goto error;
+		}
+		if (count < addr_len + 1)
+		{
+			error = "bad record length";
+			goto error;
+		}
+		if ((size_t) (end - c) < count * 2)
+		{
+			error = "truncated record";
+			goto error;
+		}
+		/* decode the address */
+		for (sum = count, bad = addr = i = 0; i < addr_len; i ++, c += 2)
+		{
+			x = decode_byte(c);
+			bad |= x;
+			sum += x;
+			addr = addr << 8 | (x & 0xff);
+		}
+		/* decode the record data, storing data record bytes
+		 * directly to their final place */
+		n = count - addr_len - 1;
+		if (1 <= rectype && rectype <= 3 && n && !(bad & ~ 0xff))
+		{
+			if (!(dest = memimage_append(image, addr, n)))
+			{
+				error = "out of core";
+				goto error;
+			}
+		}
+		else
+			dest = rec;
+		for (i = 0; i < n; i ++, c += 2)
+		{
+			x = decode_byte(c);
+			bad |= x;
+			sum += x;
+			dest[i] = x;
+		}
+		x = decode_byte(c);
+		c += 2;
+		if ((bad | x) & ~ 0xff)
+		{
+			error = "invalid hexadecimal digit";
+			goto error;
+		}
+		/* the checksum is the ones' complement of the sum of the other record bytes */
+		if ((uint8_t) (sum + x) != 0xff)
+		{
+			error = "record checksum mismatch";
+			goto error;
+		}
+		if (c != end && * c != '\r' && * c != '\n')
+		{
+			error = "junk at end of record";
+			goto error;
+		}
+		if (rectype >= 7)
+			/* termination record */
+			break;
 	}
-end:
-	if (s)
+	if (!image->nr_areas)
 	{
-		/* merge any adjacent memory areas */
+		error = "no data records found";
+		goto error;
 	}
-	fclose(f);
-	return ss;
+	if (memimage_finish(image))
+		goto error_reported;
+	return image;
+
+error:
+	if (report_errors)
+		eprintf("%s:%i: %s\n", name, line, error);
+error_reported:
+	memimage_destroy(image);
+	return 0;
 }
 
-void hexfile_dealloc(struct data_mem_area * areas)
+struct memimage * srecfile_read(const char * fname)
 {
-struct data_mem_area * m, * n;
+struct filemap * map;
+struct memimage * image;
 
-	if (!areas)
-		return;
-	for (m = areas; m; n = m->next, free(m), m = n)
-		;
+	if (!(map = filemap_open(fname)))
+		return 0;
+	image = srecbuf_parse(map->base, map->len, fname, true);
+	filemap_close(map);
+	return image;
 }
 
+struct memimage * hexfile_read(const char * fname)
+{
+struct filemap * map;
+struct memimage * image;
+int nr_threads;
+
+	if (!(map = filemap_open(fname)))
+		return 0;
+	nr_threads = map->len / MIN_PARSE_SEGMENT_LEN;
+	if (nr_threads > hexreader_get_nr_cpus())
+		nr_threads = hexreader_get_nr_cpus();
+	image = hexbuf_parse_parallel(map->base, map->len, fname, true, nr_threads);
+	filemap_close(map);
+	return image;
+}
 
 #if HEXREADER_TEST_DRIVE
 
+#include <time.h>
+#include <sys/time.h>
+
+/*
+ * a test drive for the intel hex reader; besides dumping the memory
+ * areas of a hex file, it can benchmark the parser on a generated
+ * image and fuzz it with randomly corrupted images
+ */
+
+/*! a text buffer that generated hex images are written to */
+struct text
+{
+	char	* buf;
+	size_t	len;
+	size_t	size;
+};
+
+static void text_append(struct text * t, const char * s, size_t len)
+{
+	if (t->len + len > t->size)
+	{
+		while (t->len + len > t->size)
+			t->size = t->size ? t->size * 2 : 4096;
+		if (!(t->buf = realloc(t->buf, t->size)))
+		{
+			printf("out of core\n");
+			exit(1);
+		}
+	}
+	memcpy(t->buf + t->len, s, len);
+	t->len += len;
+}
+
+static void put_record(struct text * t, int rectype, unsigned offset, const uint8_t * data, int len)
+{
+char rec[1 + (1 + 2 + 1 + 255 + 1) * 2 + 1 + 1];
+unsigned sum;
+int i, n;
+
+	sum = len + (offset >> 8) + offset + rectype;
+	n = sprintf(rec, ":%02X%04X%02X", len, offset & 0xffff, rectype);
+	for (i = 0; i < len; sum += data[i ++])
+		n += sprintf(rec + n, "%02X", data[i]);
+	n += sprintf(rec + n, "%02X\n", (uint8_t) - sum);
+	text_append(t, rec, n);
+}
+
+/* appends the intel hex representation of a memory area, using data records of up to 'reclen' bytes */
+static void put_area(struct text * t, uint32_t addr, const uint8_t * data, uint32_t len, int reclen)
+{
+uint8_t ext[2];
+uint32_t base;
+int n;
+
+	base = ~ 0;
+	while (len)
+	{
+		if ((addr & ~ 0xffff) != base)
+		{
+			base = addr & ~ 0xffff;
+			ext[0] = base >> 24;
+			ext[1] = base >> 16;
+			put_record(t, HEX_RECORD_EXTENDED_LINEAR_ADDR, 0, ext, 2);
+		}
+		n = reclen;
+		if (n > len)
+			n = len;
+		/* do not let a record cross a 64 kb boundary */
+		if (((addr & 0xffff) + n) > 0x10000)
+			n = 0x10000 - (addr & 0xffff);
+		put_record(t, HEX_RECORD_DATA, addr & 0xffff, data, n);
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
+static void fill_random(uint8_t * data, uint32_t len)
+{
+	while (len --)
+		* data ++ = rand();
+}
+
+/* checks that a memory image holds exactly the given areas; returns 0 on match, -1 otherwise */
+static int check_areas(const struct memimage * image, const uint32_t * addr, uint8_t * const * data, const uint32_t * len, int nr_areas)
+{
+const struct data_mem_area * s;
+int i;
+
+	if (!image || image->nr_areas != nr_areas)
+		return -1;
+	for (i = 0, s = image->areas; i < nr_areas; i ++, s = s->next)
+		if (!s || s->addr != addr[i] || s->len != len[i] || memcmp(s->data, data[i], len[i]))
+			return -1;
+	if (s)
+		return -1;
+	for (i = 0; i < nr_areas; i ++)
+		if (memimage_lookup(image, addr[i] + len[i] - 1) != image->areas + i
+				|| memimage_lookup(image, addr[i] - 1)
+				|| memimage_lookup(image, addr[i] + len[i]))
+			return -1;
+	return 0;
+}
+
+/* checks if two memory images (either of which can be null) are the same; returns 0 if they are, -1 otherwise */
+static int compare_images(const struct memimage * a, const struct memimage * b)
+{
+int i;
+
+	if (!a || !b)
+		return a == b ? 0 : -1;
+	if (a->nr_areas != b->nr_areas)
+		return -1;
+	for (i = 0; i < a->nr_areas; i ++)
+		if (a->areas[i].addr != b->areas[i].addr || a->areas[i].len != b->areas[i].len
+				|| memcmp(a->areas[i].data, b->areas[i].data, a->areas[i].len))
+			return -1;
+	return 0;
+}
+
+static int bench(int megabytes, int repeats, int nr_threads)
+{
+struct text t;
+uint8_t * data;
+uint32_t len, addr;
+struct memimage * image;
+struct timeval start, stop;
+double secs, best;
+int i;
+
+	memset(& t, 0, sizeof t);
+	len = megabytes << 20;
+	addr = 0x08000000;
+	if (!(data = malloc(len)))
+	{
+		printf("out of core\n");
+		return -1;
+	}
+	fill_random(data, len);
+	put_area(& t, addr, data, len, 16);
+	put_record(& t, HEX_RECORD_END_OF_FILE, 0, 0, 0);
+
+	best = 0;
+	for (i = 0; i < repeats; i ++)
+	{
+		gettimeofday(& start, 0);
+		image = hexbuf_parse_parallel(t.buf, t.len, "generated image", true, nr_threads);
+		gettimeofday(& stop, 0);
+		secs = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.;
+		if (check_areas(image, & addr, & data, & len, 1))
+		{
+			printf("parsed image contents mismatch\n");
+			return -1;
+		}
+		memimage_destroy(image);
+		if (!i || secs < best)
+			best = secs;
+	}
+	printf("parsed %i bytes of hex text (%i bytes of data) with %i thread(s) in %.3f seconds, %.1f MB/s of text\n",
+			(int) t.len, (int) len, nr_threads, best, best ? t.len / best / (1 << 20) : 0);
+	free(data);
+	free(t.buf);
+	return 0;
+}
+
+static int fuzz(int iterations)
+{
+enum { MAX_AREAS = 3, MAX_AREA_LEN = 2048, MAX_PIECES = 4, };
+struct text t;
+uint8_t * data[MAX_AREAS];
+uint32_t addr[MAX_AREAS], len[MAX_AREAS];
+struct { uint32_t addr, len; uint8_t * data; } pieces[MAX_AREAS * MAX_PIECES], x;
+struct memimage * image, * pimage;
+static const char mutations[] = "0123456789abcdefABCDEFgG:\r\n \x1a";
+int i, j, k, n, nr_areas, nr_pieces, nr_ok;
+uint32_t l;
+
+	memset(& t, 0, sizeof t);
+	for (i = 0; i < MAX_AREAS; i ++)
+		data[i] = malloc(MAX_AREA_LEN);
+	for (nr_ok = i = 0; i < iterations; i ++)
+	{
+		/* generate a random image, made of separated memory areas;
+		 * each area is split in pieces, and the pieces are written
+		 * in random order, sometimes overlapping */
+		t.len = 0;
+		nr_areas = 1 + rand() % MAX_AREAS;
+		for (nr_pieces = j = 0; j < nr_areas; j ++)
+		{
+			len[j] = 1 + rand() % MAX_AREA_LEN;
+			addr[j] = j ? addr[j - 1] + len[j - 1] + 1 + rand() % 0x20000 : (uint32_t) (rand() % 0x100000) << 8;
+			fill_random(data[j], len[j]);
+			for (l = 0, k = 1 + rand() % MAX_PIECES; l < len[j]; k --, l += n)
+			{
+				n = k == 1 ? len[j] - l : 1 + rand() % (len[j] - l);
+				pieces[nr_pieces].addr = addr[j] + l;
+				pieces[nr_pieces].data = data[j] + l;
+				pieces[nr_pieces].len = n;
+				if (l && (rand() & 3) == 0)
+				{
+					/* overlap the previous piece by a byte */
+					pieces[nr_pieces].addr --;
+					pieces[nr_pieces].data --;
+					pieces[nr_pieces].len ++;
+				}
+				nr_pieces ++;
+			}
+		}
+		for (j = nr_pieces - 1; j > 0; j --)
+		{
+			k = rand() % (j + 1);
+			x = pieces[j], pieces[j] = pieces[k], pieces[k] = x;
+		}
+		for (j = 0; j < nr_pieces; j ++)
+			put_area(& t, pieces[j].addr, pieces[j].data, pieces[j].len, 1 + rand() % 255);
+		if (rand() & 1)
+			put_record(& t, HEX_RECORD_END_OF_FILE, 0, 0, 0);
+		/* the unmodified image must parse correctly, both sequentially and in parallel */
+		image = hexbuf_parse(t.buf, t.len, "fuzz image", true);
+		pimage = hexbuf_parse_parallel(t.buf, t.len, "fuzz image", true, 2 + rand() % 7);
+		if (check_areas(image, addr, data, len, nr_areas) || compare_images(image, pimage))
+		{
+			printf("iteration %i: generated image parsed incorrectly\n", i);
+			return -1;
+		}
+		memimage_destroy(image);
+		memimage_destroy(pimage);
+
+		/* corrupt the image and parse it again - it must not crash,
+		 * and if it parses at all, the result must be sane */
+		n = 1 + rand() % 4;
+		while (n --)
+			switch (rand() % 3)
+			{
+				case 0:
+					t.buf[rand() % t.len] = mutations[rand() % (sizeof mutations - 1)];
+					break;
+				case 1:
+					t.buf[rand() % t.len] = rand();
+					break;
+				case 2:
+					t.len = rand() % t.len;
+					if (!t.len)
+						t.len = 1;
+					break;
+			}
+		image = hexbuf_parse(t.buf, t.len, "fuzz image", false);
+		pimage = hexbuf_parse_parallel(t.buf, t.len, "fuzz image", false, 2 + rand() % 7);
+		if (compare_images(image, pimage))
+		{
+			printf("iteration %i: sequential and parallel parsing results differ\n", i);
+			return -1;
+		}
+		memimage_destroy(pimage);
+		if (image)
+		{
+			for (n = j = 0; j < image->nr_areas; j ++)
+			{
+				n += image->areas[j].len;
+				if (j && image->areas[j].addr <= image->areas[j - 1].addr + image->areas[j - 1].len)
+				{
+					printf("iteration %i: memory image areas not sorted and merged\n", i);
+					return -1;
+				}
+			}
+			if (n > t.len / 2)
+			{
+				printf("iteration %i: corrupted image yields too much data\n", i);
+				return -1;
+			}
+			nr_ok ++;
+		}
+		memimage_destroy(image);
+	}
+	printf("%i iterations completed, %i corrupted images still parsed\n", iterations, nr_ok);
+	for (i = 0; i < MAX_AREAS; i ++)
+		free(data[i]);
+	free(t.buf);
+	return 0;
+}
+
 int main(int argc, char ** argv)
 {
-struct data_mem_area * s;
+struct memimage * image;
+int i;
 
-	if (argc != 2)
+	if (argc >= 3 && !strcmp(argv[1], "--bench"))
+		return bench(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 5, argc > 4 ? atoi(argv[4]) : hexreader_get_nr_cpus()) ? 1 : 0;
+	if (argc >= 3 && !strcmp(argv[1], "--fuzz"))
+	{
+		srand(argc > 3 ? atoi(argv[3]) : time(0));
+		return fuzz(atoi(argv[2])) ? 1 : 0;
+	}
+	if (argc == 3 && !strcmp(argv[1], "--srec"))
+		image = srecfile_read(argv[2]);
+	else if (argc == 2)
+		image = hexfile_read(argv[1]);
+	else
 	{
 		printf("usage: %s hexfilename\n", * argv);
+		printf("       %s --srec srecfilename\n", * argv);
+		printf("       %s --bench megabytes [repeats [threads]]\n", * argv);
+		printf("       %s --fuzz iterations [seed]\n", * argv);
 		exit(1);
 	}
-	s = hexfile_read(argv[1]);
-	if (!s)
+	if (!image)
 	{
 		printf("error reading hexfile\n");
 		exit(1);
 	}
-	else
-	{
-		while (s)
-		{
-			printf("memory area: address 0x%08x length 0x%08x\n", s->addr, s->len);
-			s = s->next;
-		}
-	}
+	for (i = 0; i < image->nr_areas; i ++)
+		printf("memory area: address 0x%08x length 0x%08x\n", image->areas[i].addr, image->areas[i].len);
+	memimage_destroy(image);
 	return 0;
 }
 
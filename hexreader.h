@@ -22,19 +22,105 @@ SOFTWARE.
 
 */
 
-struct data_mem_area
-{
-	/*! a list of these */
-	struct data_mem_area	* next;
-	/*! starting address in target memory */
-	uint32_t	addr;
-	/*! size of the memory area, in bytes */
-	uint32_t	len;
-	/*! the data itself */
-	uint8_t		* data;
-
-};
-
-struct data_mem_area * hexfile_read(const char * fname);
-void hexfile_dealloc(struct data_mem_area * areas);
+/*!
+ *	\fn	struct memimage * hexfile_read(const char * fname)
+ *	\brief	reads an intel hex file
+ *
+ *	the file is mapped in memory and parsed by hexbuf_parse_parallel(),
+ *	with a thread for each megabyte of the file, up to the number of
+ *	host processors
+ *
+ *	\param	fname	the name of the intel hex file to read
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * hexfile_read(const char * fname);
+
+/*!
+ *	\fn	int hexfile_stream(const char * fname, int (* data_handler)(void * cookie, uint32_t addr, const uint8_t * data, unsigned len), void * cookie)
+ *	\brief	reads an intel hex file, passing its data records, in file order, to a handler function
+ *
+ *	unlike hexfile_read(), this does not build a memory image, so the
+ *	data can be consumed while the rest of the file is still being read
+ *
+ *	\param	fname	the name of the intel hex file to read
+ *	\param	data_handler	the function to invoke for each data record; its
+ *			parameters are the 'cookie' below, and the address, contents
+ *			and length of the data record; a nonzero return value stops
+ *			reading the file
+ *	\param	cookie	a value passed to the 'data_handler' function
+ *	\return	0 on success, -1 on error, or if the data handler stopped reading the file */
+int hexfile_stream(const char * fname, int (* data_handler)(void * cookie, uint32_t addr, const uint8_t * data, unsigned len), void * cookie);
+
+/*!
+ *	\fn	struct memimage * hexbuf_parse(const char * buf, size_t len, const char * name, bool report_errors)
+ *	\brief	parses intel hex formatted text held in memory
+ *
+ *	each record is decoded and checksummed in a single pass, with
+ *	the data bytes stored directly in the memory image; records
+ *	can come in any address order, and can overlap if the data
+ *	at the overlapping addresses is the same, see memimage_finish()
+ *
+ *	\param	buf	the text to parse
+ *	\param	len	the length of the text, in bytes
+ *	\param	name	the name of the text source, used in error messages
+ *	\param	report_errors	if true, errors are reported (along with
+ *			the number of the offending line) on stderr
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * hexbuf_parse(const char * buf, size_t len, const char * name, bool report_errors);
+
+/*!
+ *	\fn	struct memimage * hexbuf_parse_parallel(const char * buf, size_t len, const char * name, bool report_errors, int nr_threads)
+ *	\brief	parses intel hex formatted text held in memory, using several threads
+ *
+ *	the text is split at record boundaries into (at most) 'nr_threads'
+ *	segments of about the same size, which are parsed in parallel;
+ *	the extended address in effect at the start of each segment is
+ *	then resolved from the segments preceding it, and the segment
+ *	data is merged in a single memory image; the result is the same
+ *	as that of hexbuf_parse()
+ *
+ *	\param	buf	the text to parse
+ *	\param	len	the length of the text, in bytes
+ *	\param	name	the name of the text source, used in error messages
+ *	\param	report_errors	if true, errors are reported (along with
+ *			the number of the offending line) on stderr
+ *	\param	nr_threads	the number of threads to use (including the calling thread)
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * hexbuf_parse_parallel(const char * buf, size_t len, const char * name, bool report_errors, int nr_threads);
+
+/*!
+ *	\fn	struct memimage * srecfile_read(const char * fname)
+ *	\brief	reads a motorola s-record file
+ *
+ *	\param	fname	the name of the s-record file to read
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * srecfile_read(const char * fname);
+
+/*!
+ *	\fn	struct memimage * srecbuf_parse(const char * buf, size_t len, const char * name, bool report_errors)
+ *	\brief	parses motorola s-record formatted text held in memory
+ *
+ *	s1, s2 and s3 data records are decoded and checksummed in a
+ *	single pass, in the same way as by hexbuf_parse(); header (s0) and
+ *	record count (s5, s6) records are ignored, and a termination
+ *	(s7, s8, s9) record ends parsing
+ *
+ *	\param	buf	the text to parse
+ *	\param	len	the length of the text, in bytes
+ *	\param	name	the name of the text source, used in error messages
+ *	\param	report_errors	if true, errors are reported (along with
+ *			the number of the offending line) on stderr
+ *	\return	the memory image read, which must be deallocated with
+ *		memimage_destroy(); null on error */
+struct memimage * srecbuf_parse(const char * buf, size_t len, const char * name, bool report_errors);
+
+/*!
+ *	\fn	int hexreader_get_nr_cpus(void)
+ *	\brief	retrieves the number of processors of the host
+ *
+ *	\return	the number of processors available for parsing */
+int hexreader_get_nr_cpus(void);
 
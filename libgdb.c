@@ -27,8 +27,11 @@ SOFTWARE.
  * include section follows
  */
 #ifdef __LINUX__
+#include <unistd.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #else
 #define _WIN32_WINNT	0x0501
@@ -42,7 +45,10 @@ SOFTWARE.
 #include <stdbool.h>
 #include <malloc.h>
 #include <setjmp.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "libgdb.h"
 
@@ -59,10 +65,34 @@ enum
 	TX_BUF_LEN	= 128,
 	/*! maximum length of received/transmitted packets from the gdbserver */
 	MAX_PACKET_LEN	= 1024 * 8 - 16,
+	/*! minimum length of received/transmitted packets from the gdbserver, used
+	 * as a lower bound when sizing the packet buffers from the packet size
+	 * negotiated with the gdbserver */
+	MIN_PACKET_LEN	= 256,
 	/*! read timeout waiting for data from the gdbserver, seconds part */
 	GDB_SERVER_READ_TIMEOUT_SEC	= 300,
 	/*! read timeout waiting for data from the gdbserver, microseconds part */
 	GDB_SERVER_READ_TIMEOUT_USEC	= 100000,
+	/*! read timeout waiting for the reply to a halt status query ('?') when attaching to a target, in milliseconds;
+	 * gdbservers that do not reply to such queries while the target is running are assumed to have a running target
+	 * when this timeout expires, and the target is halted with a break request */
+	ATTACH_QUERY_TIMEOUT_MSEC	= 300,
+	/*! the maximum number of words transferred (each way) when measuring a transfer chunk size during autotuning */
+	AUTOTUNE_TEST_WORDS	= 4096,
+	/*! the number of times a transfer is repeated for each chunk size being measured during autotuning; the fastest run is taken */
+	AUTOTUNE_NR_REPEATS	= 3,
+	/*! the number of single word reads used for measuring the round trip time during autotuning; the fastest read is taken */
+	AUTOTUNE_NR_RTT_PROBES	= 8,
+	/*! the smallest chunk size (in words) tried during autotuning - this is assumed to be supported by all gdbservers */
+	AUTOTUNE_SAFE_NR_WORDS	= 16,
+	/*! the percentage of the expected duration of an operation that libgdb_poll_word() sleeps through before polling */
+	POLL_EXPECTED_SLEEP_PERCENT	= 75,
+	/*! the initial polling interval of libgdb_poll_word() is the expected duration of the operation polled, divided by this */
+	POLL_INTERVAL_DIVISOR	= 16,
+	/*! the minimum polling interval of libgdb_poll_word(), in microseconds */
+	POLL_MIN_INTERVAL_USEC	= 100,
+	/*! the maximum polling interval of libgdb_poll_word(), in microseconds */
+	POLL_MAX_INTERVAL_USEC	= 50000,
 };
 
 static const char hexchars[16] = "0123456789abcdef";
@@ -84,6 +114,23 @@ enum ENUM_LIBGDB_ERR
 	LIBGDB_ERR_READ_TIMEOUT,
 };
 
+/*! a reception buffer that can be shared by several libgdb contexts
+ *
+ * contexts that are driven from a single thread (e.g. from a single
+ * event loop) are never receiving synchronous replies at the same time,
+ * and can therefore use the same buffer for holding received packets;
+ * the buffer is never reallocated, contexts using an arena have their
+ * packet size limited to the size of the arena buffer */
+struct libgdb_rx_arena
+{
+	/*! the shared reception buffer */
+	char	* buf;
+	/*! the size of the shared reception buffer, in bytes */
+	int	len;
+	/*! the number of contexts currently using this arena */
+	int	nr_users;
+};
+
 /*! context data used by libgdb */
 struct libgdb_ctx
 {
@@ -113,8 +160,30 @@ struct libgdb_ctx
 	 * as can fit in the 'rx/txpacket' buffers below - it is essential that these
 	 * buffer are of the same size */
 	int mem_access_max_nr_words;
+	/*! the round trip time to the gdbserver, in microseconds, as measured (or set) by the last autotuning; zero if unknown */
+	uint32_t rtt_usec;
+	/*! the memory transfer throughput to the gdbserver, in bytes per second, as measured (or set) by the last autotuning; zero if unknown */
+	uint32_t bytes_per_sec;
 	/*! socket over which to communicate with a gdb server */
 	int socket;
+	/*! if nonzero, overrides the default read timeout waiting for data from the gdbserver, in milliseconds; a timeout is then not reported as an error */
+	int read_timeout_msec;
+	/*! set when a stop packet is received and discarded while waiting for the reply to another request, see libgdb_armv7m_start_target_routine() */
+	bool is_halt_seen;
+	/*! the target memory area holding code that is kept resident between uses, see libgdb_set_resident_code()
+	 *
+	 * any memory write that overlaps this area invalidates it,
+	 * this is indicated by setting 'len' to zero */
+	struct
+	{
+		/*! the target address of the resident code */
+		uint32_t addr;
+		/*! the size of the resident code, in bytes; zero if no code is resident */
+		uint32_t len;
+		/*! the checksum of the resident code, as computed by libgdb_compute_crc32() */
+		uint32_t crc;
+	}
+	resident_code;
 	/*! reception buffer */
 	char rxbuf[RX_BUF_LEN];
 	/*! reception buffer read index */
@@ -125,10 +194,20 @@ struct libgdb_ctx
 	char txbuf[RX_BUF_LEN];
 	/*! transmission buffer write index */
 	int txidx;
-	/*! buffer to hold the packet received from the gdbserver */
-	char rxpacket[MAX_PACKET_LEN];
+	/*! the size of the 'rx/txpacket' buffers below, in bytes; zero until a gdbserver connection is established
+	 *
+	 * the buffers are allocated when connecting to a gdbserver, and are
+	 * resized to fit the packet size negotiated with the gdbserver by
+	 * libgdb_negotiate_packet_size() */
+	int packet_len;
+	/*! buffer to hold the packet received from the gdbserver; this is
+	 * either private to this context, or is the buffer of a shared reception
+	 * arena (see 'rx_arena' below) */
+	char * rxpacket;
 	/*! buffer to hold the packet sent to the gdbserver */
-	char txpacket[MAX_PACKET_LEN];
+	char * txpacket;
+	/*! if non-null, the shared reception arena that the 'rxpacket' buffer belongs to */
+	struct libgdb_rx_arena * rx_arena;
 	/*! a data structure holding the data needed for asynchronous packet reception from the target gdbserver probe */
 	struct
 	{
@@ -151,8 +230,10 @@ struct libgdb_ctx
 		uint8_t	cksum;
 		/*! checksum received */
 		uint8_t	rx_cksum;
-		/*! incoming packet data buffer */
-		char async_rxpacket[MAX_PACKET_LEN];
+		/*! incoming packet data buffer, allocated on first use of the asynchronous packet reception routines */
+		char * async_rxpacket;
+		/*! the size of the 'async_rxpacket' buffer, in bytes */
+		int async_rxpacket_len;
 		/*! incoming packet data index */
 		int idx;
 	};
@@ -162,10 +243,36 @@ struct libgdb_ctx
 #endif
 };
 
+/*
+ * local data follows
+ */
+
+#ifndef __LINUX__
+/*! the number of live libgdb contexts; winsock is initialized when
+ * the first context is created, and cleaned up when the last one is
+ * released, so that releasing a context does not break the others */
+static int nr_winsock_users;
+#endif
+
 /*
  * local functions follow
  */
 
+/*!
+ *	\fn	static void close_socket(int sock)
+ *	\brief	closes a socket
+ *
+ *	\param	sock	the socket to close
+ *	\return	none */
+static void close_socket(int sock)
+{
+#ifdef __LINUX__
+	close(sock);
+#else
+	closesocket(sock);
+#endif
+}
+
 
 /*!
  *	\fn	static inline hex(char c)
@@ -248,8 +355,16 @@ static char get_char(struct libgdb_ctx * ctx)
 
 		FD_ZERO(&fd);
 		FD_SET(ctx->socket, &fd);
-		tout.tv_sec = GDB_SERVER_READ_TIMEOUT_SEC;
-		tout.tv_usec = GDB_SERVER_READ_TIMEOUT_USEC;
+		if (ctx->read_timeout_msec)
+		{
+			tout.tv_sec = ctx->read_timeout_msec / 1000;
+			tout.tv_usec = (ctx->read_timeout_msec % 1000) * 1000;
+		}
+		else
+		{
+			tout.tv_sec = GDB_SERVER_READ_TIMEOUT_SEC;
+			tout.tv_usec = GDB_SERVER_READ_TIMEOUT_USEC;
+		}
 		i = select(ctx->socket + 1, & fd, 0, 0, & tout);
 		if (i == 1 && FD_ISSET(ctx->socket, &fd))
 		{
@@ -269,7 +384,8 @@ static char get_char(struct libgdb_ctx * ctx)
 		}
 		else
 		{
-			eprintf("timeout receiving data from the gdbserver\n");
+			if (!ctx->read_timeout_msec)
+				eprintf("timeout receiving data from the gdbserver\n");
 			ctx->err = LIBGDB_ERR_READ_TIMEOUT;
 			longjmp(ctx->jmpbuf, ctx->err);
 		}
@@ -353,7 +469,7 @@ retry:
 			if (c == '#')
 				break;
 			cksum = cksum + c;
-			if (i < sizeof ctx->rxpacket - 1)
+			if (i < ctx->packet_len - 1)
 				ctx->rxpacket[i ++] = c;
 		}
 		ctx->rxpacket[i ++] = 0;
@@ -383,18 +499,86 @@ retry:
 				memmove(ctx->rxpacket, ctx->rxpacket + 3, i - 3);
 			}
 			/* packet received successfully - check for packet overflow */
-			if (i == sizeof ctx->rxpacket)
+			if (i == ctx->packet_len)
 			{
 				eprintf("packet received too long, packet will be discarded\n");
 				return -1;
 			}
 			else if (!ignore_stop_packets || (ctx->rxpacket[0] != 'S' && ctx->rxpacket[0] != 'T'))
 				return 0;
+			/* a stop packet is being discarded - remember that the target has halted */
+			ctx->is_halt_seen = true;
+
+		}
+	}
+}
+
+
+/*!
+ *	\fn	static void discard_packet(struct libgdb_ctx * ctx)
+ *	\brief	receives and discards a packet sent by the gdbserver on its own, after its start character ('$') has been received
+ *
+ *	a packet may be sent by the gdbserver on its own if the target has been
+ *	resumed and has halted without being waited for, see libgdb_armv7m_start_target_routine();
+ *	the packet is read up to its end, even if it arrives in pieces; if
+ *	its checksum is valid, the packet is acknowledged, and a stop packet
+ *	is recorded in the 'is_halt_seen' field of the libgdb context;
+ *	otherwise, retransmission of the packet is requested
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none
+ *	\note	in case of an error, this function will longjmp()
+ *		to the context saved in ctx->jmpbuf */
+static void discard_packet(struct libgdb_ctx * ctx)
+{
+unsigned char cksum, xcksum;
+char c, first;
 
+	cksum = 0;
+	first = c = get_char(ctx);
+	while (c != '#')
+	{
+		if (c == '$')
+		{
+			/* a new packet starts - the one being received is incomplete */
+			cksum = 0;
+			first = c = get_char(ctx);
+			continue;
 		}
+		cksum += c;
+		c = get_char(ctx);
+	}
+	xcksum = hex(get_char(ctx)) << 4;
+	xcksum |= hex(get_char(ctx));
+	if (cksum != xcksum)
+		send_char(ctx, '-');
+	else
+	{
+		if (first == 'S' || first == 'T')
+			ctx->is_halt_seen = true;
+		send_char(ctx, '+');
 	}
+	txsync(ctx);
 }
 
+/*!
+ *	\fn	static char get_ack_char(struct libgdb_ctx * ctx)
+ *	\brief	retrieves the acknowledgement character for a packet sent to a connected gdbserver
+ *
+ *	packets sent by the gdbserver on its own (e.g. a stop packet, when a
+ *	target that has been resumed halts) may precede the acknowledgement;
+ *	such packets are processed by discard_packet()
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	the acknowledgement character received */
+static char get_ack_char(struct libgdb_ctx * ctx)
+{
+char c;
+
+	while ((c = get_char(ctx)) == '$')
+		discard_packet(ctx);
+	return c;
+}
 
 /*!
  *	\fn	static void putpacket(struct libgdb_ctx * ctx, bool wait_confirmation)
@@ -431,13 +615,19 @@ static void putpacket(struct libgdb_ctx * ctx, bool wait_confirmation)
 			FD_SET(ctx->socket, &fd);
 			tout.tv_sec = GDB_SERVER_READ_TIMEOUT_SEC;
 			tout.tv_usec = GDB_SERVER_READ_TIMEOUT_USEC;
+			ctx->rxidx = ctx->rxcnt = 0;
 			i = select(ctx->socket + 1, & fd, 0, 0, & tout);
 			if (i == 1 && FD_ISSET(ctx->socket, &fd))
 			{
-				recv(ctx->socket, ctx->rxbuf, sizeof ctx->rxbuf, 0);
+				if ((i = recv(ctx->socket, ctx->rxbuf, sizeof ctx->rxbuf, 0)) > 0)
+					ctx->rxcnt = i;
 			}
 		}
-		ctx->rxidx = ctx->rxcnt = 0;
+		/* discard any stray data received, except for packets sent by
+		 * the gdbserver on its own - a stop packet must not be lost */
+		while (ctx->rxidx != ctx->rxcnt)
+			if (get_char(ctx) == '$')
+				discard_packet(ctx);
 		send_char(ctx, '$');
 		cksum = 0;
 		i = 0;
@@ -456,7 +646,7 @@ static void putpacket(struct libgdb_ctx * ctx, bool wait_confirmation)
 		txsync(ctx);
 
 	}
-	while (wait_confirmation && (c = (get_char(ctx)) != '+'));
+	while (wait_confirmation && (c = (get_ack_char(ctx)) != '+'));
 }
 
 
@@ -497,13 +687,202 @@ char * s;
  *		packet for memory write request packets */
 static inline int get_max_mem_xfer_words(struct libgdb_ctx * ctx)
 {
-	return (MAX_PACKET_LEN
+	return (ctx->packet_len
 			- /* one byte for the null terminator */ 1
 			- /* ... and one more, the checks for packet overflow depend on this */ 1
 			- /* maximum length of the 'Mxxx,xxx:' command string */ 19)
 			/ (sizeof(uint32_t) << /* 2 ascii hex characters per byte */ 1);
 }
 
+/*!
+ *	\fn	static void clamp_max_mem_xfer_words(struct libgdb_ctx * ctx)
+ *	\brief	limits the maximum number of words transferred in a single memory access packet to what fits in the packet buffers
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none */
+static void clamp_max_mem_xfer_words(struct libgdb_ctx * ctx)
+{
+int i;
+
+	i = get_max_mem_xfer_words(ctx);
+	if (ctx->mem_access_max_nr_words > i)
+		ctx->mem_access_max_nr_words = i;
+}
+
+/*!
+ *	\fn	static int alloc_packet_buffers(struct libgdb_ctx * ctx, int len)
+ *	\brief	allocates (or resizes) the packet buffers of a libgdb context
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	len	the requested size of the packet buffers, in bytes; if the
+ *			context uses a shared reception arena, this is limited to
+ *			the size of the arena buffer
+ *	\return	0 on success, -1 if out of memory */
+static int alloc_packet_buffers(struct libgdb_ctx * ctx, int len)
+{
+char * rx, * tx;
+
+	if (ctx->rx_arena && len > ctx->rx_arena->len)
+		len = ctx->rx_arena->len;
+	if (!(tx = realloc(ctx->txpacket, len)))
+		goto out_of_core;
+	ctx->txpacket = tx;
+	if (ctx->rx_arena)
+		ctx->rxpacket = ctx->rx_arena->buf;
+	else
+	{
+		if (!(rx = realloc(ctx->rxpacket, len)))
+			goto out_of_core;
+		ctx->rxpacket = rx;
+	}
+	ctx->packet_len = len;
+	clamp_max_mem_xfer_words(ctx);
+	return 0;
+
+out_of_core:
+	eprintf("out of core\n");
+	return -1;
+}
+
+/*!
+ *	\fn	static int alloc_async_rxpacket(struct libgdb_ctx * ctx)
+ *	\brief	allocates the asynchronous packet reception buffer of a libgdb context, if not already allocated
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	0 on success, -1 if out of memory */
+static int alloc_async_rxpacket(struct libgdb_ctx * ctx)
+{
+int len;
+
+	if (ctx->async_rxpacket)
+		return 0;
+	len = ctx->packet_len ? ctx->packet_len : MAX_PACKET_LEN;
+	if (!(ctx->async_rxpacket = malloc(len)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	ctx->async_rxpacket_len = len;
+	return 0;
+}
+
+/*!
+ *	\fn	static uint64_t get_usec(void)
+ *	\brief	retrieves the current time, in microseconds
+ *
+ *	\return	the current time, in microseconds */
+static uint64_t get_usec(void)
+{
+struct timeval tv;
+
+	gettimeofday(& tv, 0);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*!
+ *	\fn	static void sleep_usec(uint32_t usec)
+ *	\brief	suspends execution for a number of microseconds
+ *
+ *	\param	usec	the time to sleep, in microseconds; on windows,
+ *			this is rounded up to whole milliseconds
+ *	\return	none */
+static void sleep_usec(uint32_t usec)
+{
+#ifdef __LINUX__
+struct timespec t;
+
+	t.tv_sec = usec / 1000000;
+	t.tv_nsec = (usec % 1000000) * 1000;
+	nanosleep(& t, 0);
+#else
+	Sleep((usec + 999) / 1000);
+#endif
+}
+
+/*!
+ *	\fn	static int get_max_mem_xfer_bytes(struct libgdb_ctx * ctx)
+ *	\brief	retrieves the maximum number of bytes transferred in a single memory access packet
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	the maximum number of bytes transferred in a single memory
+ *		access packet, -1 if an error occurs */
+static int get_max_mem_xfer_bytes(struct libgdb_ctx * ctx)
+{
+int maxwords;
+
+	/* see how many words can be transferred in one run */
+	if (ctx->mem_access_max_nr_words == 0)
+	{
+		maxwords = get_max_mem_xfer_words(ctx);
+		if (maxwords <= 0)
+			/* ??? */
+			return -1;
+	}
+	else
+		maxwords = ctx->mem_access_max_nr_words;
+	return maxwords * sizeof(uint32_t);
+}
+
+/*!
+ *	\fn	static int read_mem_packet(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf)
+ *	\brief	reads target memory with a single memory read request packet
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from
+ *	\param	len	number of bytes to read, must fit in a single packet
+ *	\param	buf	buffer where to store the memory read
+ *	\return	0 on success, -1 if an error occurs */
+static int read_mem_packet(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf)
+{
+	snprintf(ctx->txpacket, ctx->packet_len, "m%x,%x", addr, len);
+	putpacket(ctx, true);
+	if (getpacket(ctx, true))
+	{
+		eprintf("%s(): error getting packet\n", __func__);
+		return -1;
+	}
+	if (is_error_packet(ctx) || strlen(ctx->rxpacket) < len * 2)
+	{
+		eprintf("%s(): error reading target memory\n", __func__);
+		return -1;
+	}
+	hex_to_mem((char *) buf, ctx->rxpacket, len);
+	return 0;
+}
+
+/*!
+ *	\fn	static int write_mem_packet(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf)
+ *	\brief	writes target memory with a single memory write request packet
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to
+ *	\param	len	number of bytes to write, must fit in a single packet
+ *	\param	buf	buffer containing the data to be written
+ *	\return	0 on success, -1 if an error occurs */
+static int write_mem_packet(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf)
+{
+int i;
+
+	if (ctx->resident_code.len && addr < ctx->resident_code.addr + ctx->resident_code.len
+			&& ctx->resident_code.addr < addr + len)
+		/* overwriting resident code */
+		ctx->resident_code.len = 0;
+	i = snprintf(ctx->txpacket, ctx->packet_len, "M%x,%x:", addr, len);
+	mem_to_hex(ctx->txpacket + i, (char *) buf, len);
+	putpacket(ctx, true);
+	if (getpacket(ctx, true))
+	{
+		eprintf("%s(): error getting packet\n", __func__);
+		return -1;
+	}
+	if (is_error_packet(ctx) != 1)
+	{
+		eprintf("%s(): error writing target memory\n", __func__);
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * exported functions follow
  */
@@ -559,6 +938,161 @@ int i;
 	return i;
 }
 
+/*!
+ *	\fn	int libgdb_autotune_max_nr_words_xferred(struct libgdb_ctx * ctx, uint32_t scratch_addr, uint32_t scratch_len)
+ *	\brief	measures the memory transfer performance of a connected gdbserver and selects the fastest transfer chunk size
+ *
+ *	the round trip time of the gdbserver is measured first, then the
+ *	throughput of writing and reading back target memory is measured
+ *	for several transfer chunk sizes, starting from a small chunk size
+ *	that all gdbservers are expected to support; the first chunk size
+ *	that fails (or that reads back different data than written) stops
+ *	the measurement; the chunk size with the highest throughput is then
+ *	set as if by calling libgdb_set_max_nr_words_xferred(), and the
+ *	measured round trip time and throughput are made available by
+ *	libgdb_get_link_stats()
+ *
+ *	the contents of the scratch memory area are saved before, and
+ *	restored after the measurements
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	scratch_addr	the start address of a target ram area that
+ *				can be used for the measurements
+ *	\param	scratch_len	the length of the scratch area, in bytes
+ *	\return	the selected maximum number of words transferred in
+ *		a single memory access request packet, -1 if an error occurs
+ *
+ *	\note	the target must be halted prior to invoking this routine */
+int libgdb_autotune_max_nr_words_xferred(struct libgdb_ctx * ctx, uint32_t scratch_addr, uint32_t scratch_len)
+{
+static const int chunk_sizes[] = { AUTOTUNE_SAFE_NR_WORDS, 32, 64, 128, 256, 512, 768, 1024, 1536, 0, };
+uint32_t * save, * wbuf, * rbuf;
+int i, j, wordcnt, maxwords, best_nr_words, prev_nr_words;
+uint64_t t, best_time, rtt;
+uint32_t x;
+bool is_annotation_enabled;
+
+	wordcnt = scratch_len / sizeof(uint32_t);
+	if (wordcnt > AUTOTUNE_TEST_WORDS)
+		wordcnt = AUTOTUNE_TEST_WORDS;
+	maxwords = get_max_mem_xfer_words(ctx);
+	if (wordcnt <= 0 || maxwords <= 0)
+		return -1;
+	if (!(save = malloc(3 * wordcnt * sizeof * save)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	wbuf = save + wordcnt;
+	rbuf = wbuf + wordcnt;
+	for (i = 0; i < wordcnt; i ++)
+		wbuf[i] = 0xa5a50000 ^ (i * 0x01000193);
+
+	is_annotation_enabled = libgdb_set_annotation(ctx, false);
+	prev_nr_words = ctx->mem_access_max_nr_words;
+	ctx->mem_access_max_nr_words = AUTOTUNE_SAFE_NR_WORDS;
+	if (libgdb_readwords(ctx, scratch_addr, wordcnt, save))
+	{
+		eprintf("error saving the scratch memory area contents\n");
+		ctx->mem_access_max_nr_words = prev_nr_words;
+		libgdb_set_annotation(ctx, is_annotation_enabled);
+		free(save);
+		return -1;
+	}
+
+	/* measure the round trip time */
+	for (rtt = ~ 0, i = 0; i < AUTOTUNE_NR_RTT_PROBES; i ++)
+	{
+		t = get_usec();
+		if (libgdb_readwords(ctx, scratch_addr, 1, & x))
+			break;
+		t = get_usec() - t;
+		if (t < rtt)
+			rtt = t;
+	}
+
+	/* measure the throughput for the different chunk sizes */
+	best_nr_words = AUTOTUNE_SAFE_NR_WORDS;
+	best_time = ~ 0;
+	for (i = 0; chunk_sizes[i]; i ++)
+	{
+		if (chunk_sizes[i] > maxwords)
+			break;
+		ctx->mem_access_max_nr_words = chunk_sizes[i];
+		for (j = 0; j < AUTOTUNE_NR_REPEATS; j ++)
+		{
+			t = get_usec();
+			if (libgdb_writewords(ctx, scratch_addr, wordcnt, wbuf)
+					|| libgdb_readwords(ctx, scratch_addr, wordcnt, rbuf))
+				break;
+			t = get_usec() - t;
+			if (memcmp(wbuf, rbuf, wordcnt * sizeof * wbuf))
+				break;
+			if (t < best_time)
+				best_time = t, best_nr_words = chunk_sizes[i];
+		}
+		if (j != AUTOTUNE_NR_REPEATS)
+			/* this chunk size is not supported by the gdbserver - do not try larger ones */
+			break;
+		/* if the chunk size covers the whole test transfer, larger chunk sizes will not make a difference */
+		if (chunk_sizes[i] >= wordcnt)
+			break;
+	}
+
+	/* restore the scratch memory area */
+	ctx->mem_access_max_nr_words = best_nr_words;
+	if (libgdb_writewords(ctx, scratch_addr, wordcnt, save))
+	{
+		ctx->mem_access_max_nr_words = AUTOTUNE_SAFE_NR_WORDS;
+		if (libgdb_writewords(ctx, scratch_addr, wordcnt, save))
+			eprintf("error restoring the scratch memory area contents\n");
+		best_nr_words = AUTOTUNE_SAFE_NR_WORDS;
+	}
+	libgdb_set_annotation(ctx, is_annotation_enabled);
+	free(save);
+
+	ctx->rtt_usec = (rtt == (uint64_t) ~ 0) ? 0 : rtt;
+	if (best_time == (uint64_t) ~ 0 || !best_time)
+		ctx->bytes_per_sec = 0;
+	else
+		ctx->bytes_per_sec = (uint64_t) 2 * wordcnt * sizeof(uint32_t) * 1000000 / best_time;
+	ctx->mem_access_max_nr_words = best_nr_words;
+	return best_nr_words;
+}
+
+/*!
+ *	\fn	void libgdb_get_link_stats(struct libgdb_ctx * ctx, uint32_t * rtt_usec, uint32_t * bytes_per_sec)
+ *	\brief	retrieves the gdbserver link performance figures measured by libgdb_autotune_max_nr_words_xferred()
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	rtt_usec	a pointer to where to store the round trip time,
+ *				in microseconds; can be null
+ *	\param	bytes_per_sec	a pointer to where to store the memory transfer
+ *				throughput, in bytes per second; can be null
+ *	\return	none
+ *	\note	the values stored are zero if they are not known */
+void libgdb_get_link_stats(struct libgdb_ctx * ctx, uint32_t * rtt_usec, uint32_t * bytes_per_sec)
+{
+	if (rtt_usec)
+		* rtt_usec = ctx->rtt_usec;
+	if (bytes_per_sec)
+		* bytes_per_sec = ctx->bytes_per_sec;
+}
+
+/*!
+ *	\fn	void libgdb_set_link_stats(struct libgdb_ctx * ctx, uint32_t rtt_usec, uint32_t bytes_per_sec)
+ *	\brief	sets the gdbserver link performance figures, e.g. when restoring previously cached autotuning results
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	rtt_usec	the round trip time, in microseconds
+ *	\param	bytes_per_sec	the memory transfer throughput, in bytes per second
+ *	\return	none */
+void libgdb_set_link_stats(struct libgdb_ctx * ctx, uint32_t rtt_usec, uint32_t bytes_per_sec)
+{
+	ctx->rtt_usec = rtt_usec;
+	ctx->bytes_per_sec = bytes_per_sec;
+}
+
 /*!
  *	\fn	struct libgdb_ctx * libgdb_init(void)
  *	\brief	initializes the libgdb library
@@ -578,6 +1112,7 @@ struct libgdb_ctx * s;
 	s->is_annotation_enabled = false;
 	s->state = ASYNC_RX_STATE_WAITING_START;
 #ifndef __LINUX__
+	if (!nr_winsock_users)
 	{
 		int err;
 		err = WSAStartup(MAKEWORD(1, 1), & s->wsadata);
@@ -588,6 +1123,7 @@ struct libgdb_ctx * s;
 			return 0;
 		}
 	}
+	nr_winsock_users ++;
 #endif
 	return s;
 }
@@ -606,6 +1142,7 @@ struct libgdb_ctx * s;
 int libgdb_connect(struct libgdb_ctx * ctx, const char * host, int port_nr)
 {
 struct sockaddr_in addr;
+int nodelay;
 
 	if ((ctx->socket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
 	{
@@ -619,127 +1156,542 @@ struct sockaddr_in addr;
 
 	if (connect(ctx->socket, & addr, sizeof addr))
 	{
-		close(ctx->socket);
+		close_socket(ctx->socket);
 		eprintf("connect() error\n");
 		return -1;
 	}
+	/* the protocol is a strict request-reply one, with the acknowledge
+	 * characters and the packets sent separately - disable the nagle
+	 * algorithm, or else each packet would be held back until the
+	 * (delayed) tcp acknowledge for the preceding '+' arrives */
+	nodelay = 1;
+	setsockopt(ctx->socket, IPPROTO_TCP, TCP_NODELAY, (const char *) & nodelay, sizeof nodelay);
+	/* until a packet size is negotiated, use the largest supported one */
+	if (alloc_packet_buffers(ctx, MAX_PACKET_LEN))
+	{
+		close_socket(ctx->socket);
+		return -1;
+	}
 	send_char(ctx, '+');
 	txsync(ctx);
 	return 0;
 }
 
 /*!
- *	\fn	int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
- *	\brief	reads words from a target controlled by a connected gdb server
+ *	\fn	int libgdb_negotiate_packet_size(struct libgdb_ctx * ctx)
+ *	\brief	negotiates the packet size with a connected gdbserver, and resizes the packet buffers accordingly
+ *
+ *	the packet size supported by the gdbserver is retrieved with a
+ *	'qSupported' request; if the gdbserver does not report a packet
+ *	size, the packet buffers are left at their default (maximum) size;
+ *	the maximum number of words transferred in a single memory access
+ *	packet is reduced, if necessary, to fit the new packet size
  *
  *	\param	ctx	libgdb library context as returned by libgdb_init
- *	\param	addr	target address to read from
- *	\param	wordcnt	number of words to read
- *	\param	buf	buffer where to store the memory read
- *	\return	0 on success, -1 if an error occurs */
-int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+ *	\return	the packet size in effect on success, -1 if an error occurs */
+int libgdb_negotiate_packet_size(struct libgdb_ctx * ctx)
 {
-int maxwords, x;
-int total, cur;
+char * s;
+int len;
 
-	/* see how many words can be transferred in one run */
-	if (ctx->mem_access_max_nr_words == 0)
+	strcpy(ctx->txpacket, "qSupported");
+	putpacket(ctx, true);
+	if (getpacket(ctx, true))
 	{
-		maxwords = get_max_mem_xfer_words(ctx);
-		if (maxwords <= 0)
-			/* ??? */
-			return -1;
+		eprintf("%s(): error getting packet\n", __func__);
+		return -1;
 	}
-	else
-		maxwords = ctx->mem_access_max_nr_words;
-	cur = 0;
-	total = wordcnt * sizeof(uint32_t);
-	while (wordcnt)
-	{
-		x = (maxwords > wordcnt) ? wordcnt : maxwords;
-		snprintf(ctx->txpacket, sizeof ctx->txpacket, "m%x,%x", addr, x * sizeof(uint32_t));
-		putpacket(ctx, true);
-		if (getpacket(ctx, true))
-		{
-			eprintf("%s(): error getting packet\n", __func__);
-			return -1;
-		}
-		if (is_error_packet(ctx))
-		{
-			eprintf("%s(): error reading target memory\n", __func__);
-			return -1;
-		}
-		hex_to_mem((char *) buf, ctx->rxpacket, x * sizeof(uint32_t));
+	if (!(s = strstr(ctx->rxpacket, "PacketSize=")))
+		/* packet size not reported, keep the defaults */
+		return ctx->packet_len;
+	/* reserve one byte for a null terminator */
+	len = strtol(s + sizeof "PacketSize=" - 1, 0, 16) + 1;
+	if (len < MIN_PACKET_LEN)
+		len = MIN_PACKET_LEN;
+	if (len > MAX_PACKET_LEN)
+		len = MAX_PACKET_LEN;
+	if (alloc_packet_buffers(ctx, len))
+		return -1;
+	return ctx->packet_len;
+}
 
-		addr += x * sizeof(uint32_t);
-		buf += x;
-		wordcnt -= x;
-		cur += x * sizeof(uint32_t);
-		if (ctx->is_annotation_enabled)
-		{
-			printf("[VX-MEM-READ-PROGRESS]\t%i\t%i\n", cur, total);
-			fflush(stdout);
-		}
+/*!
+ *	\fn	struct libgdb_rx_arena * libgdb_rx_arena_create(int len)
+ *	\brief	creates a reception arena that can be shared by several libgdb contexts
+ *
+ *	\param	len	the size of the arena buffer, in bytes; this limits the packet
+ *			size of the contexts using the arena; if zero, the maximum
+ *			packet size supported by libgdb is used
+ *	\return	the arena created, null if an error occurs */
+struct libgdb_rx_arena * libgdb_rx_arena_create(int len)
+{
+struct libgdb_rx_arena * arena;
+
+	if (len <= 0 || len > MAX_PACKET_LEN)
+		len = MAX_PACKET_LEN;
+	if (len < MIN_PACKET_LEN)
+		len = MIN_PACKET_LEN;
+	if (!(arena = calloc(1, sizeof * arena)) || !(arena->buf = malloc(len)))
+	{
+		free(arena);
+		eprintf("out of core\n");
+		return 0;
+	}
+	arena->len = len;
+	return arena;
+}
+
+/*!
+ *	\fn	int libgdb_rx_arena_destroy(struct libgdb_rx_arena * arena)
+ *	\brief	destroys a reception arena created by libgdb_rx_arena_create()
+ *
+ *	\param	arena	the arena to destroy; it must not be used by any context
+ *	\return	0 on success, -1 if the arena is still in use */
+int libgdb_rx_arena_destroy(struct libgdb_rx_arena * arena)
+{
+	if (arena->nr_users)
+	{
+		eprintf("reception arena still in use\n");
+		return -1;
 	}
+	free(arena->buf);
+	free(arena);
 	return 0;
 }
 
 /*!
- *	\fn	int libgdb_writewords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
- *	\brief	writes words to a target controlled by a connected gdb server
+ *	\fn	int libgdb_set_rx_arena(struct libgdb_ctx * ctx, struct libgdb_rx_arena * arena)
+ *	\brief	makes a libgdb context use a shared reception arena for receiving packets
+ *
+ *	the context releases its private reception buffer, and holds the
+ *	packets it receives in the arena buffer instead; packets received
+ *	by a context are then only valid until another context sharing the
+ *	same arena receives a packet - this is the case with contexts that
+ *	are driven from a single thread; if the arena buffer is smaller
+ *	than the current packet size of the context, the packet size is
+ *	reduced to the arena buffer size; the asynchronous packet reception
+ *	buffer is never shared, as it holds partially received packets
  *
  *	\param	ctx	libgdb library context as returned by libgdb_init
- *	\param	addr	target address to write to
- *	\param	wordcnt	number of words to write
- *	\param	buf	buffer containing the data to be written
+ *	\param	arena	the arena to use; if null, the context stops using
+ *			a shared arena and allocates a private reception buffer again
  *	\return	0 on success, -1 if an error occurs */
-int libgdb_writewords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+int libgdb_set_rx_arena(struct libgdb_ctx * ctx, struct libgdb_rx_arena * arena)
 {
-int maxwords, x, i;
-int total, cur;
+char * rx;
 
-	/* see how many words can be transferred in one run */
-	if (ctx->mem_access_max_nr_words == 0)
+	if (arena == ctx->rx_arena)
+		return 0;
+	if (arena)
 	{
-		maxwords = get_max_mem_xfer_words(ctx);
-		if (maxwords <= 0)
-			/* ??? */
-			return -1;
+		if (ctx->rx_arena)
+			ctx->rx_arena->nr_users --;
+		else
+			free(ctx->rxpacket);
+		arena->nr_users ++;
+		ctx->rx_arena = arena;
+		ctx->rxpacket = arena->buf;
+		if (ctx->packet_len > arena->len)
+		{
+			ctx->packet_len = arena->len;
+			clamp_max_mem_xfer_words(ctx);
+		}
 	}
 	else
-		maxwords = ctx->mem_access_max_nr_words;
-	cur = 0;
-	total = wordcnt * sizeof(uint32_t);
-	while (wordcnt)
 	{
-		x = (maxwords > wordcnt) ? wordcnt : maxwords;
-		i = snprintf(ctx->txpacket, sizeof ctx->txpacket, "M%x,%x:", addr, x * sizeof(uint32_t));
-		mem_to_hex(ctx->txpacket + i, (char *) buf, x * sizeof(uint32_t));
-		putpacket(ctx, true);
-		if (getpacket(ctx, true))
+		rx = 0;
+		if (ctx->packet_len && !(rx = malloc(ctx->packet_len)))
 		{
-			eprintf("%s(): error getting packet\n", __func__);
+			eprintf("out of core\n");
 			return -1;
 		}
-		if (is_error_packet(ctx) != 1)
-		{
-			eprintf("%s(): error writing target memory\n", __func__);
+		ctx->rx_arena->nr_users --;
+		ctx->rx_arena = 0;
+		ctx->rxpacket = rx;
+	}
+	return 0;
+}
+
+/*!
+ *	\fn	void libgdb_deinit(struct libgdb_ctx * ctx)
+ *	\brief	closes the gdbserver connection of a libgdb context (if any), and releases the context
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none */
+void libgdb_deinit(struct libgdb_ctx * ctx)
+{
+	if (ctx->packet_len)
+		close_socket(ctx->socket);
+	if (ctx->rx_arena)
+		ctx->rx_arena->nr_users --;
+	else
+		free(ctx->rxpacket);
+	free(ctx->txpacket);
+	free(ctx->async_rxpacket);
+#ifndef __LINUX__
+	if (!-- nr_winsock_users)
+		WSACleanup();
+#endif
+	free(ctx);
+}
+
+/*!
+ *	\fn	int libgdb_readmem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf)
+ *	\brief	reads bytes from a target controlled by a connected gdb server
+ *
+ *	neither the address nor the length need be word aligned; the
+ *	memory is read with one request packet per transfer chunk, any
+ *	alignment the target needs is handled by the gdbserver
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from
+ *	\param	len	number of bytes to read
+ *	\param	buf	buffer where to store the memory read
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_readmem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf)
+{
+int maxbytes;
+uint32_t x, cur;
+
+	if ((maxbytes = get_max_mem_xfer_bytes(ctx)) <= 0)
+		return -1;
+	cur = 0;
+	while (cur != len)
+	{
+		x = (maxbytes > len - cur) ? len - cur : maxbytes;
+		if (read_mem_packet(ctx, addr + cur, x, (uint8_t *) buf + cur))
 			return -1;
+		cur += x;
+		if (ctx->is_annotation_enabled)
+		{
+			printf("[VX-MEM-READ-PROGRESS]\t%i\t%i\n", cur, len);
+			fflush(stdout);
 		}
+	}
+	return 0;
+}
+
+/*!
+ *	\fn	int libgdb_writemem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf)
+ *	\brief	writes bytes to a target controlled by a connected gdb server
+ *
+ *	neither the address nor the length need be word aligned; the
+ *	memory is written with one request packet per transfer chunk,
+ *	without any read-modify-write cycles on the host side
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to
+ *	\param	len	number of bytes to write
+ *	\param	buf	buffer containing the data to be written
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_writemem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf)
+{
+int maxbytes;
+uint32_t x, cur;
 
-		addr += x * sizeof(uint32_t);
-		buf += x;
-		wordcnt -= x;
-		cur += x * sizeof(uint32_t);
+	if ((maxbytes = get_max_mem_xfer_bytes(ctx)) <= 0)
+		return -1;
+	cur = 0;
+	while (cur != len)
+	{
+		x = (maxbytes > len - cur) ? len - cur : maxbytes;
+		if (write_mem_packet(ctx, addr + cur, x, (const uint8_t *) buf + cur))
+			return -1;
+		cur += x;
 		if (ctx->is_annotation_enabled)
 		{
-			printf("[VX-MEM-WRITE-PROGRESS]\t%i\t%i\n", cur, total);
+			printf("[VX-MEM-WRITE-PROGRESS]\t%i\t%i\n", cur, len);
 			fflush(stdout);
 		}
 	}
 	return 0;
 }
 
+/*!
+ *	\fn	int libgdb_readmem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, void * buf)
+ *	\brief	reads target memory using accesses of a specified width
+ *
+ *	each element is read with a separate request packet whose length
+ *	equals the access width; gdbservers perform naturally aligned
+ *	requests of 1, 2 or 4 bytes as a single access of that width, which
+ *	makes this suitable for accessing peripheral registers
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from, must be aligned on the access width
+ *	\param	width	the access width, in bytes - 1, 2 or 4
+ *	\param	count	number of consecutive elements to read
+ *	\param	buf	buffer where to store the memory read, in target byte order
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_readmem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, void * buf)
+{
+int i;
+
+	if ((width != 1 && width != 2 && width != 4) || (addr & (width - 1)))
+	{
+		eprintf("%s(): bad access width (%i) or address alignment (0x%08x)\n", __func__, width, addr);
+		return -1;
+	}
+	for (i = 0; i < count; i ++)
+		if (read_mem_packet(ctx, addr + i * width, width, (uint8_t *) buf + i * width))
+			return -1;
+	return 0;
+}
+
+/*!
+ *	\fn	int libgdb_writemem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, const void * buf)
+ *	\brief	writes target memory using accesses of a specified width
+ *
+ *	each element is written with a separate request packet whose length
+ *	equals the access width, see libgdb_readmem_width()
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to, must be aligned on the access width
+ *	\param	width	the access width, in bytes - 1, 2 or 4
+ *	\param	count	number of consecutive elements to write
+ *	\param	buf	buffer containing the data to be written, in target byte order
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_writemem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, const void * buf)
+{
+int i;
+
+	if ((width != 1 && width != 2 && width != 4) || (addr & (width - 1)))
+	{
+		eprintf("%s(): bad access width (%i) or address alignment (0x%08x)\n", __func__, width, addr);
+		return -1;
+	}
+	for (i = 0; i < count; i ++)
+		if (write_mem_packet(ctx, addr + i * width, width, (const uint8_t *) buf + i * width))
+			return -1;
+	return 0;
+}
+
+/*!
+ *	\fn	int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+ *	\brief	reads words from a target controlled by a connected gdb server
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from
+ *	\param	wordcnt	number of words to read
+ *	\param	buf	buffer where to store the memory read
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+{
+	return libgdb_readmem(ctx, addr, wordcnt * sizeof(uint32_t), buf);
+}
+
+/*!
+ *	\fn	int libgdb_writewords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+ *	\brief	writes words to a target controlled by a connected gdb server
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to
+ *	\param	wordcnt	number of words to write
+ *	\param	buf	buffer containing the data to be written
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_writewords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
+{
+	return libgdb_writemem(ctx, addr, wordcnt * sizeof(uint32_t), buf);
+}
+
+/*!
+ *	\fn	int libgdb_poll_word(struct libgdb_ctx * ctx, uint32_t addr, uint32_t mask, uint32_t value, uint32_t expected_usec, uint32_t timeout_usec, uint32_t * word)
+ *	\brief	waits for a target word (e.g. a peripheral status register) to hold a value
+ *
+ *	the word is read until its bits selected by 'mask' equal 'value';
+ *	rather than reading the word back to back, this function first
+ *	sleeps through most of the expected duration of the operation
+ *	waited for (if known), and then polls the word at increasing
+ *	intervals, so that long operations (e.g. flash erasure) do not
+ *	load the link and the gdbserver needlessly
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address of the word to poll
+ *	\param	mask	the bits of the word to compare
+ *	\param	value	the value expected for the bits selected by 'mask'
+ *	\param	expected_usec	the expected time for the word to attain
+ *				the value, in microseconds; can be zero if
+ *				unknown, or if the word is expected to already
+ *				hold the value
+ *	\param	timeout_usec	the time after which waiting is abandoned, in microseconds
+ *	\param	word	if non-null, the last value read from the word is stored here,
+ *			e.g. for inspecting status bits other than the ones polled
+ *	\return	0 on success, -1 if an error occurs, or if the timeout expires */
+int libgdb_poll_word(struct libgdb_ctx * ctx, uint32_t addr, uint32_t mask, uint32_t value,
+		uint32_t expected_usec, uint32_t timeout_usec, uint32_t * word)
+{
+uint64_t start, elapsed;
+uint32_t x, interval;
+
+	start = get_usec();
+	if (expected_usec)
+		sleep_usec((uint64_t) ((expected_usec < timeout_usec) ? expected_usec : timeout_usec)
+				* POLL_EXPECTED_SLEEP_PERCENT / 100);
+	interval = expected_usec / POLL_INTERVAL_DIVISOR;
+	if (interval < POLL_MIN_INTERVAL_USEC)
+		interval = POLL_MIN_INTERVAL_USEC;
+	while (1)
+	{
+		if (libgdb_readwords(ctx, addr, 1, & x))
+			return -1;
+		if (word)
+			* word = x;
+		if ((x & mask) == value)
+			return 0;
+		if ((elapsed = get_usec() - start) >= timeout_usec)
+		{
+			eprintf("%s(): timeout waiting for word at 0x%08x to read 0x%08x (mask 0x%08x), last read 0x%08x\n",
+					__func__, addr, value, mask, x);
+			return -1;
+		}
+		if (interval > timeout_usec - elapsed)
+			interval = timeout_usec - elapsed;
+		sleep_usec(interval);
+		/* back off */
+		if ((interval *= 2) > POLL_MAX_INTERVAL_USEC)
+			interval = POLL_MAX_INTERVAL_USEC;
+	}
+}
+
+/*!
+ *	\fn	int libgdb_crc32(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc)
+ *	\brief	computes the crc32 checksum of target memory on the gdbserver side (the 'qCRC' packet)
+ *
+ *	the checksum is the one computed by gdb for the 'compare-sections'
+ *	command, see libgdb_compute_crc32(); only the checksum crosses the
+ *	link, so this is much faster than reading the memory
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address of the memory to checksum
+ *	\param	len	number of bytes to checksum
+ *	\param	crc	a pointer to where to store the checksum computed
+ *	\return	0 on success, 1 if the gdbserver does not support the
+ *		'qCRC' packet, -1 if an error occurs */
+int libgdb_crc32(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc)
+{
+	snprintf(ctx->txpacket, ctx->packet_len, "qCRC:%x,%x", addr, len);
+	putpacket(ctx, true);
+	if (getpacket(ctx, true))
+	{
+		eprintf("%s(): error getting packet\n", __func__);
+		return -1;
+	}
+	if (!ctx->rxpacket[0])
+		/* empty response - packet not supported */
+		return 1;
+	if (ctx->rxpacket[0] != 'C')
+	{
+		is_error_packet(ctx);
+		eprintf("%s(): error computing target memory checksum: start 0x%08x, size 0x%08x\n", __func__, addr, len);
+		return -1;
+	}
+	* crc = strtoul(ctx->rxpacket + 1, 0, 16);
+	return 0;
+}
+
+/*!
+ *	\fn	uint32_t libgdb_compute_crc32(uint32_t crc, const void * buf, uint32_t len)
+ *	\brief	computes the crc32 checksum of a host memory buffer, as libgdb_crc32() does for target memory
+ *
+ *	the checksum is the msb-first crc32 (polynomial 0x04c11db7) used
+ *	by gdb, without a final inversion
+ *
+ *	\param	crc	the initial checksum value - 0xffffffff, or the checksum
+ *			of the preceding data, when checksumming data in pieces
+ *	\param	buf	the data to checksum
+ *	\param	len	number of bytes to checksum
+ *	\return	the checksum computed */
+uint32_t libgdb_compute_crc32(uint32_t crc, const void * buf, uint32_t len)
+{
+static uint32_t crc32_table[256];
+const uint8_t * p;
+uint32_t c;
+int i, j;
+
+	if (!crc32_table[1])
+		for (i = 0; i < 256; crc32_table[i ++] = c)
+			for (c = i << 24, j = 0; j < 8; j ++)
+				c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : c << 1;
+	for (p = buf; len --; p ++)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ * p) & 0xff];
+	return crc;
+}
+
+/*!
+ *	\fn	void libgdb_set_resident_code(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+ *	\brief	records that a piece of code has been loaded in target memory, so that it can be reused later
+ *
+ *	the record is dropped when target memory overlapping the code is
+ *	written by libgdb, or when libgdb_invalidate_resident_code() is
+ *	called; only a single piece of code is recorded, calling this
+ *	function replaces any previous record
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	the target address the code has been loaded at
+ *	\param	len	the size of the code, in bytes
+ *	\param	code	the code loaded in target memory
+ *	\return	none */
+void libgdb_set_resident_code(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+{
+	ctx->resident_code.addr = addr;
+	ctx->resident_code.crc = libgdb_compute_crc32(0xffffffff, code, len);
+	ctx->resident_code.len = len;
+}
+
+/*!
+ *	\fn	void libgdb_invalidate_resident_code(struct libgdb_ctx * ctx)
+ *	\brief	drops the record of the code loaded in target memory by libgdb_set_resident_code()
+ *
+ *	this should be called whenever target memory may have been changed
+ *	behind the back of libgdb - e.g. when the target is resumed, or
+ *	reset
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none */
+void libgdb_invalidate_resident_code(struct libgdb_ctx * ctx)
+{
+	ctx->resident_code.len = 0;
+}
+
+/*!
+ *	\fn	bool libgdb_is_code_resident(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+ *	\brief	determines if a piece of code recorded by libgdb_set_resident_code() is still intact in target memory
+ *
+ *	the code must match the one recorded, and the checksum of the
+ *	target memory holding it must match the checksum of the code;
+ *	if the gdbserver does not support the 'qCRC' packet, the target
+ *	memory is read back and checksummed on the host instead
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	the target address the code is expected at
+ *	\param	len	the size of the code, in bytes
+ *	\param	code	the code expected in target memory
+ *	\return	true, if the code is resident in target memory and
+ *		need not be loaded again, false otherwise */
+bool libgdb_is_code_resident(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+{
+uint32_t crc;
+void * buf;
+int res;
+
+	if (!len || ctx->resident_code.len != len || ctx->resident_code.addr != addr
+			|| ctx->resident_code.crc != libgdb_compute_crc32(0xffffffff, code, len))
+		return false;
+	if ((res = libgdb_crc32(ctx, addr, len, & crc)) == 1)
+	{
+		if (!(buf = malloc(len)))
+			return false;
+		res = libgdb_readmem(ctx, addr, len, buf);
+		crc = libgdb_compute_crc32(0xffffffff, buf, len);
+		free(buf);
+	}
+	if (res || crc != ctx->resident_code.crc)
+	{
+		ctx->resident_code.len = 0;
+		return false;
+	}
+	return true;
+}
+
 /*!
  *	\fn	int libgdb_readreg(struct libgdb_ctx * ctx, int reg_nr, uint32_t * reg)
  *	\brief	reads a target register
@@ -751,7 +1703,7 @@ int total, cur;
 int libgdb_readreg(struct libgdb_ctx * ctx, int reg_nr, uint32_t * reg)
 {
 
-	snprintf(ctx->txpacket, sizeof ctx->txpacket, "p%x", reg_nr);
+	snprintf(ctx->txpacket, ctx->packet_len, "p%x", reg_nr);
 	putpacket(ctx, true);
 	if (getpacket(ctx, true))
 	{
@@ -784,7 +1736,7 @@ int libgdb_writereg(struct libgdb_ctx * ctx, int reg_nr, uint32_t reg_val)
 	reg_val = (reg_val >> 16) | (reg_val << 16);
 	reg_val = ((reg_val >> 8) & 0x00ff00ff) | ((reg_val << 8) & 0xff00ff00);
 
-	snprintf(ctx->txpacket, sizeof ctx->txpacket, "P%x=%08x", reg_nr, reg_val);
+	snprintf(ctx->txpacket, ctx->packet_len, "P%x=%08x", reg_nr, reg_val);
 	putpacket(ctx, true);
 	if (getpacket(ctx, true))
 	{
@@ -811,7 +1763,7 @@ int libgdb_writereg(struct libgdb_ctx * ctx, int reg_nr, uint32_t reg_val)
  *	\return	0 on success, -1 if an error occurs */
 int libgdb_insert_hw_bkpt(struct libgdb_ctx * ctx, uint32_t addr, int len)
 {
-	snprintf(ctx->txpacket, sizeof ctx->txpacket, "Z1,%x,%x", addr, len);
+	snprintf(ctx->txpacket, ctx->packet_len, "Z1,%x,%x", addr, len);
 	putpacket(ctx, true);
 	if (getpacket(ctx, true))
 	{
@@ -837,7 +1789,7 @@ int libgdb_insert_hw_bkpt(struct libgdb_ctx * ctx, uint32_t addr, int len)
  *	\return	0 on success, -1 if an error occurs */
 int libgdb_remove_hw_bkpt(struct libgdb_ctx * ctx, uint32_t addr, int len)
 {
-	snprintf(ctx->txpacket, sizeof ctx->txpacket, "z1,%x,%x", addr, len);
+	snprintf(ctx->txpacket, ctx->packet_len, "z1,%x,%x", addr, len);
 	putpacket(ctx, true);
 	if (getpacket(ctx, true))
 	{
@@ -863,8 +1815,8 @@ int libgdb_remove_hw_bkpt(struct libgdb_ctx * ctx, uint32_t addr, int len)
  *	\return	none */
 void libgdb_sendpacket(struct libgdb_ctx * ctx, const char * packet_data)
 {
-	strncpy(ctx->txpacket, packet_data, sizeof ctx->txpacket - 1);
-	ctx->txpacket[MAX_PACKET_LEN - 1] = 0;
+	strncpy(ctx->txpacket, packet_data, ctx->packet_len - 1);
+	ctx->txpacket[ctx->packet_len - 1] = 0;
 	putpacket(ctx, true);
 }
 
@@ -878,8 +1830,8 @@ void libgdb_sendpacket(struct libgdb_ctx * ctx, const char * packet_data)
  *	\return	none */
 void libgdb_sendpacketraw(struct libgdb_ctx * ctx, const char * packet_data)
 {
-	strncpy(ctx->txpacket, packet_data, sizeof ctx->txpacket - 1);
-	ctx->txpacket[MAX_PACKET_LEN - 1] = 0;
+	strncpy(ctx->txpacket, packet_data, ctx->packet_len - 1);
+	ctx->txpacket[ctx->packet_len - 1] = 0;
 	putpacket(ctx, false);
 }
 
@@ -922,6 +1874,8 @@ void libgdb_sendbreak(struct libgdb_ctx * ctx)
  *			is not yet available */
 const char * libgdb_async_get_packet(struct libgdb_ctx * ctx, char incoming_char)
 {
+	if (alloc_async_rxpacket(ctx))
+		return 0;
 	switch (ctx->state)
 	{
 		case ASYNC_RX_STATE_WAITING_START:
@@ -941,7 +1895,7 @@ const char * libgdb_async_get_packet(struct libgdb_ctx * ctx, char incoming_char
 			}
 			else
 			{
-				if (ctx->idx == sizeof ctx->async_rxpacket - /* reserve one byte for a null terminator */ 1)
+				if (ctx->idx == ctx->async_rxpacket_len - /* reserve one byte for a null terminator */ 1)
 				{
 					/* incoming buffer overflow - abort current packet and start looking for next one */
 					ctx->state = ASYNC_RX_STATE_WAITING_START;
@@ -965,6 +1919,93 @@ const char * libgdb_async_get_packet(struct libgdb_ctx * ctx, char incoming_char
 	return 0;
 }
 
+/*!
+ *	\fn	int libgdb_async_feed(struct libgdb_ctx * ctx, const char * buf, int len, void (* packet_handler)(void * cookie, const char * packet, int packet_len), void * cookie)
+ *	\brief	receive packets from a remote gdbserver, asynchronously, a whole buffer of incoming data at a time
+ *
+ *	this is a bulk alternative to libgdb_async_get_packet(), with
+ *	the same purpose and restrictions; instead of processing a single
+ *	character, this routine scans a whole buffer of incoming data
+ *	(as obtained by code outside of this library, e.g. with a single
+ *	recv() call), and invokes the 'packet_handler' callback for
+ *	each complete packet received; the start and end of packet
+ *	characters are searched for with memchr(), and packet data is
+ *	copied and checksummed a whole span at a time; the two routines
+ *	share their state, so partial packets left over by one of them
+ *	are completed by the other
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	buf	the incoming data from the remote gdbserver
+ *	\param	len	the number of bytes in 'buf'
+ *	\param	packet_handler	a function to invoke for each complete
+ *			packet received; the packet passed is null terminated,
+ *			and is only valid for the duration of the call
+ *	\param	cookie	an arbitrary value passed to 'packet_handler'
+ *	\return	the number of packets received */
+int libgdb_async_feed(struct libgdb_ctx * ctx, const char * buf, int len,
+		void (* packet_handler)(void * cookie, const char * packet, int packet_len), void * cookie)
+{
+int i, n, nr_packets;
+const char * p;
+uint8_t cksum;
+
+	if (alloc_async_rxpacket(ctx))
+		return 0;
+	i = nr_packets = 0;
+	while (i < len)
+		switch (ctx->state)
+		{
+			default:
+				ctx->state = ASYNC_RX_STATE_WAITING_START;
+				/* fall through */
+			case ASYNC_RX_STATE_WAITING_START:
+				if (!(p = memchr(buf + i, '$', len - i)))
+					return nr_packets;
+				i = p - buf + 1;
+				ctx->state = ASYNC_RX_STATE_READING_DATA;
+				ctx->idx = 0;
+				ctx->cksum = 0;
+				break;
+			case ASYNC_RX_STATE_READING_DATA:
+				p = memchr(buf + i, '#', len - i);
+				n = (p ? p - buf : len) - i;
+				if (ctx->idx + n > ctx->async_rxpacket_len - /* reserve one byte for a null terminator */ 1)
+				{
+					/* incoming buffer overflow - abort current packet and start looking for next one */
+					i += ctx->async_rxpacket_len - 1 - ctx->idx + 1;
+					ctx->state = ASYNC_RX_STATE_WAITING_START;
+					break;
+				}
+				memcpy(ctx->async_rxpacket + ctx->idx, buf + i, n);
+				ctx->idx += n;
+				for (cksum = ctx->cksum; n; n --)
+					cksum += buf[i ++];
+				ctx->cksum = cksum;
+				if (p)
+				{
+					/* null terminate the packet received */
+					ctx->async_rxpacket[ctx->idx] = '\0';
+					ctx->state = ASYNC_RX_STATE_WAITING_FIRST_CKSUM_CHAR;
+					i ++;
+				}
+				break;
+			case ASYNC_RX_STATE_WAITING_FIRST_CKSUM_CHAR:
+				ctx->rx_cksum = hex(buf[i ++]) << 4;
+				ctx->state = ASYNC_RX_STATE_WAITING_SECOND_CKSUM_CHAR;
+				break;
+			case ASYNC_RX_STATE_WAITING_SECOND_CKSUM_CHAR:
+				ctx->rx_cksum |= hex(buf[i ++]);
+				ctx->state = ASYNC_RX_STATE_WAITING_START;
+				if (ctx->cksum == ctx->rx_cksum)
+				{
+					packet_handler(cookie, ctx->async_rxpacket, ctx->idx);
+					nr_packets ++;
+				}
+				break;
+		}
+	return nr_packets;
+}
+
 /*!
  *	\fn	int libgdb_get_gdbserver_socket_desc(struct libgdb_ctx * ctx)
  *	\brief	retrieves the file descriptor of the socket that libgdb is using to communicate with the remote gdbserver
@@ -999,8 +2040,84 @@ void libgdb_waithalted(struct libgdb_ctx * ctx)
 }
 
 /*!
- *	\fn	int libgdb_armv7m_run_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr, uint32_t halt_addr, uint32_t * halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
- *	\brief	runs a routine on a connected target and wait for the target to halt
+ *	\fn	int libgdb_attach(struct libgdb_ctx * ctx, int * signal)
+ *	\brief	attaches to a target, halting it only if it is running
+ *
+ *	the halt state of the target is queried with a '?' request; if
+ *	the gdbserver replies with a stop packet, the target is already
+ *	halted, and is left as it is; if no reply arrives within a short
+ *	timeout, the target is considered running, and is halted by
+ *	sending a break request, after which the first stop packet
+ *	received ends the attaching - this may also be a late reply to the
+ *	'?' request, the stop packet replying to the break request (if
+ *	any) is then received later, and is processed along with the reply
+ *	to the next request (see get_ack_char()); unlike resuming and then
+ *	halting the target, this never runs the target firmware
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	signal	if non-null, the signal number from the stop
+ *			packet describing the halt reason is stored here
+ *	\return	0 if the target was already halted, 1 if the target was
+ *		running and has been halted, -1 if an error occurs */
+int libgdb_attach(struct libgdb_ctx * ctx, int * signal)
+{
+jmp_buf saved_jmpbuf;
+volatile int res;
+
+	memcpy(saved_jmpbuf, ctx->jmpbuf, sizeof saved_jmpbuf);
+	res = 0;
+	if (!setjmp(ctx->jmpbuf))
+	{
+		strcpy(ctx->txpacket, "?");
+		putpacket(ctx, true);
+		ctx->read_timeout_msec = ATTACH_QUERY_TIMEOUT_MSEC;
+		do
+			if (getpacket(ctx, false))
+				ctx->rxpacket[0] = 0;
+		while (ctx->rxpacket[0] != 'S' && ctx->rxpacket[0] != 'T'
+				&& ctx->rxpacket[0] != 'W' && ctx->rxpacket[0] != 'X');
+	}
+	else if (ctx->err == LIBGDB_ERR_READ_TIMEOUT && ctx->read_timeout_msec)
+		/* no reply - the target is running */
+		res = 1;
+	else
+		res = -1;
+	ctx->read_timeout_msec = 0;
+	if (res == 1)
+	{
+		if (!setjmp(ctx->jmpbuf))
+		{
+			/* halt the target, and wait for the first stop packet */
+			libgdb_sendbreak(ctx);
+			do
+				if (getpacket(ctx, false))
+					ctx->rxpacket[0] = 0;
+			while (ctx->rxpacket[0] != 'S' && ctx->rxpacket[0] != 'T'
+					&& ctx->rxpacket[0] != 'W' && ctx->rxpacket[0] != 'X');
+		}
+		else
+			res = -1;
+	}
+	memcpy(ctx->jmpbuf, saved_jmpbuf, sizeof saved_jmpbuf);
+
+	if (res == -1)
+	{
+		eprintf("%s(): error querying the target halt state\n", __func__);
+		return -1;
+	}
+	if (ctx->rxpacket[0] == 'W' || ctx->rxpacket[0] == 'X')
+	{
+		eprintf("%s(): the target process has exited\n", __func__);
+		return -1;
+	}
+	if (signal)
+		* signal = (hex(ctx->rxpacket[1]) << 4) | hex(ctx->rxpacket[2]);
+	return res;
+}
+
+/*!
+ *	\fn	int libgdb_armv7m_start_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr, uint32_t halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
+ *	\brief	starts running a routine on a connected target, without waiting for the target to halt
  *
  *	\param	ctx	libgdb library context as returned by libgdb_init
  *	\param	routine_entry_point	the routine entry point address
@@ -1010,23 +2127,23 @@ void libgdb_waithalted(struct libgdb_ctx * ctx)
  *				will be inserted at this address, then
  *				the routine to be run will have its
  *				parameters set to the param0 .. param3
- *				values passed, the target will then be run,
- *				and this function will wait for the target
- *				to halt; when the target halts, the hardware
- *				breakpoint will be removed, and the result
- *				returned by the executed routine will be stored
- *				in the 'result' parameter passed
- *	\param	result	a pointer to where to store the result that the executed
- *			routine returns; can be null if this value is of no interest
+ *				values passed, and the target will be run
  *	\param	param0	value for the first parameter to pass to the function
  *	\param	param1	value for the second parameter to pass to the function
  *	\param	param2	value for the third parameter to pass to the function
  *	\param	param3	value for the fourth parameter to pass to the function
  *	\return	0 on success, -1 if an error occurs
  *
- *	\note	the target must be halted prior to invoking this routine */
-int libgdb_armv7m_run_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr,
-		uint32_t halt_addr, uint32_t * result, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
+ *	\note	the target must be halted prior to invoking this routine;
+ *		the routine must be completed by invoking
+ *		libgdb_armv7m_finish_target_routine(); in between, other
+ *		requests (e.g. memory writes) may be issued to the gdbserver -
+ *		whether these are serviced while the target is running depends
+ *		on the gdbserver, a stop packet received meanwhile is recorded,
+ *		so that libgdb_armv7m_finish_target_routine() does not wait
+ *		for it a second time */
+int libgdb_armv7m_start_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr,
+		uint32_t halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
 {
 uint32_t reg;
 void dump_target_regfile(void)
@@ -1168,9 +2285,46 @@ int i;
 	}
 
 	/* request target run */
+	ctx->is_halt_seen = false;
 	libgdb_sendpacket(ctx, "c");
-	/* wait for the target to halt */
-	libgdb_waithalted(ctx);
+	return 0;
+}
+
+/*!
+ *	\fn	int libgdb_armv7m_finish_target_routine(struct libgdb_ctx * ctx, uint32_t halt_addr, uint32_t * result)
+ *	\brief	waits for a routine started by libgdb_armv7m_start_target_routine() to complete
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	halt_addr	the halt address that was passed to
+ *				libgdb_armv7m_start_target_routine(); the
+ *				hardware breakpoint at this address is removed
+ *	\param	result	a pointer to where to store the result that the executed
+ *			routine returns; can be null if this value is of no interest
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_armv7m_finish_target_routine(struct libgdb_ctx * ctx, uint32_t halt_addr, uint32_t * result)
+{
+jmp_buf saved_jmpbuf;
+volatile int res;
+
+	/* wait for the target to halt, unless a stop packet
+	 * has already been received (and discarded) while
+	 * communicating with the target in the meantime */
+	res = 0;
+	if (!ctx->is_halt_seen)
+	{
+		memcpy(saved_jmpbuf, ctx->jmpbuf, sizeof saved_jmpbuf);
+		if (!setjmp(ctx->jmpbuf))
+			libgdb_waithalted(ctx);
+		else
+			res = -1;
+		memcpy(ctx->jmpbuf, saved_jmpbuf, sizeof saved_jmpbuf);
+	}
+	ctx->is_halt_seen = false;
+	if (res)
+	{
+		eprintf("%s(): error waiting for the target routine to complete\n", __func__);
+		return -1;
+	}
 	/* remove the hardware breakpoint */
 	if (libgdb_remove_hw_bkpt(ctx, halt_addr, 2));
 	if (result)
@@ -1183,6 +2337,41 @@ int i;
 	return 0;
 }
 
+/*!
+ *	\fn	int libgdb_armv7m_run_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr, uint32_t halt_addr, uint32_t * halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
+ *	\brief	runs a routine on a connected target and wait for the target to halt
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	routine_entry_point	the routine entry point address
+ *	\param	stack_ptr	stack pointer value to set for the routine
+ *				being run
+ *	\param	halt_addr	expected halt address; a hardware breakpoint
+ *				will be inserted at this address, then
+ *				the routine to be run will have its
+ *				parameters set to the param0 .. param3
+ *				values passed, the target will then be run,
+ *				and this function will wait for the target
+ *				to halt; when the target halts, the hardware
+ *				breakpoint will be removed, and the result
+ *				returned by the executed routine will be stored
+ *				in the 'result' parameter passed
+ *	\param	result	a pointer to where to store the result that the executed
+ *			routine returns; can be null if this value is of no interest
+ *	\param	param0	value for the first parameter to pass to the function
+ *	\param	param1	value for the second parameter to pass to the function
+ *	\param	param2	value for the third parameter to pass to the function
+ *	\param	param3	value for the fourth parameter to pass to the function
+ *	\return	0 on success, -1 if an error occurs
+ *
+ *	\note	the target must be halted prior to invoking this routine */
+int libgdb_armv7m_run_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr,
+		uint32_t halt_addr, uint32_t * result, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
+{
+	if (libgdb_armv7m_start_target_routine(ctx, routine_entry_point, stack_ptr, halt_addr, param0, param1, param2, param3))
+		return -1;
+	return libgdb_armv7m_finish_target_routine(ctx, halt_addr, result);
+}
+
 /*!
  *	\fn	bool libgdb_set_annotation(struct libgdb_ctx * ctx, bool enable_annotation)
  *	\brief	enables/disables libgdb output annotation
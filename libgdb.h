@@ -30,6 +30,8 @@ SOFTWARE.
 
 /*! opaque libgdb context data structure */
 struct libgdb_ctx;
+/*! opaque reception arena data structure, see libgdb_rx_arena_create() */
+struct libgdb_rx_arena;
 
 /*!
  *	\fn	void libgdb_send_ack(struct libgdb_ctx * ctx)
@@ -63,6 +65,48 @@ void libgdb_send_ack(struct libgdb_ctx * ctx);
  *		the amount of words requested) */
 int libgdb_set_max_nr_words_xferred(struct libgdb_ctx * ctx, int maxwords);
 
+/*!
+ *	\fn	int libgdb_autotune_max_nr_words_xferred(struct libgdb_ctx * ctx, uint32_t scratch_addr, uint32_t scratch_len)
+ *	\brief	measures the memory transfer performance of a connected gdbserver and selects the fastest transfer chunk size
+ *
+ *	the chunk size selected is set as if by calling
+ *	libgdb_set_max_nr_words_xferred(); the round trip time and
+ *	throughput measured can be retrieved by libgdb_get_link_stats();
+ *	the contents of the scratch memory area are preserved
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	scratch_addr	the start address of a target ram area that
+ *				can be used for the measurements
+ *	\param	scratch_len	the length of the scratch area, in bytes
+ *	\return	the selected maximum number of words transferred in
+ *		a single memory access request packet, -1 if an error occurs
+ *
+ *	\note	the target must be halted prior to invoking this routine */
+int libgdb_autotune_max_nr_words_xferred(struct libgdb_ctx * ctx, uint32_t scratch_addr, uint32_t scratch_len);
+
+/*!
+ *	\fn	void libgdb_get_link_stats(struct libgdb_ctx * ctx, uint32_t * rtt_usec, uint32_t * bytes_per_sec)
+ *	\brief	retrieves the gdbserver link performance figures measured by libgdb_autotune_max_nr_words_xferred()
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	rtt_usec	a pointer to where to store the round trip time,
+ *				in microseconds; can be null
+ *	\param	bytes_per_sec	a pointer to where to store the memory transfer
+ *				throughput, in bytes per second; can be null
+ *	\return	none
+ *	\note	the values stored are zero if they are not known */
+void libgdb_get_link_stats(struct libgdb_ctx * ctx, uint32_t * rtt_usec, uint32_t * bytes_per_sec);
+
+/*!
+ *	\fn	void libgdb_set_link_stats(struct libgdb_ctx * ctx, uint32_t rtt_usec, uint32_t bytes_per_sec)
+ *	\brief	sets the gdbserver link performance figures, e.g. when restoring previously cached autotuning results
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	rtt_usec	the round trip time, in microseconds
+ *	\param	bytes_per_sec	the memory transfer throughput, in bytes per second
+ *	\return	none */
+void libgdb_set_link_stats(struct libgdb_ctx * ctx, uint32_t rtt_usec, uint32_t bytes_per_sec);
+
 /*!
  *	\fn	struct libgdb_ctx * libgdb_init(void)
  *	\brief	initializes the libgdb library
@@ -74,6 +118,46 @@ int libgdb_set_max_nr_words_xferred(struct libgdb_ctx * ctx, int maxwords);
  *		some error */
 struct libgdb_ctx * libgdb_init(void);
 
+/*!
+ *	\fn	void libgdb_deinit(struct libgdb_ctx * ctx)
+ *	\brief	closes the gdbserver connection of a libgdb context (if any), and releases the context
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none */
+void libgdb_deinit(struct libgdb_ctx * ctx);
+
+/*!
+ *	\fn	struct libgdb_rx_arena * libgdb_rx_arena_create(int len)
+ *	\brief	creates a reception arena that can be shared by several libgdb contexts
+ *
+ *	\param	len	the size of the arena buffer, in bytes; this limits the packet
+ *			size of the contexts using the arena; if zero, the maximum
+ *			packet size supported by libgdb is used
+ *	\return	the arena created, null if an error occurs */
+struct libgdb_rx_arena * libgdb_rx_arena_create(int len);
+
+/*!
+ *	\fn	int libgdb_rx_arena_destroy(struct libgdb_rx_arena * arena)
+ *	\brief	destroys a reception arena created by libgdb_rx_arena_create()
+ *
+ *	\param	arena	the arena to destroy; it must not be used by any context
+ *	\return	0 on success, -1 if the arena is still in use */
+int libgdb_rx_arena_destroy(struct libgdb_rx_arena * arena);
+
+/*!
+ *	\fn	int libgdb_set_rx_arena(struct libgdb_ctx * ctx, struct libgdb_rx_arena * arena)
+ *	\brief	makes a libgdb context use a shared reception arena for receiving packets
+ *
+ *	contexts sharing an arena must all be driven from a single thread;
+ *	a packet received by a context is only valid until another context
+ *	sharing the same arena receives a packet
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	arena	the arena to use; if null, the context stops using
+ *			a shared arena and allocates a private reception buffer again
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_set_rx_arena(struct libgdb_ctx * ctx, struct libgdb_rx_arena * arena);
+
 /*!
  *	\fn	int libgdb_connect(struct libgdb_ctx * ctx, const char * host, int port_nr)
  *	\brief	attempts connection to a gdb server
@@ -87,6 +171,62 @@ struct libgdb_ctx * libgdb_init(void);
  *	\todo	only inet dot addresses are supported right now */
 int libgdb_connect(struct libgdb_ctx * ctx, const char * host, int port_nr);
 
+/*!
+ *	\fn	int libgdb_negotiate_packet_size(struct libgdb_ctx * ctx)
+ *	\brief	negotiates the packet size with a connected gdbserver, and resizes the packet buffers accordingly
+ *
+ *	the target should be halted when calling this
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	the packet size in effect on success, -1 if an error occurs */
+int libgdb_negotiate_packet_size(struct libgdb_ctx * ctx);
+
+/*!
+ *	\fn	int libgdb_readmem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf)
+ *	\brief	reads bytes from a target controlled by a connected gdb server
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from, need not be aligned
+ *	\param	len	number of bytes to read
+ *	\param	buf	buffer where to store the memory read
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_readmem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, void * buf);
+
+/*!
+ *	\fn	int libgdb_writemem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf)
+ *	\brief	writes bytes to a target controlled by a connected gdb server
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to, need not be aligned
+ *	\param	len	number of bytes to write
+ *	\param	buf	buffer containing the data to be written
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_writemem(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * buf);
+
+/*!
+ *	\fn	int libgdb_readmem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, void * buf)
+ *	\brief	reads target memory using accesses of a specified width (e.g. for peripheral registers)
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to read from, must be aligned on the access width
+ *	\param	width	the access width, in bytes - 1, 2 or 4
+ *	\param	count	number of consecutive elements to read
+ *	\param	buf	buffer where to store the memory read, in target byte order
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_readmem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, void * buf);
+
+/*!
+ *	\fn	int libgdb_writemem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, const void * buf)
+ *	\brief	writes target memory using accesses of a specified width (e.g. for peripheral registers)
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address to write to, must be aligned on the access width
+ *	\param	width	the access width, in bytes - 1, 2 or 4
+ *	\param	count	number of consecutive elements to write
+ *	\param	buf	buffer containing the data to be written, in target byte order
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_writemem_width(struct libgdb_ctx * ctx, uint32_t addr, int width, int count, const void * buf);
+
 /*!
  *	\fn	int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf)
  *	\brief	reads words from a target controlled by a connected gdb server
@@ -109,6 +249,107 @@ int libgdb_readwords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32
  *	\return	0 on success, -1 if an error occurs */
 int libgdb_writewords(struct libgdb_ctx * ctx, uint32_t addr, int wordcnt, uint32_t * buf);
 
+/*!
+ *	\fn	int libgdb_poll_word(struct libgdb_ctx * ctx, uint32_t addr, uint32_t mask, uint32_t value, uint32_t expected_usec, uint32_t timeout_usec, uint32_t * word)
+ *	\brief	waits for a target word (e.g. a peripheral status register) to hold a value
+ *
+ *	the word is read until its bits selected by 'mask' equal 'value';
+ *	rather than reading the word back to back, this function first
+ *	sleeps through most of the expected duration of the operation
+ *	waited for (if known), and then polls the word at increasing
+ *	intervals, so that long operations (e.g. flash erasure) do not
+ *	load the link and the gdbserver needlessly
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address of the word to poll
+ *	\param	mask	the bits of the word to compare
+ *	\param	value	the value expected for the bits selected by 'mask'
+ *	\param	expected_usec	the expected time for the word to attain
+ *				the value, in microseconds; can be zero if
+ *				unknown, or if the word is expected to already
+ *				hold the value
+ *	\param	timeout_usec	the time after which waiting is abandoned, in microseconds
+ *	\param	word	if non-null, the last value read from the word is stored here,
+ *			e.g. for inspecting status bits other than the ones polled
+ *	\return	0 on success, -1 if an error occurs, or if the timeout expires */
+int libgdb_poll_word(struct libgdb_ctx * ctx, uint32_t addr, uint32_t mask, uint32_t value,
+		uint32_t expected_usec, uint32_t timeout_usec, uint32_t * word);
+
+/*!
+ *	\fn	int libgdb_crc32(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc)
+ *	\brief	computes the crc32 checksum of target memory on the gdbserver side (the 'qCRC' packet)
+ *
+ *	the checksum is the one computed by gdb for the 'compare-sections'
+ *	command, see libgdb_compute_crc32(); only the checksum crosses the
+ *	link, so this is much faster than reading the memory
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	target address of the memory to checksum
+ *	\param	len	number of bytes to checksum
+ *	\param	crc	a pointer to where to store the checksum computed
+ *	\return	0 on success, 1 if the gdbserver does not support the
+ *		'qCRC' packet, -1 if an error occurs */
+int libgdb_crc32(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc);
+
+/*!
+ *	\fn	uint32_t libgdb_compute_crc32(uint32_t crc, const void * buf, uint32_t len)
+ *	\brief	computes the crc32 checksum of a host memory buffer, as libgdb_crc32() does for target memory
+ *
+ *	the checksum is the msb-first crc32 (polynomial 0x04c11db7) used
+ *	by gdb, without a final inversion
+ *
+ *	\param	crc	the initial checksum value - 0xffffffff, or the checksum
+ *			of the preceding data, when checksumming data in pieces
+ *	\param	buf	the data to checksum
+ *	\param	len	number of bytes to checksum
+ *	\return	the checksum computed */
+uint32_t libgdb_compute_crc32(uint32_t crc, const void * buf, uint32_t len);
+
+/*!
+ *	\fn	void libgdb_set_resident_code(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+ *	\brief	records that a piece of code has been loaded in target memory, so that it can be reused later
+ *
+ *	the record is dropped when target memory overlapping the code is
+ *	written by libgdb, or when libgdb_invalidate_resident_code() is
+ *	called; only a single piece of code is recorded, calling this
+ *	function replaces any previous record
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	the target address the code has been loaded at
+ *	\param	len	the size of the code, in bytes
+ *	\param	code	the code loaded in target memory
+ *	\return	none */
+void libgdb_set_resident_code(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code);
+
+/*!
+ *	\fn	void libgdb_invalidate_resident_code(struct libgdb_ctx * ctx)
+ *	\brief	drops the record of the code loaded in target memory by libgdb_set_resident_code()
+ *
+ *	this should be called whenever target memory may have been changed
+ *	behind the back of libgdb - e.g. when the target is resumed, or
+ *	reset
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\return	none */
+void libgdb_invalidate_resident_code(struct libgdb_ctx * ctx);
+
+/*!
+ *	\fn	bool libgdb_is_code_resident(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code)
+ *	\brief	determines if a piece of code recorded by libgdb_set_resident_code() is still intact in target memory
+ *
+ *	the code must match the one recorded, and the checksum of the
+ *	target memory holding it must match the checksum of the code;
+ *	if the gdbserver does not support the 'qCRC' packet, the target
+ *	memory is read back and checksummed on the host instead
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	addr	the target address the code is expected at
+ *	\param	len	the size of the code, in bytes
+ *	\param	code	the code expected in target memory
+ *	\return	true, if the code is resident in target memory and
+ *		need not be loaded again, false otherwise */
+bool libgdb_is_code_resident(struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, const void * code);
+
 /*!
  *	\fn	int libgdb_readreg(struct libgdb_ctx * ctx, int reg_nr, uint32_t * reg)
  *	\brief	reads a target register
@@ -204,6 +445,28 @@ void libgdb_sendbreak(struct libgdb_ctx * ctx);
  *			is not yet available */
 const char * libgdb_async_get_packet(struct libgdb_ctx * ctx, char incoming_char);
 
+/*!
+ *	\fn	int libgdb_async_feed(struct libgdb_ctx * ctx, const char * buf, int len, void (* packet_handler)(void * cookie, const char * packet, int packet_len), void * cookie)
+ *	\brief	receive packets from a remote gdbserver, asynchronously, a whole buffer of incoming data at a time
+ *
+ *	this is a bulk alternative to libgdb_async_get_packet(), with the
+ *	same purpose and restrictions; it scans a whole buffer of incoming
+ *	data obtained by code outside of this library, and invokes the
+ *	'packet_handler' callback once for each complete packet received;
+ *	partial packets are carried over to the next invocation; the
+ *	two routines share their state and can be intermixed
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	buf	the incoming data from the remote gdbserver
+ *	\param	len	the number of bytes in 'buf'
+ *	\param	packet_handler	a function to invoke for each complete
+ *			packet received; the packet passed is null terminated,
+ *			and is only valid for the duration of the call
+ *	\param	cookie	an arbitrary value passed to 'packet_handler'
+ *	\return	the number of packets received */
+int libgdb_async_feed(struct libgdb_ctx * ctx, const char * buf, int len,
+		void (* packet_handler)(void * cookie, const char * packet, int packet_len), void * cookie);
+
 /*!
  *	\fn	int libgdb_get_gdbserver_socket_desc(struct libgdb_ctx * ctx)
  *	\brief	retrieves the file descriptor of the socket that libgdb is using to communicate with the remote gdbserver
@@ -227,6 +490,64 @@ int libgdb_get_gdbserver_socket_desc(struct libgdb_ctx * ctx);
  *	\return	none */
 void libgdb_waithalted(struct libgdb_ctx * ctx);
 
+/*!
+ *	\fn	int libgdb_attach(struct libgdb_ctx * ctx, int * signal)
+ *	\brief	attaches to a target, halting it only if it is running
+ *
+ *	the halt state is queried with a '?' request, and a break request
+ *	is only sent if no reply arrives within a short timeout; the target
+ *	is never resumed
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	signal	if non-null, the signal number from the stop
+ *			packet describing the halt reason is stored here
+ *	\return	0 if the target was already halted, 1 if the target was
+ *		running and has been halted, -1 if an error occurs */
+int libgdb_attach(struct libgdb_ctx * ctx, int * signal);
+
+/*!
+ *	\fn	int libgdb_armv7m_start_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr, uint32_t halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
+ *	\brief	starts running a routine on a connected target, without waiting for the target to halt
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	routine_entry_point	the routine entry point address
+ *	\param	stack_ptr	stack pointer value to set for the routine
+ *				being run
+ *	\param	halt_addr	expected halt address; a hardware breakpoint
+ *				will be inserted at this address, then
+ *				the routine to be run will have its
+ *				parameters set to the param0 .. param3
+ *				values passed, and the target will be run
+ *	\param	param0	value for the first parameter to pass to the function
+ *	\param	param1	value for the second parameter to pass to the function
+ *	\param	param2	value for the third parameter to pass to the function
+ *	\param	param3	value for the fourth parameter to pass to the function
+ *	\return	0 on success, -1 if an error occurs
+ *
+ *	\note	the target must be halted prior to invoking this routine;
+ *		the routine must be completed by invoking
+ *		libgdb_armv7m_finish_target_routine(); in between, other
+ *		requests (e.g. memory writes) may be issued to the gdbserver -
+ *		whether these are serviced while the target is running depends
+ *		on the gdbserver, a stop packet received meanwhile is recorded,
+ *		so that libgdb_armv7m_finish_target_routine() does not wait
+ *		for it a second time */
+int libgdb_armv7m_start_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr,
+		uint32_t halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3);
+
+/*!
+ *	\fn	int libgdb_armv7m_finish_target_routine(struct libgdb_ctx * ctx, uint32_t halt_addr, uint32_t * result)
+ *	\brief	waits for a routine started by libgdb_armv7m_start_target_routine() to complete
+ *
+ *	\param	ctx	libgdb library context as returned by libgdb_init
+ *	\param	halt_addr	the halt address that was passed to
+ *				libgdb_armv7m_start_target_routine(); the
+ *				hardware breakpoint at this address is removed
+ *	\param	result	a pointer to where to store the result that the executed
+ *			routine returns; can be null if this value is of no interest
+ *	\return	0 on success, -1 if an error occurs */
+int libgdb_armv7m_finish_target_routine(struct libgdb_ctx * ctx, uint32_t halt_addr, uint32_t * result);
+
 /*!
  *	\fn	int libgdb_armv7m_run_target_routine(struct libgdb_ctx * ctx, uint32_t routine_entry_point, uint32_t stack_ptr, uint32_t halt_addr, uint32_t * halt_addr, uint32_t param0, uint32_t param1, uint32_t param2, uint32_t param3)
  *	\brief	runs a routine on a connected target and wait for the target to halt
@@ -144,6 +144,11 @@ static struct struct_devctl lpc17xx_devs[NR_SUPPORTED_DEVICES] =
                 .flash_erase_sector = lpc17xx_flash_erase_sector,
                 .flash_mass_erase = 0,/* lpc17xx_flash_mass_erase */
                 .flash_program_words = lpc17xx_flash_program_words,
+		/* each flash programming operation writes a whole ram buffer */
+		.program_align = LPC17XX_BUF_SIZE,
+                .sector_erase_usec = 100000,
+                .sector_erase_usec_per_kb = 0,
+                .mass_erase_usec = 0,
 		.validate_cmdline_options = 0,
                 .pdev = & (struct lpc17xx_flash_data)
 		{
@@ -577,7 +582,15 @@ int i, sector_nr, sector_idx;
 		return -1;
 	}
 
-	sector_nr = sector_idx = 0;
+	/* locate the flash sector that the destination address falls in */
+	sector_idx = dest - dev->flash_areas[0].start;
+	for (sector_nr = 0; dev->flash_areas[0].sizes[sector_nr] && sector_idx >= dev->flash_areas[0].sizes[sector_nr]; sector_nr ++)
+		sector_idx -= dev->flash_areas[0].sizes[sector_nr];
+	if (!dev->flash_areas[0].sizes[sector_nr])
+	{
+		eprintf("destination address not in target flash, aborting\n");
+		return -1;
+	}
 	while (wordcnt)
 	{
 		/*! \todo	special case - checksum - do this properly */
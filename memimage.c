@@ -0,0 +1,311 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * firmware memory images
+ */
+
+/*
+ * include section follows
+ */
+#ifndef __LINUX__
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libgdb.h"
+#include "memimage.h"
+#include "filemap.h"
+
+enum
+{
+	/*! the minimum size of a memory image data storage arena block, in bytes */
+	MEMIMAGE_BLOCK_SIZE	= 256 * 1024,
+	/*! the initial number of elements allocated for the memory image area array */
+	INITIAL_MAX_AREAS	= 16,
+};
+
+/*! a memory image data storage arena block */
+struct memimage_block
+{
+	/*! a list of these */
+	struct memimage_block	* next;
+	/*! the size of the data storage in this block, in bytes */
+	size_t	size;
+	/*! the number of bytes of the data storage allocated */
+	size_t	used;
+	/*! the data storage */
+	uint8_t	data[];
+};
+
+struct memimage * memimage_create(void)
+{
+	return calloc(1, sizeof(struct memimage));
+}
+
+/* allocates arena storage; the storage is allocated from the first block in the block list */
+static uint8_t * arena_alloc(struct memimage * image, size_t len)
+{
+struct memimage_block * b;
+size_t size;
+
+	if (!(b = image->blocks) || b->size - b->used < len)
+	{
+		size = len * 2 > MEMIMAGE_BLOCK_SIZE ? len * 2 : MEMIMAGE_BLOCK_SIZE;
+		if (!(b = malloc(sizeof * b + size)))
+			return 0;
+		b->size = size;
+		b->used = 0;
+		b->next = image->blocks;
+		image->blocks = b;
+	}
+	b->used += len;
+	return b->data + b->used - len;
+}
+
+/* adds a new, empty, area at the end of the area array; returns null if out of memory */
+static struct data_mem_area * new_area(struct memimage * image, uint32_t addr)
+{
+struct data_mem_area * s;
+int max_areas;
+
+	if (image->nr_areas == image->max_areas)
+	{
+		max_areas = image->max_areas ? image->max_areas * 2 : INITIAL_MAX_AREAS;
+		if (!(s = realloc(image->areas, max_areas * sizeof * s)))
+			return 0;
+		image->areas = s;
+		image->max_areas = max_areas;
+	}
+	s = image->areas + image->nr_areas ++;
+	s->next = 0;
+	s->addr = addr;
+	s->len = 0;
+	s->data = 0;
+	return s;
+}
+
+uint8_t * memimage_append(struct memimage * image, uint32_t addr, uint32_t len)
+{
+struct data_mem_area * s;
+struct memimage_block * b;
+uint8_t * data;
+
+	s = image->nr_areas ? image->areas + image->nr_areas - 1 : 0;
+	if (s && addr == s->addr + s->len)
+	{
+		/* extend the last area - in place, if it is at the end
+		 * of the current arena block and there is room there */
+		b = image->blocks;
+		if (b && s->data + s->len == b->data + b->used && b->size - b->used >= len)
+		{
+			b->used += len;
+			s->len += len;
+			return s->data + s->len - len;
+		}
+		/* otherwise, move the area data to a new place */
+		if (!(data = arena_alloc(image, (size_t) s->len + len)))
+			return 0;
+		memcpy(data, s->data, s->len);
+		s->data = data;
+		s->len += len;
+		return s->data + s->len - len;
+	}
+	/* start a new area */
+	if (!(data = arena_alloc(image, len)) || !(s = new_area(image, addr)))
+		return 0;
+	s->len = len;
+	s->data = data;
+	return data;
+}
+
+int memimage_add_external(struct memimage * image, uint32_t addr, const void * data, uint32_t len)
+{
+struct data_mem_area * s;
+
+	if (!(s = new_area(image, addr)))
+		return -1;
+	s->len = len;
+	s->data = (uint8_t *) data;
+	return 0;
+}
+
+int memimage_add(struct memimage * image, uint32_t addr, const void * data, uint32_t len)
+{
+uint8_t * p;
+
+	if (!(p = memimage_append(image, addr, len)))
+		return -1;
+	memcpy(p, data, len);
+	return 0;
+}
+
+int memimage_merge(struct memimage * image, struct memimage * from, uint32_t addr_offset)
+{
+struct data_mem_area * areas;
+struct memimage_block * b;
+int i, max_areas;
+
+	if (image->nr_areas + from->nr_areas > image->max_areas)
+	{
+		max_areas = image->nr_areas + from->nr_areas;
+		if (!(areas = realloc(image->areas, max_areas * sizeof * areas)))
+			return -1;
+		image->areas = areas;
+		image->max_areas = max_areas;
+	}
+	for (i = 0; i < from->nr_areas; i ++)
+	{
+		image->areas[image->nr_areas] = from->areas[i];
+		image->areas[image->nr_areas ++].addr += addr_offset;
+	}
+	/* the blocks taken over are placed after the current block of
+	 * the image, so that memimage_append() keeps allocating from it */
+	if (from->blocks)
+	{
+		for (b = from->blocks; b->next; b = b->next)
+			;
+		if (image->blocks)
+		{
+			b->next = image->blocks->next;
+			image->blocks->next = from->blocks;
+		}
+		else
+			image->blocks = from->blocks;
+	}
+	free(from->areas);
+	free(from);
+	return 0;
+}
+
+static int compare_areas(const void * a, const void * b)
+{
+const struct data_mem_area * x = a, * y = b;
+
+	return x->addr < y->addr ? -1 : (x->addr > y->addr ? 1 : 0);
+}
+
+int memimage_finish(struct memimage * image)
+{
+struct data_mem_area * s, * t, * areas;
+uint64_t end, area_end;
+uint8_t * data;
+int i, j, n;
+
+	if (!image->nr_areas)
+		return 0;
+	qsort(image->areas, image->nr_areas, sizeof * image->areas, compare_areas);
+	areas = image->areas;
+	for (n = i = 0; i < image->nr_areas; i = j)
+	{
+		/* find a group of adjacent or overlapping areas */
+		s = areas + i;
+		end = (uint64_t) s->addr + s->len;
+		for (j = i + 1; j < image->nr_areas && areas[j].addr <= end; j ++)
+			if ((area_end = (uint64_t) areas[j].addr + areas[j].len) > end)
+				end = area_end;
+		if (j - i > 1)
+		{
+			/* merge the group into a single area */
+			if (end - s->addr > UINT32_MAX)
+			{
+				eprintf("memory image too large\n");
+				return -1;
+			}
+			if (!(data = arena_alloc(image, end - s->addr)))
+			{
+				eprintf("out of core\n");
+				return -1;
+			}
+			end = s->addr;
+			for (t = s; t < areas + j; t ++)
+			{
+				if (t->addr < end)
+				{
+					/* overlapping data - accept it only if it is the same */
+					area_end = (uint64_t) t->addr + t->len < end ? (uint64_t) t->addr + t->len : end;
+					if (memcmp(data + (t->addr - s->addr), t->data, area_end - t->addr))
+					{
+						eprintf("conflicting data at overlapping addresses 0x%08x - 0x%08x\n",
+								t->addr, (uint32_t) (area_end - 1));
+						return -1;
+					}
+				}
+				memcpy(data + (t->addr - s->addr), t->data, t->len);
+				if ((uint64_t) t->addr + t->len > end)
+					end = (uint64_t) t->addr + t->len;
+			}
+			s->len = end - s->addr;
+			s->data = data;
+		}
+		areas[n ++] = * s;
+	}
+	image->nr_areas = n;
+	for (i = 0; i < n; i ++)
+		areas[i].next = i + 1 < n ? areas + i + 1 : 0;
+	return 0;
+}
+
+const struct data_mem_area * memimage_lookup(const struct memimage * image, uint32_t addr)
+{
+int lo, hi, mid;
+
+	/* binary search for the last area starting at or below the address */
+	lo = 0;
+	hi = image->nr_areas;
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (image->areas[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo || addr - image->areas[lo - 1].addr >= image->areas[lo - 1].len)
+		return 0;
+	return image->areas + lo - 1;
+}
+
+void memimage_destroy(struct memimage * image)
+{
+struct memimage_block * b;
+
+	if (!image)
+		return;
+	while ((b = image->blocks))
+	{
+		image->blocks = b->next;
+		free(b);
+	}
+	if (image->map)
+		filemap_close(image->map);
+	free(image->areas);
+	free(image);
+}
+
@@ -0,0 +1,161 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * firmware memory images
+ */
+
+/*! a contiguous area of a memory image */
+struct data_mem_area
+{
+	/*! the next area of the image, in address order; null for the last area
+	 *
+	 * only valid after memimage_finish() has been called */
+	struct data_mem_area	* next;
+	/*! starting address in target memory */
+	uint32_t	addr;
+	/*! size of the memory area, in bytes */
+	uint32_t	len;
+	/*! the data itself */
+	uint8_t		* data;
+
+};
+
+/*! opaque memory image data storage arena block */
+struct memimage_block;
+
+/*! a firmware memory image
+ *
+ * data is stored in the image in any address order, as it is read
+ * from an image file; memimage_finish() then sorts the image areas
+ * by address, merging adjacent and (identically) overlapping areas,
+ * so that the image is made of the smallest possible number of areas;
+ * the area data is held in an arena, and is released in bulk when
+ * the image is destroyed */
+struct memimage
+{
+	/*! the areas of the image, an array of 'nr_areas' elements; after
+	 * memimage_finish() has been called, these are sorted by address,
+	 * and are also linked in a list via their 'next' fields */
+	struct data_mem_area	* areas;
+	/*! the number of elements in the 'areas' array */
+	int	nr_areas;
+	/*! the number of elements allocated for the 'areas' array */
+	int	max_areas;
+	/*! the area data storage arena */
+	struct memimage_block	* blocks;
+	/*! a file mapping that image areas added by memimage_add_external()
+	 * refer to, if any; it is closed when the image is destroyed */
+	struct filemap	* map;
+};
+
+/*!
+ *	\fn	struct memimage * memimage_create(void)
+ *	\brief	creates an empty memory image
+ *
+ *	\return	the memory image created, null if out of memory */
+struct memimage * memimage_create(void);
+
+/*!
+ *	\fn	uint8_t * memimage_append(struct memimage * image, uint32_t addr, uint32_t len)
+ *	\brief	allocates storage for a run of data in a memory image
+ *
+ *	if the data immediately follows the data last appended to the
+ *	image, the last image area is extended, otherwise a new area is
+ *	started; the caller stores the data at the location returned
+ *
+ *	\param	image	the memory image to append data to
+ *	\param	addr	the target memory address of the data
+ *	\param	len	the length of the data, in bytes, must be nonzero
+ *	\return	a pointer to where to store the data, null if out of memory */
+uint8_t * memimage_append(struct memimage * image, uint32_t addr, uint32_t len);
+
+/*!
+ *	\fn	int memimage_add(struct memimage * image, uint32_t addr, const void * data, uint32_t len)
+ *	\brief	copies a run of data into a memory image, see memimage_append()
+ *
+ *	\param	image	the memory image to add data to
+ *	\param	addr	the target memory address of the data
+ *	\param	data	the data to add
+ *	\param	len	the length of the data, in bytes, must be nonzero
+ *	\return	0 on success, -1 if out of memory */
+int memimage_add(struct memimage * image, uint32_t addr, const void * data, uint32_t len);
+
+/*!
+ *	\fn	int memimage_add_external(struct memimage * image, uint32_t addr, const void * data, uint32_t len)
+ *	\brief	adds a run of data to a memory image without copying it
+ *
+ *	the image area added refers to the data in place, which must remain
+ *	valid for the life of the image, e.g. by being part of the file
+ *	mapping in the image 'map' field; the data is only copied if the
+ *	area gets merged with other areas, see memimage_finish()
+ *
+ *	\param	image	the memory image to add data to
+ *	\param	addr	the target memory address of the data
+ *	\param	data	the data to add
+ *	\param	len	the length of the data, in bytes, must be nonzero
+ *	\return	0 on success, -1 if out of memory */
+int memimage_add_external(struct memimage * image, uint32_t addr, const void * data, uint32_t len);
+
+/*!
+ *	\fn	int memimage_merge(struct memimage * image, struct memimage * from, uint32_t addr_offset)
+ *	\brief	moves all data of a memory image into another memory image
+ *
+ *	the data is not copied, the image being merged takes over the
+ *	other image data storage; the image being merged from is destroyed
+ *
+ *	\param	image	the memory image to merge data into
+ *	\param	from	the memory image to merge data from, must not have been
+ *			finished, and must not have a file mapping attached
+ *	\param	addr_offset	a value added to the addresses of the areas merged
+ *	\return	0 on success, -1 if out of memory; in this case, 'from' is left unchanged */
+int memimage_merge(struct memimage * image, struct memimage * from, uint32_t addr_offset);
+
+/*!
+ *	\fn	int memimage_finish(struct memimage * image)
+ *	\brief	sorts and merges the areas of a memory image, once all data has been added to it
+ *
+ *	\param	image	the memory image to finish
+ *	\return	0 on success, -1 if the image contains overlapping areas
+ *		holding different data, or if out of memory */
+int memimage_finish(struct memimage * image);
+
+/*!
+ *	\fn	const struct data_mem_area * memimage_lookup(const struct memimage * image, uint32_t addr)
+ *	\brief	locates the area of a finished memory image that contains a given address
+ *
+ *	\param	image	the memory image to search, must have been finished by memimage_finish()
+ *	\param	addr	the target memory address to look up
+ *	\return	the area containing the address, null if the address is not in the image */
+const struct data_mem_area * memimage_lookup(const struct memimage * image, uint32_t addr);
+
+/*!
+ *	\fn	void memimage_destroy(struct memimage * image)
+ *	\brief	deallocates a memory image, along with all of its data
+ *
+ *	\param	image	the memory image to destroy, can be null
+ *	\return	none */
+void memimage_destroy(struct memimage * image);
+
@@ -0,0 +1,213 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+
+/*
+ * target ram layout planning for target resident routines
+ */
+
+#ifndef __LINUX__
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libgdb.h"
+#include "devctl.h"
+#include "ramplan.h"
+
+enum
+{
+	/*! the alignment of all regions placed in target ram, in bytes; armv7m stacks must be 8 byte aligned */
+	RAMPLAN_ALIGNMENT	= 8,
+	/*! the smallest write buffer size considered usable, in bytes */
+	MIN_WRITE_BUF_SIZE	= 256,
+};
+
+#define ALIGN_UP(x)	(((x) + RAMPLAN_ALIGNMENT - 1) & ~ (RAMPLAN_ALIGNMENT - 1))
+#define ALIGN_DOWN(x)	((x) & ~ (RAMPLAN_ALIGNMENT - 1))
+
+/*! a contiguous block of target ram, possibly made up of several adjacent device ram areas */
+struct ram_block
+{
+	uint32_t	start;
+	uint32_t	len;
+};
+
+/*!
+ *	\fn	static bool is_block_start(const struct struct_memarea * ram_areas, const struct struct_memarea * area)
+ *	\brief	determines if a device ram area starts a contiguous block, i.e. no other ram area ends where it starts
+ *
+ *	\param	ram_areas	the device ram areas
+ *	\param	area	the ram area to check
+ *	\return	true if the area starts a contiguous block, false otherwise */
+static bool is_block_start(const struct struct_memarea * ram_areas, const struct struct_memarea * area)
+{
+const struct struct_memarea * m;
+
+	for (m = ram_areas; m->len; m ++)
+		if (m != area && m->start + m->len == area->start)
+			return false;
+	return true;
+}
+
+/*!
+ *	\fn	static struct ram_block get_block(const struct struct_memarea * ram_areas, const struct struct_memarea * area)
+ *	\brief	returns the contiguous block of target ram starting with a device ram area
+ *
+ *	\param	ram_areas	the device ram areas
+ *	\param	area	the ram area starting the block
+ *	\return	the block of target ram */
+static struct ram_block get_block(const struct struct_memarea * ram_areas, const struct struct_memarea * area)
+{
+const struct struct_memarea * m;
+struct ram_block b;
+
+	b.start = area->start;
+	b.len = area->len;
+	m = ram_areas;
+	while (m->len)
+		if (m->start == b.start + b.len)
+		{
+			b.len += m->len;
+			/* rescan for an area following the merged one */
+			m = ram_areas;
+		}
+		else
+			m ++;
+	return b;
+}
+
+/*!
+ *	\fn	static bool is_in_ram(const struct struct_memarea * ram_areas, uint32_t start, uint32_t len)
+ *	\brief	determines if a region lies entirely in a contiguous block of target ram
+ *
+ *	\param	ram_areas	the device ram areas
+ *	\param	start	the region start address
+ *	\param	len	the region length, in bytes
+ *	\return	true if the region lies in target ram, false otherwise */
+static bool is_in_ram(const struct struct_memarea * ram_areas, uint32_t start, uint32_t len)
+{
+const struct struct_memarea * m;
+struct ram_block b;
+
+	for (m = ram_areas; m->len; m ++)
+		if (is_block_start(ram_areas, m))
+		{
+			b = get_block(ram_areas, m);
+			if (start >= b.start && (uint64_t) start + len <= (uint64_t) b.start + b.len)
+				return true;
+		}
+	return false;
+}
+
+/*!
+ *	\fn	static bool is_overlapping(uint32_t start1, uint32_t len1, uint32_t start2, uint32_t len2)
+ *	\brief	determines if two regions overlap
+ *
+ *	\return	true if the regions overlap, false otherwise */
+static bool is_overlapping(uint32_t start1, uint32_t len1, uint32_t start2, uint32_t len2)
+{
+	return start1 < start2 + len2 && start2 < start1 + len1;
+}
+
+int ramplan_layout(const struct struct_memarea * ram_areas, uint32_t code_size, bool is_double_buffered, struct pdev * layout)
+{
+const struct struct_memarea * m;
+struct ram_block b, largest, alt;
+uint32_t code_len, stack_len, buf_size;
+struct { uint32_t start, len; } regions[4];
+int i, j, nr_regions;
+
+	if (!ram_areas)
+	{
+		eprintf("%s(): no target ram areas specified\n", __func__);
+		return -1;
+	}
+	/* locate the largest, and the second largest contiguous ram blocks */
+	largest.len = alt.len = 0;
+	for (m = ram_areas; m->len; m ++)
+	{
+		if (!is_block_start(ram_areas, m))
+			continue;
+		b = get_block(ram_areas, m);
+		if (b.len > largest.len)
+		{
+			alt = largest;
+			largest = b;
+		}
+		else if (b.len > alt.len)
+			alt = b;
+	}
+
+	code_len = ALIGN_UP(code_size);
+	stack_len = ALIGN_UP(layout->stack_size);
+	if ((uint64_t) code_len + stack_len + MIN_WRITE_BUF_SIZE > ALIGN_DOWN(largest.len))
+	{
+		eprintf("%s(): target ram too small for a routine of %i bytes, with a stack of %i bytes\n",
+				__func__, (int) code_size, (int) layout->stack_size);
+		return -1;
+	}
+	layout->code_load_addr = ALIGN_UP(largest.start);
+	layout->write_buf_addr = layout->code_load_addr + code_len;
+	buf_size = ALIGN_DOWN(largest.start + largest.len - layout->write_buf_addr - stack_len);
+	layout->alt_write_buf_addr = 0;
+	if (is_double_buffered && ALIGN_DOWN(alt.len) > buf_size / 2)
+	{
+		/* a buffer in the second largest block is larger than
+		 * a half of the write buffer - use it as the second buffer */
+		layout->alt_write_buf_addr = ALIGN_UP(alt.start);
+		if (buf_size > ALIGN_DOWN(alt.start + alt.len - layout->alt_write_buf_addr))
+			buf_size = ALIGN_DOWN(alt.start + alt.len - layout->alt_write_buf_addr);
+	}
+	layout->write_buf_size = buf_size;
+	layout->stack_size = stack_len;
+
+	/* verify the layout */
+	nr_regions = 0;
+	regions[nr_regions].start = layout->code_load_addr, regions[nr_regions ++].len = code_len;
+	regions[nr_regions].start = layout->write_buf_addr, regions[nr_regions ++].len = buf_size;
+	regions[nr_regions].start = layout->write_buf_addr + buf_size, regions[nr_regions ++].len = stack_len;
+	if (layout->alt_write_buf_addr)
+		regions[nr_regions].start = layout->alt_write_buf_addr, regions[nr_regions ++].len = buf_size;
+	for (i = 0; i < nr_regions; i ++)
+	{
+		if (!is_in_ram(ram_areas, regions[i].start, regions[i].len))
+		{
+			eprintf("%s(): region at 0x%08x, size 0x%08x, not in target ram\n", __func__, regions[i].start, regions[i].len);
+			return -1;
+		}
+		for (j = i + 1; j < nr_regions; j ++)
+			if (is_overlapping(regions[i].start, regions[i].len, regions[j].start, regions[j].len))
+			{
+				eprintf("%s(): overlapping target ram regions at 0x%08x and 0x%08x\n", __func__, regions[i].start, regions[j].start);
+				return -1;
+			}
+	}
+	return 0;
+}
+
@@ -0,0 +1,59 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+
+/*
+ * target ram layout planning for target resident routines
+ */
+
+/*!
+ *	\fn	int ramplan_layout(const struct struct_memarea * ram_areas, uint32_t code_size, bool is_double_buffered, struct pdev * layout)
+ *	\brief	computes the placement of a target resident routine, its data buffers and its stack in target ram
+ *
+ *	adjacent device ram areas are merged in contiguous blocks; the
+ *	routine code, the write buffer and the stack are then placed,
+ *	in this order, in the largest block, the write buffer taking up
+ *	all of the memory that the code and the stack leave free; the
+ *	stack base address is then the end of the write buffer plus the
+ *	stack size, as the 'struct pdev' description in devctl.h suggests
+ *
+ *	if double buffering is requested, and another block can hold a
+ *	buffer larger than half of the write buffer, this block is used
+ *	for the second buffer ('alt_write_buf_addr'), and both buffers
+ *	are sized equally; otherwise, 'alt_write_buf_addr' is set to zero,
+ *	and the write buffer is to be split in two halves
+ *
+ *	all of the regions placed are finally verified to lie in target
+ *	ram, and to not overlap each other
+ *
+ *	\param	ram_areas	the device ram areas, terminated by an entry of zero length
+ *	\param	code_size	the size of the target resident routine, in bytes
+ *	\param	is_double_buffered	true if two write buffers are needed
+ *	\param	layout	on entry, the 'stack_size' field holds the stack size
+ *			needed by the routine; on success, the remaining fields
+ *			are filled in with the placement computed
+ *	\return	0 on success, -1 if the routine, a write buffer and the stack
+ *		do not fit in target ram */
+int ramplan_layout(const struct struct_memarea * ram_areas, uint32_t code_size, bool is_double_buffered, struct pdev * layout);
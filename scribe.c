@@ -47,10 +47,184 @@ SOFTWARE.
 #include "libgdb.h"
 #include "devctl.h"
 #include "devices.h"
+#include "memimage.h"
 #include "hexreader.h"
-
+#include "elfreader.h"
+#include "binreader.h"
+#include "targetcrc.h"
+#include "bench.h"
+#include "filemap.h"
+#include "daemon.h"
+
+enum
+{
+	/*! the tcp port that the gdbserver is listening on */
+	GDBSERVER_PORT			= 1122,
+	/*! the maximum number of words transferred in a single memory access packet
+	 * when neither an autotuned, nor a cached value is available */
+	DEFAULT_MAX_NR_WORDS_XFERRED	= 67 * 11,
+	/*! the size of the chunks in which file data is streamed to/from the target by the '-w' and '-r' commands, in bytes */
+	FILE_XFER_CHUNK_SIZE		= 64 * 1024,
+	/*! an estimate of the number of gdbserver link round trips that a single flash erase operation takes */
+	ERASE_NR_ROUND_TRIPS		= 12,
+	/*! an estimate of the number of gdbserver link round trips of the fixed overhead of
+	 * a flash_program_words() call - loading the flash programming routine, and setting
+	 * up and running it on the target */
+	PROGRAM_CALL_NR_ROUND_TRIPS	= 16,
+	/*! the gap threshold returned by get_program_gap_threshold() when the link performance is not known */
+	DEFAULT_PROGRAM_GAP_THRESHOLD	= 256,
+	/*! the maximum number of resources that the job being run can hold at a time, see job_hold() */
+	MAX_JOB_RESOURCES		= 8,
+};
+
+/*! the value of an erased target flash word */
+static const uint32_t flash_erased_word = 0xffffffff;
+/*! the address of the machine that the gdbserver is running on */
+static const char gdbserver_host[] = "127.0.0.1";
+/*! the name of the file (in the user's home directory) holding cached gdbserver link autotuning results */
+static const char link_cache_fname[] = ".scribe-link-cache";
 
 static bool is_vx_annotation_enabled;
+/*! if true, link autotuning is performed even if cached autotuning results are available */
+static bool must_retune_link;
+/*! the device opened (by open_device()) in the current gdbserver session; null if none */
+static struct struct_devctl * opened_dev;
+/*! the libgdb context that the device 'opened_dev' has been opened with, see close_device() */
+static struct libgdb_ctx * opened_dev_ctx;
+/*! the command line options that the device 'opened_dev' has been opened with, as formatted by format_device_cmdline_options() */
+static char * opened_dev_options;
+/*! if true, intel hex files are programmed in the target while they are being parsed, see struct image_stream */
+static bool is_streaming_enabled;
+/*! if true, flash sectors already holding the data to be programmed by the '-x' and '-w' commands are left untouched, see program_flash_delta() */
+static bool is_delta_enabled;
+/*! if true, the erase planner may choose to mass erase the target device, destroying flash contents outside of the image being programmed, see erase_plan_run() */
+static bool is_mass_erase_allowed;
+/*! if true, flash programming overlaps uploading data to the target with programming previously uploaded data, see the 'is_double_buffering_enabled' field of struct struct_devctl */
+static bool is_double_buffering_enabled;
+/*! if true, image files loaded by the '-x' and '--verify' commands are raw binary files, to be placed at address 'load_addr' */
+static bool is_load_addr_specified;
+/*! the target address of raw binary image files, see 'is_load_addr_specified' */
+static uint32_t load_addr;
+/*! when running as a daemon, the context to return to when the job being run fails; null otherwise */
+static jmp_buf * job_jmpbuf;
+/*! a resource (memory, a file, a thread...) held by the job being run, see job_hold() */
+struct job_resource
+{
+	/*! the routine releasing the resource */
+	void	(* release)(void * resource);
+	/*! the resource */
+	void	* resource;
+};
+/*! the resources held by the job being run, in the order of their acquisition */
+static struct job_resource job_resources[MAX_JOB_RESOURCES];
+/*! the number of entries in 'job_resources' */
+static int nr_job_resources;
+
+static int close_device(void);
+
+/*!
+ *	\fn	static void job_release_all(void)
+ *	\brief	releases all resources held by the job being run, in the reverse order of their acquisition
+ *
+ *	\return	none */
+static void job_release_all(void)
+{
+	while (nr_job_resources)
+	{
+		nr_job_resources --;
+		job_resources[nr_job_resources].release(job_resources[nr_job_resources].resource);
+	}
+}
+
+/*!
+ *	\fn	static void job_exit(int status)
+ *	\brief	terminates the job being run
+ *
+ *	the resources held by the job (see job_hold()) are released first;
+ *	when running as a daemon, this aborts the job being run and returns
+ *	to the daemon job loop, which reports 'status' to the client that
+ *	submitted the job; otherwise, this closes the opened device (if
+ *	any) and terminates the program
+ *
+ *	\param	status	the job exit status
+ *	\return	does not return */
+static void job_exit(int status)
+{
+	job_release_all();
+	if (job_jmpbuf)
+		/* offset the status, so that a zero status can be passed through setjmp() */
+		longjmp(* job_jmpbuf, status + 1);
+	close_device();
+	exit(status);
+}
+
+/*!
+ *	\fn	static void job_hold(void (* release)(void * resource), void * resource)
+ *	\brief	records a resource held by the job being run, to be released by job_exit() if the job fails
+ *
+ *	\param	release	the routine releasing the resource
+ *	\param	resource	the resource held
+ *	\return	none */
+static void job_hold(void (* release)(void * resource), void * resource)
+{
+	if (nr_job_resources == MAX_JOB_RESOURCES)
+	{
+		release(resource);
+		eprintf("too many resources held by the job, aborting\n");
+		job_exit(1);
+	}
+	job_resources[nr_job_resources].release = release;
+	job_resources[nr_job_resources].resource = resource;
+	nr_job_resources ++;
+}
+
+/*!
+ *	\fn	static void job_unhold(void * resource)
+ *	\brief	drops a resource recorded by job_hold(), without releasing it
+ *
+ *	\param	resource	the resource, as passed to job_hold()
+ *	\return	none */
+static void job_unhold(void * resource)
+{
+int i;
+
+	for (i = nr_job_resources - 1; i >= 0; i --)
+		if (job_resources[i].resource == resource)
+		{
+			memmove(job_resources + i, job_resources + i + 1, (nr_job_resources - i - 1) * sizeof * job_resources);
+			nr_job_resources --;
+			return;
+		}
+}
+
+/*!
+ *	\fn	static void job_release(void * resource)
+ *	\brief	releases a resource recorded by job_hold()
+ *
+ *	\param	resource	the resource, as passed to job_hold()
+ *	\return	none */
+static void job_release(void * resource)
+{
+int i;
+
+	for (i = nr_job_resources - 1; i >= 0; i --)
+		if (job_resources[i].resource == resource)
+		{
+			job_resources[i].release(resource);
+			job_unhold(resource);
+			return;
+		}
+}
+
+static void release_memimage(void * image)
+{
+	memimage_destroy((struct memimage *) image);
+}
+
+static void release_filemap(void * fmap)
+{
+	filemap_close((struct filemap *) fmap);
+}
 
 static void list_devices(struct struct_devctl * devs, bool vx_annotate)
 {
@@ -152,8 +326,9 @@ char * s, * valstr;
 				{
 					free(s);
 					eprintf("bad numeric value ('%s') for command line option '%s' for target '%s', aborting\n", valstr, p->cmdstr, dev->name);
-					exit(1);
+					return -1;
 				}
+				p->is_specified = true;
 				p->num = x;
 				free(s);
 				return 0;
@@ -171,123 +346,403 @@ char * s, * valstr;
 	return -1;
 }
 
+/*!
+ *	\fn	static void clear_device_cmdline_options(struct struct_devctl * devs)
+ *	\brief	marks the command line options of all devices in a list as not specified
+ *
+ *	\param	devs	the list of devices
+ *	\return	none */
+static void clear_device_cmdline_options(struct struct_devctl * devs)
+{
+struct cmdline_option_info * p;
+
+	for (; devs; devs = devs->next)
+		if (devs->cmdline_options)
+			for (p = devs->cmdline_options; p->cmdstr; p ++)
+			{
+				if (p->is_specified && p->type == PARAM_TYPE_STRING)
+					free(p->str);
+				p->is_specified = false;
+			}
+}
+
+/*!
+ *	\fn	static char * format_device_cmdline_options(struct struct_devctl * dev)
+ *	\brief	formats the command line options specified for a device, and their values, in a string
+ *
+ *	two devices opened with the same command line options have equal
+ *	strings formatted, see open_device()
+ *
+ *	\param	dev	the device
+ *	\return	the formatted string, which must be deallocated with free(); null if out of core */
+static char * format_device_cmdline_options(struct struct_devctl * dev)
+{
+struct cmdline_option_info * p;
+char * s;
+int len;
+
+	len = 1;
+	if (dev->cmdline_options)
+		for (p = dev->cmdline_options; p->cmdstr; p ++)
+			if (p->is_specified)
+				len += strlen(p->cmdstr) + sizeof "=0x12345678 "
+					+ (p->type == PARAM_TYPE_STRING ? strlen(p->str) : 0);
+	if (!(s = malloc(len)))
+		return 0;
+	* s = 0;
+	if (dev->cmdline_options)
+		for (p = dev->cmdline_options; p->cmdstr; p ++)
+			if (p->is_specified)
+			{
+				if (p->type == PARAM_TYPE_STRING)
+					sprintf(s + strlen(s), "%s=%s ", p->cmdstr, p->str);
+				else
+					sprintf(s + strlen(s), "%s=0x%08x ", p->cmdstr, p->num);
+			}
+	return s;
+}
+
 static int open_device(struct struct_devctl * dev, struct libgdb_ctx * ctx)
 {
 int res;	
+char * options;
+
 	if (!dev)
 	{
 		eprintf("target not specified, specify a target with '-d device'; aborting\n");
 		return -1;
 	}
+	dev->is_double_buffering_enabled = is_double_buffering_enabled;
+	if (!(options = format_device_cmdline_options(dev)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	/* a device is only opened once per gdbserver session - when running
+	 * as a daemon, this spares repeated device setup (e.g. clock
+	 * configuration) for jobs targeting the same device with the same
+	 * command line options */
+	if (dev == opened_dev && !strcmp(options, opened_dev_options))
+	{
+		free(options);
+		return 0;
+	}
+	/* a job run by a daemon may target a device other than the one opened
+	 * by a previous job, or the same device with different options (e.g. a
+	 * different clock setup) - the device is reopened then */
+	if (close_device())
+	{
+		free(options);
+		return -1;
+	}
 	if (!dev->dev_open)
+	{
+		free(options);
 		return 0;
+	}
 	if (check_device_cmdline_options(dev))
+	{
+		free(options);
 		return -1;
+	}
 	if ((res = dev->dev_open(dev, ctx)))
 	{
 		eprintf("error opening target, aborting\n");
+		free(options);
 	}
+	else
+		opened_dev = dev, opened_dev_ctx = ctx, opened_dev_options = options;
 	return res;
 }
 
+/*!
+ *	\fn	static int close_device(void)
+ *	\brief	closes the device opened by open_device(), if any
+ *
+ *	this gives the device a chance to restore any target settings
+ *	it has changed while open (e.g. clock settings)
+ *
+ *	\return	0 on success, -1 if an error occurs */
+static int close_device(void)
+{
+struct struct_devctl * dev;
+
+	if (!(dev = opened_dev))
+		return 0;
+	/* reset first, so that a failure here does not cause another attempt to close the device */
+	opened_dev = 0;
+	free(opened_dev_options);
+	opened_dev_options = 0;
+	if (!dev->dev_close)
+		return 0;
+	if (dev->dev_close(dev, opened_dev_ctx))
+	{
+		eprintf("error closing target, target settings may not have been restored\n");
+		return -1;
+	}
+	return 0;
+}
+
 
-static int get_hex_fname(const char * infile, char ** outfile, bool * must_unlink)
+static char * get_link_cache_path(void)
 {
-char cmdline[512];
-DWORD exit_code;
-STARTUPINFO si;
-PROCESS_INFORMATION pi;
-int fd;
-unsigned char x[4];
+const char * home;
+char * s;
+
+	if (!(home = getenv("HOME")) && !(home = getenv("APPDATA")))
+		home = ".";
+	if (!(s = malloc(strlen(home) + 1 + sizeof link_cache_fname)))
+		return 0;
+	sprintf(s, "%s/%s", home, link_cache_fname);
+	return s;
+}
+
+/* the cache file holds a line of the form "host:port max-nr-words rtt-usec bytes-per-sec" per gdbserver */
+static int load_cached_link_settings(struct libgdb_ctx * ctx, const char * endpoint)
+{
+FILE * f;
+char * fname, key[64];
+int maxwords, res;
+unsigned rtt, bps;
+
+	if (!(fname = get_link_cache_path()))
+		return -1;
+	f = fopen(fname, "r");
+	free(fname);
+	if (!f)
+		return -1;
+	res = -1;
+	while (fscanf(f, "%63s %i %u %u", key, & maxwords, & rtt, & bps) == 4)
+		if (!strcmp(key, endpoint) && libgdb_set_max_nr_words_xferred(ctx, maxwords) != -1)
+		{
+			libgdb_set_link_stats(ctx, rtt, bps);
+			res = 0;
+		}
+	fclose(f);
+	return res;
+}
+
+static void store_link_settings(struct libgdb_ctx * ctx, const char * endpoint, int maxwords)
+{
+FILE * f;
+char * fname, * s, line[128], key[64];
+int len;
+uint32_t rtt, bps;
+
+	if (!(fname = get_link_cache_path()))
+		return;
+	/* keep the entries for the other gdbservers */
+	s = 0;
+	len = 0;
+	if ((f = fopen(fname, "r")))
+	{
+		while (fgets(line, sizeof line, f))
+			if (sscanf(line, "%63s", key) == 1 && strcmp(key, endpoint))
+			{
+				if (!(s = realloc(s, len + strlen(line) + 1)))
+					break;
+				strcpy(s + len, line);
+				len += strlen(line);
+			}
+		fclose(f);
+	}
+	libgdb_get_link_stats(ctx, & rtt, & bps);
+	if ((f = fopen(fname, "w")))
+	{
+		if (s)
+			fputs(s, f);
+		fprintf(f, "%s %i %u %u\n", endpoint, maxwords, (unsigned) rtt, (unsigned) bps);
+		fclose(f);
+	}
+	free(s);
+	free(fname);
+}
+
+/* selects the memory transfer chunk size for the connected gdbserver - the
+ * chunk size is either measured (using the first ram area of the device,
+ * if a device has been specified), or retrieved from the link cache file */
+static void tune_link(struct libgdb_ctx * ctx, struct struct_devctl * dev)
+{
+char endpoint[64];
+int maxwords;
+uint32_t rtt, bps;
+
+	snprintf(endpoint, sizeof endpoint, "%s:%i", gdbserver_host, GDBSERVER_PORT);
+	if (!must_retune_link && !load_cached_link_settings(ctx, endpoint))
+		return;
+	if (!dev || !dev->ram_areas || !dev->ram_areas[0].len)
+	{
+		libgdb_set_max_nr_words_xferred(ctx, DEFAULT_MAX_NR_WORDS_XFERRED);
+		return;
+	}
+	printf("measuring gdbserver link performance...\n");
+	if ((maxwords = libgdb_autotune_max_nr_words_xferred(ctx, dev->ram_areas[0].start, dev->ram_areas[0].len)) == -1)
+	{
+		eprintf("gdbserver link autotuning failed, using default transfer settings\n");
+		libgdb_set_max_nr_words_xferred(ctx, DEFAULT_MAX_NR_WORDS_XFERRED);
+		return;
+	}
+	libgdb_get_link_stats(ctx, & rtt, & bps);
+	printf("gdbserver round trip time: %i usec, throughput: %i bytes/second, selected transfer size: %i words\n",
+			(int) rtt, (int) bps, maxwords);
+	store_link_settings(ctx, endpoint, maxwords);
+}
 
-	* outfile = 0;
-	* must_unlink = false;
+/*! image file formats */
+enum IMAGE_FORMAT
+{
+	IMAGE_FORMAT_INVALID = -1,
+	IMAGE_FORMAT_IHEX,
+	IMAGE_FORMAT_ELF,
+	IMAGE_FORMAT_SREC,
+	IMAGE_FORMAT_UF2,
+};
+
+/*!
+ *	\fn	static enum IMAGE_FORMAT get_image_file_format(const char * fname)
+ *	\brief	detects the format of an image file
+ *
+ *	\param	fname	the name of the image file
+ *	\return	the format of the image file, IMAGE_FORMAT_INVALID on error */
+static enum IMAGE_FORMAT get_image_file_format(const char * fname)
+{
+int fd;
+unsigned char x[512];
+ssize_t len;
 
 	/* try to open the input file and detect its format */
-	if ((fd = open(infile, O_RDONLY)) == -1)
+	if ((fd = open(fname, O_RDONLY)) == -1)
 	{
-		eprintf("error opening input file %s\n", infile);
-		return -1;
+		eprintf("error opening input file %s\n", fname);
+		return IMAGE_FORMAT_INVALID;
 	}
-	if (read(fd, x, sizeof x) != sizeof x)
+	if ((len = read(fd, x, sizeof x)) < 4)
 	{
-		eprintf("error reading input file %s (read error or file too small)\n", infile);
-		return -1;
+		eprintf("error reading input file %s (read error or file too small)\n", fname);
+		close(fd);
+		return IMAGE_FORMAT_INVALID;
 	}
 	close(fd);
 
 	if (x[0] == ':' && isalnum(x[1]) && isalnum(x[2]) && isalnum(x[3]))
-	{
-		/* looks like an ihex file - say it is such */
-		* must_unlink = false;
-		* outfile = strdup(infile);
-		return 0;
-	}
+		/* looks like an ihex file */
+		return IMAGE_FORMAT_IHEX;
 	else if (x[0] == 0x7f && x[1] == 'E' && x[2] == 'L' && x[3] == 'F')
+		/* looks like an elf file */
+		return IMAGE_FORMAT_ELF;
+	else if (x[0] == 'S' && isdigit(x[1]) && isxdigit(x[2]) && isxdigit(x[3]))
+		/* looks like a motorola s-record file */
+		return IMAGE_FORMAT_SREC;
+	else if (uf2buf_is_uf2(x, len))
+		/* looks like an uf2 file */
+		return IMAGE_FORMAT_UF2;
+	/* file format not recognized */
+	eprintf("could not read file %s, file format not recognized "
+			"(use '--load-addr' to load a raw binary file)\n", fname);
+	return IMAGE_FORMAT_INVALID;
+}
+
+/*!
+ *	\fn	static struct memimage * load_image_file(const char * fname)
+ *	\brief	reads an image file to load into the target, detecting its format
+ *
+ *	intel hex, motorola s-record, elf and uf2 files are supported;
+ *	if a load address has been specified by the '--load-addr' option,
+ *	the file is read as a raw binary file instead; elf, uf2 and raw
+ *	binary file contents are not copied, but referred to in a mapping
+ *	of the file, see memimage_add_external()
+ *
+ *	\param	fname	the name of the image file
+ *	\return	the memory image read from the file, null on error */
+static struct memimage * load_image_file(const char * fname)
+{
+struct memimage * image;
+
+	if (is_load_addr_specified)
+		return binfile_read(fname, load_addr);
+	switch (get_image_file_format(fname))
 	{
-		/* looks like an elf file - try to make an ihex file out of it with the help of objcopy */
-		int i;
-		/* make an output file name by concatenating an ".ihex" suffix to the input file name */
-		i = strlen(infile);
-		i += 5 + 1;
-		if (!(* outfile = malloc(i)))
-		{
-			eprintf("out of core\n");
-			return -1;
-		}
-		**outfile = 0;
-		strcat(*outfile, infile);
-		strcat(*outfile, ".ihex");
-
-		/* build the command line */
-		snprintf(cmdline, sizeof cmdline, "objcopy -O ihex \"%s\" \"%s\"", infile, *outfile);
-		memset(&pi, 0, sizeof pi);
-		memset(&si, 0, sizeof si);
-		if (!(CreateProcess(0,
-		                    cmdline,
-		                    0,
-		                    0,
-		                    FALSE, /* do not inherit handles */
-		                    0,
-		                    0,
-		                    0,
-		                    &si,
-		                    &pi)))
-		{
-			eprintf("failed to run objcopy to create the output ihex file\n");
-			eprintf("make sure that objcopy is available, and in your PATH\n");
-			free(*outfile);
-			return -1;
-		}
-		if (WaitForSingleObject(pi.hProcess, INFINITE) != WAIT_OBJECT_0)
-		{
-			eprintf("error waiting for objcopy to finish\n");
-			free(*outfile);
-			return -1;
-		}
-		if (!GetExitCodeProcess(pi.hProcess, &exit_code))
-		{
-			eprintf("error retrieving objcopy exit code\n");
-			free(*outfile);
-			return -1;
-		}
-		if (exit_code)
-		{
-			eprintf("error executing objcopy - objcopy returned %i\n", (int) exit_code);
-			free(*outfile);
-			return -1;
-		}
-		* must_unlink = true;
+		case IMAGE_FORMAT_IHEX:
+			if (!(image = hexfile_read(fname)))
+				eprintf("error reading hex file %s\n", fname);
+			return image;
+		case IMAGE_FORMAT_ELF:
+			return elffile_read(fname);
+		case IMAGE_FORMAT_SREC:
+			if (!(image = srecfile_read(fname)))
+				eprintf("error reading s-record file %s\n", fname);
+			return image;
+		case IMAGE_FORMAT_UF2:
+			return uf2file_read(fname);
+		default:
+			return 0;
 	}
-	else
+}
+
+/*! an image file load, run in a separate thread so that it overlaps with the target connection setup */
+struct image_load
+{
+	/*! the name of the image file to load */
+	const char	* fname;
+	/*! the memory image read from the image file, null if loading the image failed */
+	struct memimage	* image;
+	/*! the handle of the thread loading the image */
+	HANDLE		thread;
+};
+
+static DWORD WINAPI image_load_thread(LPVOID arg)
+{
+struct image_load * load = (struct image_load *) arg;
+
+	return (load->image = load_image_file(load->fname)) ? 0 : 1;
+}
+
+/*!
+ *	\fn	static int image_load_start(struct image_load * load, const char * fname)
+ *	\brief	starts loading an image file in the background
+ *
+ *	\param	load	the image load to start
+ *	\param	fname	the name of the image file to load
+ *	\return	0 if the load was started, -1 on error */
+static int image_load_start(struct image_load * load, const char * fname)
+{
+	memset(load, 0, sizeof * load);
+	load->fname = fname;
+	if (!(load->thread = CreateThread(0, 0, image_load_thread, load, 0, 0)))
 	{
-		/* file format not recognized */
-		eprintf("could not make an ihex file out of file %s, file format not recognized\n", infile);
+		eprintf("failed to create image loading thread\n");
 		return -1;
 	}
 	return 0;
 }
 
+/*!
+ *	\fn	static int image_load_finish(struct image_load * load)
+ *	\brief	waits for an image load started by image_load_start() to complete
+ *
+ *	\param	load	the image load to wait for
+ *	\return	0 if the image was loaded successfully, -1 on error */
+static int image_load_finish(struct image_load * load)
+{
+DWORD exit_code;
+
+	if (!load->thread)
+		return load->image ? 0 : -1;
+	if (WaitForSingleObject(load->thread, INFINITE) != WAIT_OBJECT_0
+			|| !GetExitCodeThread(load->thread, & exit_code))
+		exit_code = 1;
+	CloseHandle(load->thread);
+	load->thread = 0;
+	return (exit_code || !load->image) ? -1 : 0;
+}
+
+/*! releases an image load held by a job - the loading thread must not outlive the job, as it writes to 'load' */
+static void release_image_load(void * load)
+{
+	image_load_finish((struct image_load *) load);
+	memimage_destroy(((struct image_load *) load)->image);
+}
+
 static const struct struct_memarea * locate_mem_area(const struct struct_memarea * areas, uint32_t start_addr)
 {
 	while (areas->len)
@@ -319,80 +774,80 @@ int memtype;
 }
 
 
-static int get_flash_area_info(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t start_addr, uint32_t len,
-                             const struct struct_memarea ** mem_area, int * start_sector_nr, int * nr_sectors)
+/*!
+ *	\fn	static int get_flash_sector(struct struct_devctl * dev, uint32_t addr, int * sector_nr, uint32_t * sector_start, uint32_t * sector_len)
+ *	\brief	locates the flash sector containing a target address
+ *
+ *	sectors are numbered across all device flash areas, as in generic_flash_mass_erase()
+ *
+ *	\param	dev	the target device
+ *	\param	addr	the target address to locate
+ *	\param	sector_nr	the number of the sector is stored here
+ *	\param	sector_start	the start address of the sector is stored here
+ *	\param	sector_len	the length of the sector, in bytes, is stored here
+ *	\return	0 on success, -1 if the address is not in target flash */
+static int get_flash_sector(struct struct_devctl * dev, uint32_t addr, int * sector_nr, uint32_t * sector_start, uint32_t * sector_len)
 {
-/* locate starting sector number */
-int i, j;
-uint32_t addr, end_addr;
-const struct struct_memarea ** s;
-
-	if (mem_area)
-		* mem_area = 0;
-	if (start_sector_nr)
-		* start_sector_nr = -1;
-	if (nr_sectors)
-		* nr_sectors = -1;
-
-	end_addr = start_addr + len;
-	for (s = &dev->flash_areas; *s; s ++)
-	{
-		addr = (*s)->start;
-		for (i = 0; (*s)->sizes[i]; i ++)
-		{
-			if (start_addr <= addr && addr < end_addr)
-				break;
-			addr += (*s)->sizes[i];
-		}
-		if (start_addr <= addr && addr < end_addr)
-			break;
-	}
-	if (!(start_addr <= addr && addr < end_addr))
-		/* address not found */
-		return -2;
+const struct struct_memarea * m;
+uint32_t start;
+int i, n;
 
-	j = i;
-	do
+	for (n = 0, m = dev->flash_areas; m->len; m ++)
+		for (start = m->start, i = 0; m->sizes[i]; start += m->sizes[i ++], n ++)
+			if (addr - start < m->sizes[i])
+			{
+				* sector_nr = n;
+				* sector_start = start;
+				* sector_len = m->sizes[i];
+				return 0;
+			}
+	return -1;
+}
+
+/*!
+ *	\fn	static int wait_flash_idle(struct struct_devctl * dev, struct libgdb_ctx * ctx)
+ *	\brief	waits for a target flash operation still in progress (e.g. a sector erase) to complete
+ *
+ *	see the 'flash_wait_idle' field of struct struct_devctl
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\return	0 on success, -1 on error */
+static int wait_flash_idle(struct struct_devctl * dev, struct libgdb_ctx * ctx)
+{
+	if (dev->flash_wait_idle && dev->flash_wait_idle(dev, ctx))
 	{
-		addr += (*s)->sizes[i];
-		if (!(start_addr <= addr && addr < end_addr))
-			break;
-		i ++;
-	}
-	while ((*s)->sizes[i]);
-	if (start_addr <= addr && addr < end_addr)
-		/* requested flash area too large */
-		return -3;
-	if (mem_area)
-		* mem_area = * s;
-	if (start_sector_nr)
-		* start_sector_nr = j;
-	if (nr_sectors)
-		* nr_sectors = i - j + 1;
+		eprintf("error waiting for a target flash operation to complete\n");
+		return -1;
+	}
 	return 0;
 }
 
 static int generic_flash_erase_area(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t start_addr, uint32_t len)
 {
-/* locate starting sector number */
-int i, sector_nr, cnt;
+uint32_t addr, sector_start, sector_len;
+uint64_t end;
+int sector_nr;
 
 	if (!dev->flash_erase_sector)
 	{
 		eprintf("flash_erase_sector() routine unavailable, aborting\n");
 		return -1;
 	}
-	if (!len)
-		/* nothing to do */
-		return 0;
-	if (get_flash_area_info(dev, ctx, start_addr, len, 0, & sector_nr, & cnt))
-		return -1;
-	for (i = 0; i < cnt; i ++, sector_nr ++)
+	end = (uint64_t) start_addr + len;
+	for (addr = start_addr; addr < end; addr = sector_start + sector_len)
 	{
+		if (get_flash_sector(dev, addr, & sector_nr, & sector_start, & sector_len))
+		{
+			eprintf("address 0x%08x not in target flash, aborting\n", addr);
+			return -1;
+		}
 		if (dev->flash_erase_sector(dev, ctx, sector_nr))
 			return -1;
+		if ((uint64_t) sector_start + sector_len >= end)
+			break;
 	}
-	return 0;
+	return wait_flash_idle(dev, ctx);
 }
 
 
@@ -411,926 +866,1914 @@ const struct struct_memarea * m;
 		}
 	}
 
-	return 0;
+	return wait_flash_idle(dev, ctx);
 }
 
 
-int main(int argc, char ** argv)
+/*! a set of target flash sectors to erase
+ *
+ * sectors are added to the set for each address range that is to be
+ * programmed, so that sectors shared by several ranges are only erased
+ * once; when the plan is run, the sectors are either erased one by one,
+ * or the whole device is mass erased, whichever is estimated to be faster */
+struct erase_plan
 {
-struct libgdb_ctx * ctx;
-int i, argnr;
-uint32_t * buf, * rbuf, addr;
-int wordcnt;
-struct timeval tv1, tv2;
-struct timezone tz;
-int diff;
-double dx;
-bool is_target_connected;
-const char * devname;
-struct struct_devctl * devs, * pdev;
+	/*! the total number of device flash sectors */
+	int	nr_sectors;
+	/*! for each device flash sector, true if the sector is to be erased */
+	bool	* is_sector_erased;
+};
+
+/*!
+ *	\fn	static int erase_plan_init(struct struct_devctl * dev, struct erase_plan * plan)
+ *	\brief	initializes an empty erase plan
+ *
+ *	\param	dev	the target device
+ *	\param	plan	the erase plan to initialize
+ *	\return	0 on success, -1 if out of memory */
+static int erase_plan_init(struct struct_devctl * dev, struct erase_plan * plan)
+{
+const struct struct_memarea * m;
+int i;
 
+	for (plan->nr_sectors = 0, m = dev->flash_areas; m->len; m ++)
+		for (i = 0; m->sizes[i]; i ++)
+			plan->nr_sectors ++;
+	if (!(plan->is_sector_erased = calloc(plan->nr_sectors + 1, sizeof * plan->is_sector_erased)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	return 0;
+}
 
-void dump_target_regfile(void)
+/*!
+ *	\fn	static int erase_plan_add(struct struct_devctl * dev, struct erase_plan * plan, uint32_t start_addr, uint32_t len)
+ *	\brief	adds the flash sectors overlapping an address range to an erase plan
+ *
+ *	\param	dev	the target device
+ *	\param	plan	the erase plan to add sectors to
+ *	\param	start_addr	the start address of the range
+ *	\param	len	the length of the range, in bytes
+ *	\return	0 on success, -1 if the range is not entirely in target flash */
+static int erase_plan_add(struct struct_devctl * dev, struct erase_plan * plan, uint32_t start_addr, uint32_t len)
 {
-uint32_t reg;
-int i;
+uint32_t addr, sector_start, sector_len;
+uint64_t end;
+int sector_nr;
 
-	printf("target register file:\n");
-	for (i = 0; i < 16; i ++)
+	end = (uint64_t) start_addr + len;
+	for (addr = start_addr; addr < end; addr = sector_start + sector_len)
 	{
-		if (libgdb_readreg(ctx, i, &reg))
+		if (get_flash_sector(dev, addr, & sector_nr, & sector_start, & sector_len))
 		{
-			eprintf("error reading register %i\n", i);
-			exit(2);
+			eprintf("address 0x%08x not in target flash, aborting\n", addr);
+			return -1;
 		}
-		printf("r%i: 0x%08x, ", i, reg);
+		plan->is_sector_erased[sector_nr] = true;
+		if ((uint64_t) sector_start + sector_len >= end)
+			break;
 	}
-	/* read xpsr */
-	if (libgdb_readreg(ctx, 16, &reg))
+	return 0;
+}
+
+/*!
+ *	\fn	static int erase_plan_run(struct struct_devctl * dev, struct libgdb_ctx * ctx, struct erase_plan * plan)
+ *	\brief	erases the flash sectors of an erase plan, in the way estimated to be fastest
+ *
+ *	the time to erase the sectors one by one is estimated from the device
+ *	typical sector erase times, plus the gdbserver link round trips that
+ *	each erase operation takes; this is compared to the device typical
+ *	mass erase time, and the device is mass erased if this is faster, and
+ *	if mass erasing is allowed (see the '--allow-mass-erase' option);
+ *	when erasing sectors one by one, runs of adjacent sectors are erased
+ *	by a single flash_erase_area() call for devices that have no
+ *	flash_erase_sector() routine; the target flash is unlocked
+ *	before erasing, if there is anything to erase; the plan is destroyed
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	plan	the erase plan to run
+ *	\return	0 on success, -1 on error */
+static int erase_plan_run(struct struct_devctl * dev, struct libgdb_ctx * ctx, struct erase_plan * plan)
+{
+const struct struct_memarea * m;
+uint32_t rtt, start, run_start, run_len;
+uint64_t sectors_usec, mass_usec;
+int i, n, nr_erased, res;
+
+	libgdb_get_link_stats(ctx, & rtt, 0);
+	sectors_usec = 0;
+	nr_erased = 0;
+	for (n = 0, m = dev->flash_areas; m->len; m ++)
+		for (i = 0; m->sizes[i]; i ++, n ++)
+			if (plan->is_sector_erased[n])
+			{
+				nr_erased ++;
+				sectors_usec += (uint64_t) rtt * ERASE_NR_ROUND_TRIPS + dev->sector_erase_usec
+					+ (uint64_t) dev->sector_erase_usec_per_kb * (m->sizes[i] / 1024);
+			}
+	mass_usec = (uint64_t) rtt * ERASE_NR_ROUND_TRIPS + dev->mass_erase_usec;
+	res = -1;
+	if (!nr_erased)
 	{
-		eprintf("error reading xpsr\n");
-		exit(2);
+		res = 0;
+		goto out;
 	}
-	printf("xpsr: 0x%08x, ", reg);
-	/* read main stack pointer (msp) */
-	if (libgdb_readreg(ctx, 17, &reg))
+	if (dev->flash_unlock_area && dev->flash_unlock_area(dev, ctx, 0))
 	{
-		eprintf("error reading msp\n");
-		exit(2);
+		eprintf("error unlocking target flash, target may need reset\n");
+		goto out;
 	}
-	printf("msp: 0x%08x, ", reg);
-	/* read process stack pointer (psp) */
-	if (libgdb_readreg(ctx, 18, &reg))
+	if (dev->flash_mass_erase && dev->mass_erase_usec && mass_usec < sectors_usec)
 	{
-		eprintf("error reading psp\n");
-		exit(2);
+		if (is_mass_erase_allowed)
+		{
+			printf("erasing %i flash sectors is estimated to take %i ms, mass erasing the device instead (estimated %i ms)\n",
+					nr_erased, (int) (sectors_usec / 1000), (int) (mass_usec / 1000));
+			if (dev->flash_mass_erase(dev, ctx))
+				eprintf("error mass erasing target flash, target may need reset\n");
+			else
+				res = 0;
+			goto out;
+		}
+		printf("note: mass erasing the device is estimated to be faster than erasing %i flash sectors (%i ms vs %i ms), "
+				"use '--allow-mass-erase' to permit it\n", nr_erased, (int) (mass_usec / 1000), (int) (sectors_usec / 1000));
 	}
-	printf("psp: 0x%08x, ", reg);
-	/* read control, primask, faultmask, basepri */
-	if (libgdb_readreg(ctx, 19, &reg))
+	printf("erasing %i flash sectors, estimated time %i ms\n", nr_erased, (int) (sectors_usec / 1000));
+	run_len = 0;
+	for (n = 0, m = dev->flash_areas; m->len; m ++)
 	{
-		eprintf("error reading register 20\n");
-		exit(2);
+		for (start = m->start, i = 0; m->sizes[i]; start += m->sizes[i ++], n ++)
+		{
+			if (!plan->is_sector_erased[n])
+				continue;
+			if (dev->flash_erase_sector)
+			{
+				if (dev->flash_erase_sector(dev, ctx, n))
+				{
+					eprintf("error erasing flash\n");
+					goto out;
+				}
+				continue;
+			}
+			/* no sector erase routine - gather a run of adjacent sectors
+			 * to erase with a single flash_erase_area() call */
+			if (!run_len)
+				run_start = start;
+			run_len += m->sizes[i];
+			if (m->sizes[i + 1] && plan->is_sector_erased[n + 1])
+				continue;
+			if (!dev->flash_erase_area || dev->flash_erase_area(dev, ctx, run_start, run_len))
+			{
+				eprintf("error erasing flash\n");
+				goto out;
+			}
+			run_len = 0;
+		}
 	}
-	printf("control: 0x%08x, ", reg >> 24);
-	printf("faultmask: 0x%08x, ", (reg >> 16) & 255);
-	printf("basepri: 0x%08x, ", (reg >> 8) & 255);
-	printf("primask: 0x%08x, ", (reg >> 0) & 255);
-	printf("\n");
+	res = 0;
+out:
+	free(plan->is_sector_erased);
+	plan->is_sector_erased = 0;
+	return res;
 }
 
-void connect_to_target(void)
+static const char * get_signal_name(int sig)
 {
-	if (is_target_connected)
-		return;
-	is_target_connected = true;
-	if (!(ctx = libgdb_init()))
-	{
-		eprintf("failed to initialize the libgdb library\n");
-		exit(1);
-	}
-	if (is_vx_annotation_enabled)
-		libgdb_set_annotation(ctx, true);
-	if (libgdb_connect(ctx, "127.0.0.1", 1122))
+	switch (sig)
 	{
-		eprintf("failed to connect to a gdb server\n");
-		exit(2);
+		case 0: return "none";
+		case 2: return "SIGINT";
+		case 4: return "SIGILL";
+		case 5: return "SIGTRAP";
+		case 6: return "SIGABRT";
+		case 7: return "SIGEMT";
+		case 10: return "SIGBUS";
+		case 11: return "SIGSEGV";
+		default: return "unknown";
 	}
-
-	libgdb_send_ack(ctx);
-	libgdb_sendpacketraw(ctx, "c");
-	libgdb_sendbreak(ctx);
-	libgdb_waithalted(ctx);
-	libgdb_set_max_nr_words_xferred(ctx, 2);
-	libgdb_set_max_nr_words_xferred(ctx, 67);
-	libgdb_set_max_nr_words_xferred(ctx, 67 * /* this seems to be optimal */ 11);
-	libgdb_set_max_nr_words_xferred(ctx, 67 * 11);
-
-	libgdb_set_max_nr_words_xferred(ctx, 300);
-
-	libgdb_set_max_nr_words_xferred(ctx, 67 * 11);
 }
 
-struct struct_devctl * merge_dev_lists(struct struct_devctl * l1, struct struct_devctl * l2)
+static int verify_mem_area(struct libgdb_ctx * ctx, const struct data_mem_area * area)
 {
-struct struct_devctl * d;
+uint8_t * buf;
+int res;
 
-	if (!l1)
-		return l2;
-	if (!l2)
-		return l1;
-	for (d = l1; d->next; d = d-> next);
-	d->next = l2;
-	return l1;
+	if (!(buf = malloc(area->len)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	res = 0;
+	if (libgdb_readmem(ctx, area->addr, area->len, buf))
+	{
+		eprintf("error reading back memory area: start 0x%08x, size 0x%08x, aborting\n", area->addr, area->len);
+		res = -1;
+	}
+	else if (memcmp(buf, area->data, area->len))
+	{
+		eprintf("verification failed, memory read and written mismatch\n");
+		res = -1;
+	}
+	free(buf);
+	return res;
 }
 
-struct struct_devctl * find_device(struct struct_devctl * devs, const char * devname)
+/*!
+ *	\fn	static uint32_t get_program_gap_threshold(struct libgdb_ctx * ctx)
+ *	\brief	computes the number of bytes that take about as long to transfer as the fixed overhead of a flash programming call
+ *
+ *	\param	ctx	libgdb library context
+ *	\return	the gap threshold, in bytes, rounded up to a whole number of words */
+static uint32_t get_program_gap_threshold(struct libgdb_ctx * ctx)
 {
-	while (devs && strcmp(devs->name, devname))
-		devs = devs->next;
-	return devs;
+uint32_t rtt, bps;
+uint64_t x;
+
+	libgdb_get_link_stats(ctx, & rtt, & bps);
+	if (!rtt || !bps)
+		return DEFAULT_PROGRAM_GAP_THRESHOLD;
+	x = (uint64_t) rtt * PROGRAM_CALL_NR_ROUND_TRIPS * bps / 1000000;
+	if (x > UINT32_MAX / 2)
+		x = UINT32_MAX / 2;
+	return (x + sizeof(uint32_t) - 1) & ~ (sizeof(uint32_t) - 1);
 }
 
-	if (0) test_objcopy("c:/shopov/src/vxgen0/vxgen0.elf", "c:/shopov/vx.hex");
-
-	/* build a list of supported devices */
-	devs = 0;
-	devs = merge_dev_lists(devs, stm32f10x_get_devs());
-	devs = merge_dev_lists(devs, stm32f4x_get_devs());
-	devs = merge_dev_lists(devs, stm32f0x_get_devs());
-	devs = merge_dev_lists(devs, lpc17xx_get_devs());
-	is_target_connected = false;
-	is_vx_annotation_enabled = false;
-
-	devname = 0;
-	pdev = 0;
-
-	for (argnr = 1; argnr < argc; )
+/*!
+ *	\fn	static int program_flash_words(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, const uint32_t * words, uint32_t wordcnt)
+ *	\brief	programs words to erased target flash, skipping long runs of words holding the erased flash value
+ *
+ *	programming a word with the erased value leaves the flash unchanged,
+ *	so runs of such words are split out of the data programmed; runs
+ *	shorter than get_program_gap_threshold() are programmed nevertheless,
+ *	as the overhead of an extra flash programming call would exceed the
+ *	time saved; only the part of a run between 'program_align' boundaries
+ *	of the device is split out, as the device may not be able to start
+ *	programming at an arbitrary word
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	addr	the target flash address to program, must be word aligned
+ *	\param	words	the data to program
+ *	\param	wordcnt	the number of words to program
+ *	\return	0 on success, -1 on error */
+static int program_flash_words(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, const uint32_t * words, uint32_t wordcnt)
+{
+uint32_t i, start, run, min_run, align, skip_start, skip_end;
+
+	min_run = get_program_gap_threshold(ctx) / sizeof(uint32_t);
+	if (min_run < 1)
+		min_run = 1;
+	if (!(align = dev->program_align))
+		align = sizeof(uint32_t);
+	for (start = i = 0; i < wordcnt; )
 	{
-		if (!strcmp(argv[argnr], "--help") || !strcmp(argv[argnr], "-h"))
+		if (words[i] != flash_erased_word)
 		{
-			/* print usage infiormation */
-			printf("usage: %s [--enable-vx-annotation] [-h|--help] -d device-name [--erase-sector sector-number] [-l] [--regs] [-r addr wordcnt outfile] [-w addr infile] [--erase-area addr len] [-x hexfile] [-t] [-e] [--cont] [--stop]\n", * argv);
-			exit(0);
+			i ++;
+			continue;
 		}
-		else if (!strcmp(argv[argnr], "--enable-vx-annotation"))
+		/* measure the run of erased value words */
+		for (run = 1; i + run < wordcnt && words[i + run] == flash_erased_word; run ++)
+			;
+		/* trim the run to program alignment boundaries - the data
+		 * after the run must start at an aligned address, and the
+		 * data before the run is kept in whole aligned blocks */
+		for (skip_start = i; skip_start < i + run && (addr + skip_start * sizeof(uint32_t)) % align; skip_start ++)
+			;
+		skip_end = i + run;
+		if (skip_end < wordcnt)
+			while (skip_end > skip_start && (addr + skip_end * sizeof(uint32_t)) % align)
+				skip_end --;
+		if (skip_end - skip_start >= min_run)
 		{
-			argnr ++;
-			is_vx_annotation_enabled = true;
+			if (skip_start > start && dev->flash_program_words(dev, ctx, addr + start * sizeof(uint32_t),
+						(uint32_t *) words + start, skip_start - start))
+				return -1;
+			start = skip_end;
 		}
-		else if (!strcmp(argv[argnr], "--regs"))
-		{
-			argnr ++;
-			is_target_connected = true;
-			if (!(ctx = libgdb_init()))
-			{
-				eprintf("failed to initialize the libgdb library\n");
-				exit(1);
-			}
-			if (libgdb_connect(ctx, "127.0.0.1", 1122))
-			{
-				eprintf("failed to connect to a gdb server\n");
-				exit(2);
-			}
-
-			libgdb_send_ack(ctx);
-			libgdb_sendpacketraw(ctx, "c");
-			libgdb_sendbreak(ctx);
-			libgdb_waithalted(ctx);
-			libgdb_set_max_nr_words_xferred(ctx, 2);
-			libgdb_set_max_nr_words_xferred(ctx, 67);
+		i += run;
+	}
+	if (i > start && dev->flash_program_words(dev, ctx, addr + start * sizeof(uint32_t),
+				(uint32_t *) words + start, i - start))
+		return -1;
+	/* if all of the words were skipped, an erase may still be in progress */
+	return wait_flash_idle(dev, ctx);
+}
 
-			dump_target_regfile();
-			return 0;
+/*!
+ *	\fn	static int program_flash_bytes(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, const uint8_t * data, uint32_t len)
+ *	\brief	programs data of arbitrary length to erased target flash, see program_flash_words()
+ *
+ *	a trailing partial word is padded with the erased flash value; for
+ *	this, the last chunk of the data (of up to FILE_XFER_CHUNK_SIZE bytes,
+ *	or of 'program_align' bytes of the device, if larger) is copied to a
+ *	padded buffer, and is programmed along with the partial word
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	addr	the target flash address to program, must be word aligned
+ *	\param	data	the data to program
+ *	\param	len	the number of bytes to program
+ *	\return	0 on success, -1 on error */
+static int program_flash_bytes(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, const uint8_t * data, uint32_t len)
+{
+uint32_t align, chunk, n;
+uint32_t * block;
+int res;
+
+	if (!(len & (sizeof(uint32_t) - 1)))
+		return program_flash_words(dev, ctx, addr, (const uint32_t *) data, len / sizeof(uint32_t));
+	if (!(align = dev->program_align))
+		align = sizeof(uint32_t);
+	chunk = (align > FILE_XFER_CHUNK_SIZE) ? align : FILE_XFER_CHUNK_SIZE;
+	/* program the data before the last chunk as it is; the
+	 * last chunk starts at an aligned offset from 'addr' */
+	n = (len & ~ (sizeof(uint32_t) - 1)) / chunk * chunk;
+	if (n && program_flash_words(dev, ctx, addr, (const uint32_t *) data, n / sizeof(uint32_t)))
+		return -1;
+	len -= n;
+	/* the padded buffer spans a whole aligned block, as some
+	 * flash programming routines always read that much */
+	if (!(block = malloc(len + align)))
+	{
+		eprintf("out of core\n");
+		return -1;
+	}
+	memset(block, 0xff, len + align);
+	memcpy(block, data + n, len);
+	res = program_flash_words(dev, ctx, addr + n, block, (len + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+	free(block);
+	return res;
+}
 
+/*!
+ *	\fn	static int program_mem_area(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct data_mem_area * s, int memtype)
+ *	\brief	writes a memory area to the target; flash areas must have already been erased
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	s	the memory area to write
+ *	\param	memtype	the type of the target memory, as returned by get_mem_type()
+ *	\return	0 on success, -1 on error */
+static int program_mem_area(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct data_mem_area * s, int memtype)
+{
+	if (memtype == MEM_TYPE_RAM)
+	{
+		if (libgdb_writemem(ctx, s->addr, s->len, s->data))
+		{
+			eprintf("error writing ram area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+			return -1;
 		}
-		else if (!strcmp(argv[argnr], "-l"))
+		return 0;
+	}
+	if (memtype != MEM_TYPE_FLASH)
+	{
+		/* should never happen */
+		eprintf("bad memory area type: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+		return -1;
+	}
+	if (!dev->flash_program_words)
+	{
+		eprintf("target flash write routine not specified, not performing flash write\n");
+		return -1;
+	}
+	if (s->addr & (sizeof(uint32_t) - 1))
+	{
+		eprintf("flash area not word aligned: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+		return -1;
+	}
+	if (program_flash_bytes(dev, ctx, s->addr, s->data, s->len))
+	{
+		eprintf("error writing flash area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+		return -1;
+	}
+	return 0;
+}
+
+/*!
+ *	\fn	static struct memimage * coalesce_flash_areas(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct memimage * image)
+ *	\brief	joins image flash areas separated by small gaps, so that they can be programmed with fewer flash programming calls
+ *
+ *	consecutive image areas in the same flash sector, separated by a gap
+ *	shorter than get_program_gap_threshold(), are joined in a single
+ *	area, with the gaps filled with the erased flash value; as the
+ *	sector is erased before programming, the flash contents are the same
+ *	as when programming the areas separately; all other areas are left
+ *	as they are, and are referred to, and not copied, by the image returned
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	image	the memory image to process; it must not be destroyed before the image returned
+ *	\return	the coalesced image, which must be deallocated with memimage_destroy(); null on error */
+static struct memimage * coalesce_flash_areas(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct memimage * image)
+{
+struct memimage * runs;
+const struct data_mem_area * s, * t, * last;
+uint32_t threshold, sector_start, sector_len, end, len;
+uint8_t * data;
+int sector_nr, next_sector_nr, res;
+
+	threshold = get_program_gap_threshold(ctx);
+	if (!(runs = memimage_create()))
+	{
+		eprintf("out of core\n");
+		return 0;
+	}
+	for (s = image->areas; s; s = last->next)
+	{
+		/* find the last area to join with this one */
+		last = s;
+		if (get_mem_type(dev, ctx, s->addr, s->len) == MEM_TYPE_FLASH)
+			for (t = s->next; t; last = t, t = t->next)
+			{
+				end = last->addr + last->len;
+				if (t->addr - end >= threshold
+						|| get_mem_type(dev, ctx, t->addr, t->len) != MEM_TYPE_FLASH
+						|| get_flash_sector(dev, end - 1, & sector_nr, & sector_start, & sector_len)
+						|| get_flash_sector(dev, t->addr, & next_sector_nr, & sector_start, & sector_len)
+						|| sector_nr != next_sector_nr)
+					break;
+			}
+		len = last->addr + last->len - s->addr;
+		if (last == s)
+			res = memimage_add_external(runs, s->addr, s->data, s->len);
+		else if ((data = memimage_append(runs, s->addr, len)))
 		{
-			/* list devices */
-			argnr ++;
-			list_devices(devs, is_vx_annotation_enabled);
+			memset(data, 0xff, len);
+			for (t = s; t != last->next; t = t->next)
+				memcpy(data + (t->addr - s->addr), t->data, t->len);
+			res = 0;
 		}
-		else if (!strcmp(argv[argnr], "-d"))
+		else
+			res = -1;
+		if (res)
 		{
-			/* specify device */
-			argnr ++;
-			if (argnr == argc)
-			{
-				eprintf("missing device name\n");
-				exit(1);
-			}
-			devname = argv[argnr ++];
-			if (!(pdev = find_device(devs, devname)))
-			{
-				eprintf("unknown device name (%s); type '%s -l' to get a list of supported devices\n", devname, * argv);
-				exit(1);
-			}
+			eprintf("out of core\n");
+			memimage_destroy(runs);
+			return 0;
 		}
+	}
+	if (memimage_finish(runs))
+	{
+		memimage_destroy(runs);
+		return 0;
+	}
+	if (runs->nr_areas != image->nr_areas)
+		printf("%i image areas coalesced into %i program runs (gap threshold %u bytes)\n",
+				image->nr_areas, runs->nr_areas, (unsigned) threshold);
+	return runs;
+}
 
+/*!
+ *	\fn	static int program_flash_delta(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct memimage * image)
+ *	\brief	programs the flash contents of a memory image, erasing and programming only the flash sectors that change
+ *
+ *	for each flash sector touched by the image, the contents that the
+ *	sector would have after being erased and programmed (the image data,
+ *	and the erased flash value elsewhere) are checksummed, and compared
+ *	to the checksum of the current sector contents, computed on the
+ *	target side (see target_crc32()); only sectors whose checksums
+ *	differ are erased, programmed and verified; image areas outside
+ *	of the target flash are ignored
+ *
+ *	\param	dev	the target device
+ *	\param	ctx	libgdb library context
+ *	\param	image	the memory image to program
+ *	\return	0 on success, -1 on error */
+static int program_flash_delta(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct memimage * image)
+{
+const struct data_mem_area * s, * t;
+struct data_mem_area piece;
+uint32_t addr, sector_start, sector_len, done_end, crc, target_crc;
+uint64_t end, sector_end;
+uint8_t * buf;
+int sector_nr, nr_changed, nr_sectors, res;
 
-
-		else if (!strcmp(argv[argnr], "--hack-test"))
+	if (!dev->flash_erase_sector)
+	{
+		eprintf("flash_erase_sector() routine unavailable, aborting\n");
+		return -1;
+	}
+	if (dev->flash_unlock_area && dev->flash_unlock_area(dev, ctx, 0))
+	{
+		eprintf("error unlocking target flash, target may need reset\n");
+		return -1;
+	}
+	buf = 0;
+	res = -1;
+	nr_changed = nr_sectors = 0;
+	done_end = 0;
+	for (s = image->areas; s; s = s->next)
+	{
+		if (get_mem_type(dev, ctx, s->addr, s->len) != MEM_TYPE_FLASH)
+			continue;
+		end = (uint64_t) s->addr + s->len;
+		for (addr = s->addr; addr < end; addr = sector_end)
 		{
-			/* perform hack tests */
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
-			if (!pdev->ram_areas)
-			{
-				eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
-				exit(1);
-			}
-			connect_to_target();
-			if (libgdb_readwords(ctx, 0x400fc080, 3, (uint32_t[3]){}))
-				printf("hack tests failed!!!\n");
-			else
-				printf("hack tests succeeded\n");
-
-
+			if (get_flash_sector(dev, addr, & sector_nr, & sector_start, & sector_len))
+			{
+				eprintf("address 0x%08x not in target flash, aborting\n", addr);
+				goto out;
+			}
+			sector_end = (uint64_t) sector_start + sector_len;
+			if (nr_sectors && sector_start < done_end)
+				/* already handled along with a preceding image area */
+				continue;
+			done_end = sector_end;
+			nr_sectors ++;
+			if (!(buf = realloc(buf, sector_len)))
+			{
+				eprintf("out of core\n");
+				goto out;
+			}
+			/* build the expected sector contents - the image areas are
+			 * sorted, so all areas overlapping the sector follow 's' */
+			memset(buf, 0xff, sector_len);
+			for (t = s; t && t->addr < sector_end; t = t->next)
+				if ((uint64_t) t->addr + t->len > sector_start)
+				{
+					piece.addr = t->addr > sector_start ? t->addr : sector_start;
+					piece.len = ((uint64_t) t->addr + t->len < sector_end ? (uint64_t) t->addr + t->len : sector_end) - piece.addr;
+					memcpy(buf + piece.addr - sector_start, t->data + piece.addr - t->addr, piece.len);
+				}
+			crc = libgdb_compute_crc32(0xffffffff, buf, sector_len);
+			if (target_crc32(dev, ctx, sector_start, sector_len, & target_crc))
+				goto out;
+			if (crc == target_crc)
+				continue;
+			/* sector contents differ - erase and program the sector */
+			nr_changed ++;
+			printf("sector %i (0x%08x, 0x%08x bytes) changed, reprogramming\n", sector_nr, sector_start, sector_len);
+			if (dev->flash_erase_sector(dev, ctx, sector_nr))
+			{
+				eprintf("error erasing flash\n");
+				goto out;
+			}
+			for (t = s; t && t->addr < sector_end; t = t->next)
+				if ((uint64_t) t->addr + t->len > sector_start)
+				{
+					piece.next = 0;
+					piece.addr = t->addr > sector_start ? t->addr : sector_start;
+					piece.len = ((uint64_t) t->addr + t->len < sector_end ? (uint64_t) t->addr + t->len : sector_end) - piece.addr;
+					piece.data = t->data + piece.addr - t->addr;
+					if (program_mem_area(dev, ctx, & piece, MEM_TYPE_FLASH) || verify_mem_area(ctx, & piece))
+						goto out;
+				}
 		}
+	}
+	printf("%i of %i flash sectors changed, %i sectors skipped\n", nr_changed, nr_sectors, nr_sectors - nr_changed);
+	res = 0;
+out:
+	free(buf);
+	return res;
+}
 
+enum
+{
+	/*! the size of the chunks that a streamed image is passed in, in bytes, see struct image_stream */
+	STREAM_CHUNK_SIZE	= 16 * 1024,
+	/*! the number of chunks that a streamed image is passed through */
+	STREAM_QUEUE_LEN	= 8,
+};
+
+/*! a chunk of image data, see struct image_stream */
+struct stream_chunk
+{
+	/*! the data of the chunk; the area 'next' field is unused */
+	struct data_mem_area	area;
+	/*! if true, this is the last chunk of the stream, carrying no data */
+	bool	is_end;
+	/*! the chunk data buffer */
+	uint8_t	data[STREAM_CHUNK_SIZE];
+};
+
+/*! an image file streamed to the target
+ *
+ * the image file is parsed in a separate thread, which emits its
+ * data in file order, in chunks; a chunk holds a contiguous run of
+ * data that never crosses a STREAM_CHUNK_SIZE aligned address, so
+ * the chunks can be erased and programmed as they arrive; chunks are
+ * passed through a fixed ring of STREAM_QUEUE_LEN buffers, which
+ * bounds memory usage and makes the parser wait for the programming
+ * when it gets too far ahead; the parser and the programming loop
+ * each own one end of the ring, and synchronize via two semaphores,
+ * counting the free and the filled buffers */
+struct image_stream
+{
+	/*! the name of the image file */
+	const char	* fname;
+	/*! the chunk buffer ring */
+	struct stream_chunk	* chunks;
+	/*! the index of the next buffer to fill, modified by the parsing thread only */
+	int		fill_idx;
+	/*! the index of the next buffer to consume, modified by the programming loop only */
+	int		consume_idx;
+	/*! the buffer being filled by the parsing thread, null if none */
+	struct stream_chunk	* cur;
+	/*! semaphores counting the free and the filled buffers */
+	HANDLE		free_sem, full_sem;
+	/*! set by the programming loop to make the parsing thread stop */
+	volatile bool	is_aborted;
+	/*! the parsing status, 0 if the whole file has been parsed successfully */
+	int		status;
+	/*! the handle of the parsing thread */
+	HANDLE		thread;
+};
+
+/* passes the chunk being filled to the programming loop */
+static void stream_push_chunk(struct image_stream * stream)
+{
+	stream->cur = 0;
+	stream->fill_idx = (stream->fill_idx + 1) % STREAM_QUEUE_LEN;
+	ReleaseSemaphore(stream->full_sem, 1, 0);
+}
 
+/* obtains a free chunk buffer to fill; returns null if the stream has been aborted */
+static struct stream_chunk * stream_get_free_chunk(struct image_stream * stream)
+{
+struct stream_chunk * chunk;
 
-		else if (!strcmp(argv[argnr], "--hack"))
-		{
-			uint32_t x[3];
+	WaitForSingleObject(stream->free_sem, INFINITE);
+	if (stream->is_aborted)
+		return 0;
+	chunk = stream->chunks + stream->fill_idx;
+	chunk->area.addr = 0;
+	chunk->area.len = 0;
+	chunk->area.data = chunk->data;
+	chunk->is_end = false;
+	return chunk;
+}
 
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
-			if (!pdev->ram_areas)
-			{
-				eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
-				exit(1);
-			}
-			connect_to_target();
-			if (libgdb_readwords(ctx, 0x20000000 + 0x1ff4, 3, x))
-			{
-				printf("error\n");
-				exit(1);
-			}
-			printf("0x%x 0x%x 0x%x\n", 0[x], 1[x], 2[x]);
-			exit(1);
+static int stream_data_handler(void * cookie, uint32_t addr, const uint8_t * data, unsigned len)
+{
+struct image_stream * stream = cookie;
+struct stream_chunk * chunk;
+unsigned n;
 
+	while (len)
+	{
+		chunk = stream->cur;
+		if (chunk && addr != chunk->area.addr + chunk->area.len)
+		{
+			/* not contiguous with the chunk being filled - start a new one */
+			stream_push_chunk(stream);
+			chunk = 0;
+		}
+		if (!chunk)
+		{
+			if (!(chunk = stream->cur = stream_get_free_chunk(stream)))
+				return -1;
+			chunk->area.addr = addr;
 		}
+		n = STREAM_CHUNK_SIZE - addr % STREAM_CHUNK_SIZE;
+		if (n > len)
+			n = len;
+		memcpy(chunk->data + chunk->area.len, data, n);
+		chunk->area.len += n;
+		addr += n;
+		data += n;
+		len -= n;
+		if (!(addr % STREAM_CHUNK_SIZE))
+			stream_push_chunk(stream);
+	}
+	return 0;
+}
 
+static DWORD WINAPI image_stream_thread(LPVOID arg)
+{
+struct image_stream * stream = (struct image_stream *) arg;
+struct stream_chunk * chunk;
+
+	stream->status = hexfile_stream(stream->fname, stream_data_handler, stream);
+	if (stream->is_aborted)
+		return 1;
+	if (stream->cur)
+		stream_push_chunk(stream);
+	/* terminate the stream */
+	if ((chunk = stream_get_free_chunk(stream)))
+	{
+		chunk->is_end = true;
+		stream_push_chunk(stream);
+	}
+	return 0;
+}
 
-		else if (!strcmp(argv[argnr], "-t"))
-		{
-			/* perform memory read/write speed tests */
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
-			if (!pdev->ram_areas)
-			{
-				eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
-				exit(1);
-			}
-			/* use the first device ram area to do the tests */
-			addr = pdev->ram_areas[0].start;
-			wordcnt = pdev->ram_areas[0].len >> 2;
+/*!
+ *	\fn	static struct image_stream * image_stream_open(const char * fname)
+ *	\brief	starts streaming an intel hex file, see struct image_stream
+ *
+ *	\param	fname	the name of the intel hex file to stream
+ *	\return	the image stream, null on error */
+static struct image_stream * image_stream_open(const char * fname)
+{
+struct image_stream * stream;
 
-			if (!wordcnt)
-			{
-				eprintf("invalid device ram area length, unable to perform memory read/write speed tests, aborting\n");
-				exit(1);
-			}
+	if (!(stream = calloc(1, sizeof * stream))
+			|| !(stream->chunks = malloc(STREAM_QUEUE_LEN * sizeof * stream->chunks)))
+	{
+		eprintf("out of core\n");
+		free(stream);
+		return 0;
+	}
+	stream->fname = fname;
+	if (!(stream->free_sem = CreateSemaphore(0, STREAM_QUEUE_LEN, STREAM_QUEUE_LEN, 0))
+			|| !(stream->full_sem = CreateSemaphore(0, 0, STREAM_QUEUE_LEN, 0))
+			|| !(stream->thread = CreateThread(0, 0, image_stream_thread, stream, 0, 0)))
+	{
+		eprintf("failed to start image streaming thread\n");
+		if (stream->free_sem)
+			CloseHandle(stream->free_sem);
+		if (stream->full_sem)
+			CloseHandle(stream->full_sem);
+		free(stream->chunks);
+		free(stream);
+		return 0;
+	}
+	return stream;
+}
 
-			if (!((buf = malloc(wordcnt * sizeof(uint32_t))) && (rbuf = calloc(wordcnt, sizeof(uint32_t)))))
-			{
-				eprintf("cannot allocate memory for tests, unable to perform memory read/write speed tests, aborting\n");
-				exit(1);
-			}
-			/* initialize test pattern */
-			for (i = 0; i < wordcnt; i ++)
-				buf[i] = i;
+/*!
+ *	\fn	static const struct stream_chunk * image_stream_get_chunk(struct image_stream * stream)
+ *	\brief	retrieves the next chunk of a stream, waiting for it to be parsed if necessary
+ *
+ *	the chunk retrieved must be released by image_stream_release_chunk() once consumed
+ *
+ *	\param	stream	the image stream
+ *	\return	the next chunk; a chunk with the 'is_end' field set terminates the stream */
+static const struct stream_chunk * image_stream_get_chunk(struct image_stream * stream)
+{
+	WaitForSingleObject(stream->full_sem, INFINITE);
+	return stream->chunks + stream->consume_idx;
+}
 
-			connect_to_target();
+static void image_stream_release_chunk(struct image_stream * stream)
+{
+	stream->consume_idx = (stream->consume_idx + 1) % STREAM_QUEUE_LEN;
+	ReleaseSemaphore(stream->free_sem, 1, 0);
+}
 
-#if 1
-			/* memory write test */
-			printf("performing memory write test...\n");
-			gettimeofday(&tv1, &tz);
-			if (libgdb_writewords(ctx, addr, wordcnt, buf))
-			{
-				eprintf("error writing target memory\n");
-				exit(2);
-			}
-			gettimeofday(&tv2, &tz);
-
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("\n\n\nwrite speed:\n");
-			printf("%i bytes written in %i.%i seconds\n", wordcnt * 4, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
-			dx = ((double) (wordcnt * 4)) / (double) diff;
-			dx *= 1000000.;
-			printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
-			printf("\n\n\n");
-#endif
-#if 1
-			/* memory read test */
-			printf("performing memory read test...\n");
-			gettimeofday(&tv1, &tz);
-			if (libgdb_readwords(ctx, addr, wordcnt, rbuf))
-			{
-				eprintf("error reading target memory\n");
-				exit(2);
-			}
-			gettimeofday(&tv2, &tz);
-
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("\n\n\nread speed:\n");
-			printf("%i bytes read in %i.%i seconds\n", wordcnt * 4, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
-			dx = ((double) (wordcnt * 4)) / (double) diff;
-			dx *= 1000000.;
-			printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
-			printf("\n\n\n");
-
-			if (memcmp(buf, rbuf, wordcnt * sizeof(uint32_t)))
-			{
-				eprintf("fatal error: data written and data read do not match!!!\n");
-				exit(1);
-			}
-#endif
+/*!
+ *	\fn	static int image_stream_close(struct image_stream * stream)
+ *	\brief	stops streaming an image, and deallocates the stream
+ *
+ *	\param	stream	the image stream
+ *	\return	0 if the stream was consumed to its end, and the whole image file was parsed successfully, -1 otherwise */
+static int image_stream_close(struct image_stream * stream)
+{
+int res;
+
+	/* if the parsing thread is still running, make it stop */
+	stream->is_aborted = true;
+	ReleaseSemaphore(stream->free_sem, 1, 0);
+	WaitForSingleObject(stream->thread, INFINITE);
+	CloseHandle(stream->thread);
+	CloseHandle(stream->free_sem);
+	CloseHandle(stream->full_sem);
+	res = stream->status;
+	free(stream->chunks);
+	free(stream);
+	return res ? -1 : 0;
+}
 
-			free(buf);
-			free(rbuf);
+/*! releases an image stream held by a job - the parsing thread must not outlive the job */
+static void release_image_stream(void * stream)
+{
+	image_stream_close((struct image_stream *) stream);
+}
 
+/*!
+ *	\fn	static int stream_image_to_target(struct struct_devctl * dev, struct libgdb_ctx * ctx, struct image_stream * stream)
+ *	\brief	erases, programs and verifies the chunks of an image stream, as they arrive
+ *
+ *	the image data must be in ascending address order; each flash
+ *	sector is erased when the first chunk of data destined to it arrives
+ *
+ *	\param	dev	the target device, already opened
+ *	\param	ctx	libgdb library context
+ *	\param	stream	the image stream
+ *	\return	0 on success, -1 on error */
+static int stream_image_to_target(struct struct_devctl * dev, struct libgdb_ctx * ctx, struct image_stream * stream)
+{
+const struct stream_chunk * chunk;
+const struct data_mem_area * s;
+uint32_t addr, end, erased_end, sector_start, sector_len;
+int memtype, sector_nr, nr_chunks;
+bool is_flash_unlocked;
+
+	erased_end = end = 0;
+	is_flash_unlocked = false;
+	for (nr_chunks = 0; !(chunk = image_stream_get_chunk(stream))->is_end; nr_chunks ++)
+	{
+		s = & chunk->area;
+		if (nr_chunks && s->addr < end)
+		{
+			eprintf("image data not in ascending address order at address 0x%08x, cannot stream the image\n", s->addr);
+			return -1;
 		}
-		else if (!strcmp(argv[argnr], "-e"))
+		end = s->addr + s->len;
+		if ((memtype = get_mem_type(dev, ctx, s->addr, s->len)) == MEM_TYPE_INVALID)
 		{
-			/* mass erase device */
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
-			/*! \todo	properly unlock flash here */
-
-			if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+			eprintf("invalid memory area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+			return -1;
+		}
+		if (memtype == MEM_TYPE_FLASH)
+		{
+			if (!is_flash_unlocked && dev->flash_unlock_area && dev->flash_unlock_area(dev, ctx, 0))
 			{
 				eprintf("error unlocking target flash, target may need reset\n");
-				return - 1;
+				return -1;
 			}
-			/*
-
-			if (pdev->flash_erase_area)
+			is_flash_unlocked = true;
+			/* erase the sectors of the chunk not yet erased; as data
+			 * arrives in ascending address order, only the last sector
+			 * erased can be shared with the chunk */
+			for (addr = s->addr; addr < end; addr = sector_start + sector_len)
 			{
-				if (pdev->flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
+				if (get_flash_sector(dev, addr, & sector_nr, & sector_start, & sector_len))
 				{
-					eprintf("error erasing flash\n");
-					exit(1);
+					eprintf("address 0x%08x not in a flash sector\n", addr);
+					return -1;
 				}
-			}
-			else
-			{
-				printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
-				if (generic_flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
+				if (addr < erased_end)
+					continue;
+				printf("erasing sector %i, start 0x%08x, size 0x%08x\n", sector_nr, sector_start, sector_len);
+				if (dev->flash_erase_sector ? dev->flash_erase_sector(dev, ctx, sector_nr)
+						: (!dev->flash_erase_area || dev->flash_erase_area(dev, ctx, sector_start, sector_len)))
 				{
 					eprintf("error erasing flash\n");
-					exit(1);
-				}
-			}
-			*/
-
-			if (pdev->flash_mass_erase)
-			{
-				if (pdev->flash_mass_erase(pdev, ctx))
-				{
-					eprintf("error mass erasing target flash, target may need reset\n");
-					return - 1;
+					return -1;
 				}
+				erased_end = sector_start + sector_len;
 			}
-			else if (pdev->flash_erase_sector)
-			{
-				printf("flash_mass_erase() routine unavailable, invoking generic flash erase area routine\n");
-				for (i = 0; pdev->flash_areas[i].len; i ++)
-				{
-					if (generic_flash_erase_area(pdev, ctx, pdev->flash_areas[i].start, pdev->flash_areas[i].len))
-					{
-						eprintf("error erasing flash\n");
-						exit(1);
-					}
-				}
-			}
-			else
-			{
-				eprintf("neither mass erase, nor erase sector routines specified\n");
-				eprintf("aborting mass erase request\n");
-				return -1;
-			}
-			printf("ok, chip successfully mass erased\n");
 		}
-		else if (!strcmp(argv[argnr], "--cont"))
-		{
-			argnr ++;
-			connect_to_target();
-			libgdb_sendpacket(ctx, "c");
-			return 0;
-		}
-		else if (!strcmp(argv[argnr], "--stop") || !strcmp(argv[argnr], "--halt"))
-		{
+		if (program_mem_area(dev, ctx, s, memtype) || verify_mem_area(ctx, s))
+			return -1;
+		image_stream_release_chunk(stream);
+	}
+	if (!nr_chunks)
+	{
+		eprintf("no data to write\n");
+		return -1;
+	}
+	printf("%i chunks of up to %i bytes streamed to the target\n", nr_chunks, STREAM_CHUNK_SIZE);
+	return 0;
+}
 
-			argnr ++;
-			is_target_connected = true;
-			if (!(ctx = libgdb_init()))
-			{
-				eprintf("failed to initialize the libgdb library\n");
-				exit(1);
-			}
-			if (libgdb_connect(ctx, "127.0.0.1", 1122))
-			{
-				eprintf("failed to connect to a gdb server\n");
-				exit(2);
-			}
+int main(int argc, char ** argv)
+{
+struct libgdb_ctx * ctx;
+int i, argnr;
+uint32_t * buf, addr;
+int wordcnt;
+struct timeval tv1, tv2;
+struct timezone tz;
+int diff;
+double dx;
+bool is_target_connected;
+const char * devname, * endpoint;
+struct struct_devctl * devs, * pdev;
 
-			libgdb_sendbreak(ctx);
-			libgdb_waithalted(ctx);
-			return 0;
-		}
-		else if (!strcmp(argv[argnr], "--erase-area"))
-		{
-			/* write to flash */
-			int len;
-			char * s;
 
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
+void dump_target_regfile(void)
+{
+uint32_t reg;
+int i;
 
-			if (argnr == argc)
-			{
-				eprintf("missing destination address for erase command\n");
-				exit(1);
-			}
-			addr = strtoul(argv[argnr], & s, 0);
-			if (* s)
-			{
-				eprintf("bad destination address for erase command\n");
-				exit(1);
-			}
+	printf("target register file:\n");
+	for (i = 0; i < 16; i ++)
+	{
+		if (libgdb_readreg(ctx, i, &reg))
+		{
+			eprintf("error reading register %i\n", i);
+			job_exit(2);
+		}
+		printf("r%i: 0x%08x, ", i, reg);
+	}
+	/* read xpsr */
+	if (libgdb_readreg(ctx, 16, &reg))
+	{
+		eprintf("error reading xpsr\n");
+		job_exit(2);
+	}
+	printf("xpsr: 0x%08x, ", reg);
+	/* read main stack pointer (msp) */
+	if (libgdb_readreg(ctx, 17, &reg))
+	{
+		eprintf("error reading msp\n");
+		job_exit(2);
+	}
+	printf("msp: 0x%08x, ", reg);
+	/* read process stack pointer (psp) */
+	if (libgdb_readreg(ctx, 18, &reg))
+	{
+		eprintf("error reading psp\n");
+		job_exit(2);
+	}
+	printf("psp: 0x%08x, ", reg);
+	/* read control, primask, faultmask, basepri */
+	if (libgdb_readreg(ctx, 19, &reg))
+	{
+		eprintf("error reading register 20\n");
+		job_exit(2);
+	}
+	printf("control: 0x%08x, ", reg >> 24);
+	printf("faultmask: 0x%08x, ", (reg >> 16) & 255);
+	printf("basepri: 0x%08x, ", (reg >> 8) & 255);
+	printf("primask: 0x%08x, ", (reg >> 0) & 255);
+	printf("\n");
+}
 
-			argnr ++;
-			if (argnr == argc)
-			{
-				eprintf("missing length argument for write command\n");
-				exit(1);
-			}
-			len = strtoul(argv[argnr], & s, 0);
-			if (* s)
-			{
-				eprintf("bad length argument for erase command\n");
-				exit(1);
-			}
-			argnr ++;
+void connect_to_target(void)
+{
+int i, sig;
 
-			connect_to_target();
-			gettimeofday(&tv1, &tz);
-			if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
-			{
-				eprintf("error unlocking target flash, target may need reset\n");
-				return - 1;
-			}
+	if (is_target_connected)
+	{
+		/* the annotation setting may differ between daemon jobs */
+		libgdb_set_annotation(ctx, is_vx_annotation_enabled);
+		return;
+	}
+	if (!(ctx = libgdb_init()))
+	{
+		eprintf("failed to initialize the libgdb library\n");
+		job_exit(1);
+	}
+	/* set here, so that the session is dropped if connecting fails midway */
+	is_target_connected = true;
+	if (is_vx_annotation_enabled)
+		libgdb_set_annotation(ctx, true);
+	if (libgdb_connect(ctx, gdbserver_host, GDBSERVER_PORT))
+	{
+		eprintf("failed to connect to a gdb server\n");
+		job_exit(2);
+	}
 
-			if (pdev->flash_erase_area)
-			{
-				if (pdev->flash_erase_area(pdev, ctx, addr, len))
-				{
-					eprintf("error erasing flash\n");
-					exit(1);
-				}
-			}
-			else
-			{
-				printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
-				if (generic_flash_erase_area(pdev, ctx, addr, len))
-				{
-					eprintf("error erasing flash\n");
-					exit(1);
-				}
-			}
+	libgdb_send_ack(ctx);
+	/* halt the target, unless it is already halted */
+	if ((i = libgdb_attach(ctx, & sig)) == -1)
+	{
+		eprintf("failed to attach to the target\n");
+		job_exit(2);
+	}
+	printf("target %s, halt reason: %s (signal %i)\n", i ? "halted" : "already halted", get_signal_name(sig), sig);
+	if (libgdb_negotiate_packet_size(ctx) == -1)
+		eprintf("warning: failed to negotiate the packet size with the gdbserver, using defaults\n");
+	tune_link(ctx, pdev);
+}
 
-			gettimeofday(&tv2, &tz);
+struct struct_devctl * merge_dev_lists(struct struct_devctl * l1, struct struct_devctl * l2)
+{
+struct struct_devctl * d;
+
+	if (!l1)
+		return l2;
+	if (!l2)
+		return l1;
+	for (d = l1; d->next; d = d-> next);
+	d->next = l2;
+	return l1;
+}
 
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("\n\n\nflash erase speed:\n");
-			dx = ((double) len) / (double) diff;
-			dx *= 1000000.;
-			printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
-			printf("\n\n\n");
+struct struct_devctl * find_device(struct struct_devctl * devs, const char * devname)
+{
+	while (devs && strcmp(devs->name, devname))
+		devs = devs->next;
+	return devs;
+}
 
-		}
-		else if (!strcmp(argv[argnr], "-w"))
-		{
-			/* write to flash */
-			int fd, idx, len;
-			char * s;
-			struct stat stat;
+void drop_session(void)
+{
+	if (is_target_connected)
+	{
+		/* attempt restoring the target settings changed by the opened device, if any */
+		close_device();
+		libgdb_deinit(ctx);
+	}
+	is_target_connected = false;
+	opened_dev = 0;
+}
 
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
+int run_commands(int argc, char ** argv)
+{
+int argnr;
 
-			if (argnr == argc)
+		for (argnr = 1; argnr < argc; )
+		{
+			if (!strcmp(argv[argnr], "--help") || !strcmp(argv[argnr], "-h"))
 			{
-				eprintf("missing destination address for write command\n");
-				exit(1);
+				/* print usage infiormation */
+				printf("usage: %s [--enable-vx-annotation] [--retune] [--stream] [--delta] [--allow-mass-erase] [--double-buffer] [--load-addr addr] [-h|--help] -d device-name [--erase-sector sector-number] [-l] [--regs] [-r addr wordcnt outfile] [-w addr infile] [--erase-area addr len] [-x imagefile] [--verify imagefile] [-t] [-e] [--cont] [--stop]\n", * argv);
+				printf("       %s [--daemon-endpoint endpoint] --daemon\n", * argv);
+				printf("       %s [--daemon-endpoint endpoint] --job [switches...]\n", * argv);
+				job_exit(0);
 			}
-			addr = strtoul(argv[argnr], & s, 0);
-			if (* s)
+			else if (!strcmp(argv[argnr], "--enable-vx-annotation"))
 			{
-				eprintf("bad destination address for write command\n");
-				exit(1);
+				argnr ++;
+				is_vx_annotation_enabled = true;
 			}
-
-			argnr ++;
-			if (argnr == argc)
+			else if (!strcmp(argv[argnr], "--stream"))
 			{
-				eprintf("missing filename for write command\n");
-				exit(1);
+				/* program intel hex files while they are being parsed */
+				argnr ++;
+				is_streaming_enabled = true;
 			}
-			if ((fd = open(argv[argnr], O_RDONLY | O_BINARY)) == -1)
+			else if (!strcmp(argv[argnr], "--delta"))
 			{
-				eprintf("error opening file for reading\n");
-				exit(1);
+				/* only erase and program flash sectors whose contents change */
+				argnr ++;
+				is_delta_enabled = true;
 			}
-			argnr ++;
-			/* obtain file length and allocate buffer memory */
-
-			if (fstat(fd, &stat))
+			else if (!strcmp(argv[argnr], "--allow-mass-erase"))
 			{
-				eprintf("error fstat()-ing input file\n");
-				exit(1);
+				/* let the erase planner mass erase the device when this is faster */
+				argnr ++;
+				is_mass_erase_allowed = true;
 			}
-
-			wordcnt = stat.st_size >> 2;
-
-			if (!(buf = malloc(wordcnt * sizeof(uint32_t))))
+			else if (!strcmp(argv[argnr], "--double-buffer"))
 			{
-				eprintf("cannot allocate buffer memory for reading input file\n");
-				exit(1);
+				/* upload the next chunk of data to the target while the previous one is being programmed
+				 *
+				 * note that this sends memory write ('M') packets while the target
+				 * is running; in all-stop mode, the gdb remote serial protocol
+				 * does not allow this, and only some gdbservers (e.g. the
+				 * black magic probe) service such packets - others may
+				 * reject them, or stall until the target halts */
+				argnr ++;
+				is_double_buffering_enabled = true;
 			}
+			else if (!strcmp(argv[argnr], "--load-addr"))
+			{
+				char * s;
 
-			len = read(fd, buf, wordcnt * sizeof(uint32_t));
-			close(fd);
-			if (len == -1)
+				/* read the image files of subsequent '-x' and '--verify' commands as raw binary files */
+				if (++ argnr == argc)
+				{
+					eprintf("missing address for --load-addr\n");
+					job_exit(1);
+				}
+				load_addr = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad address for --load-addr\n");
+					job_exit(1);
+				}
+				argnr ++;
+				is_load_addr_specified = true;
+			}
+			else if (!strcmp(argv[argnr], "--retune"))
 			{
-				eprintf("error reading input file\n");
-				exit(1);
+				/* measure gdbserver link performance even if cached results are available */
+				argnr ++;
+				must_retune_link = true;
 			}
+			else if (!strcmp(argv[argnr], "--regs"))
+			{
+				argnr ++;
+				connect_to_target();
+				dump_target_regfile();
+				return 0;
 
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
-			if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+			}
+			else if (!strcmp(argv[argnr], "-l"))
 			{
-				eprintf("error unlocking target flash, target may need reset\n");
-				return - 1;
+				/* list devices */
+				argnr ++;
+				list_devices(devs, is_vx_annotation_enabled);
 			}
-
-			if (pdev->flash_erase_area)
+			else if (!strcmp(argv[argnr], "-d"))
 			{
-				if (pdev->flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
+				/* specify device */
+				argnr ++;
+				if (argnr == argc)
 				{
-					eprintf("error erasing flash\n");
-					exit(1);
+					eprintf("missing device name\n");
+					job_exit(1);
 				}
-			}
-			else
-			{
-				printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
-				if (generic_flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
+				devname = argv[argnr ++];
+				if (!(pdev = find_device(devs, devname)))
 				{
-					eprintf("error erasing flash\n");
-					exit(1);
+					eprintf("unknown device name (%s); type '%s -l' to get a list of supported devices\n", devname, * argv);
+					job_exit(1);
 				}
 			}
-			
-			gettimeofday(&tv1, &tz);
-			if (!pdev->flash_program_words)
-			{
-				eprintf("target flash write routine not specified, not performing flash write\n");
-				exit(1);
-			}
-			else if (pdev->flash_program_words(pdev, ctx, addr, buf, wordcnt))
-			{
-				eprintf("error writing flash\n");
-				exit(1);
-			}
-			else
-				printf("flash successfully programmed\n");
-			gettimeofday(&tv2, &tz);
 
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("\n\n\nflash write speed:\n");
-			printf("%i bytes written in %i.%i seconds\n", wordcnt * 4, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
-			dx = ((double) (wordcnt * 4)) / (double) diff;
-			dx *= 1000000.;
-			printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
-			printf("\n\n\n");
 
-			free(buf);
 
-		}
-		else if (!strcmp(argv[argnr], "-x"))
-		{
-			/* write file to flash - file can be in intel hex format,
-			 * or an elf file - in this case it is first converted
-			 * to intel hex format by running objcopy */
-			struct data_mem_area * mem_areas, * s;
-			bool must_unlink;
-			char * hexfile_name;
-
-			uint32_t * wbuf;
-			argnr ++;
-			if (!pdev)
+			else if (!strcmp(argv[argnr], "--hack-test"))
 			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
+				/* perform hack tests */
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+				if (!pdev->ram_areas)
+				{
+					eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
+					job_exit(1);
+				}
+				connect_to_target();
+				if (libgdb_readwords(ctx, 0x400fc080, 3, (uint32_t[3]){}))
+					printf("hack tests failed!!!\n");
+				else
+					printf("hack tests succeeded\n");
+
 
-			if (argnr == argc)
-			{
-				eprintf("missing filename for file write command\n");
-				exit(1);
 			}
-			if (get_hex_fname(argv[argnr ++], &hexfile_name, & must_unlink) == -1)
+
+
+
+			else if (!strcmp(argv[argnr], "--hack"))
 			{
-				eprintf("failed to obtain an ihex-formatted file to load into target\n");
-				exit(1);
+				uint32_t x[3];
+
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+				if (!pdev->ram_areas)
+				{
+					eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
+					job_exit(1);
+				}
+				connect_to_target();
+				if (libgdb_readwords(ctx, 0x20000000 + 0x1ff4, 3, x))
+				{
+					printf("error\n");
+					job_exit(1);
+				}
+				printf("0x%x 0x%x 0x%x\n", 0[x], 1[x], 2[x]);
+				job_exit(1);
+
 			}
 
-			mem_areas = hexfile_read(hexfile_name);
-			if (!mem_areas)
+
+			else if (!strcmp(argv[argnr], "-t"))
 			{
-				eprintf("error reading hex file\n");
-				exit(1);
-			}
+				struct bench_options opts;
+				const struct struct_memarea * scratch;
+
+				/* run the link benchmark suite - memory read/write speed,
+				 * register access and target routine call latencies */
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+				/* the scratch area size is checked by bench_run() */
+				if (!(scratch = bench_get_scratch_area(pdev)))
+				{
+					eprintf("device does not have ram areas defined, unable to perform memory read/write speed tests, aborting\n");
+					job_exit(1);
+				}
+				bench_init_options(& opts);
+				opts.scratch_addr = scratch->start;
+				opts.scratch_len = scratch->len;
+
+				connect_to_target();
 
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
-			for (s = mem_areas; s; s = s->next)
+				if (bench_run(ctx, pdev, & opts))
+				{
+					eprintf("error running benchmarks\n");
+					job_exit(2);
+				}
+			}
+			else if (!strcmp(argv[argnr], "-e"))
 			{
-				int memtype;
-				int wlen;
-				printf("start: 0x%08x\tlen: 0x%08x\n", s->addr, s->len);
-				memtype = get_mem_type(pdev, ctx, s->addr, s->len);
+				/* mass erase device */
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+				connect_to_target();
+				if (open_device(pdev, ctx))
+					job_exit(1);
+				/*! \todo	properly unlock flash here */
 
-				wlen = s->len / sizeof(uint32_t);
+				if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+				{
+					eprintf("error unlocking target flash, target may need reset\n");
+					job_exit(1);
+				}
+				/*
 
-				if (memtype == MEM_TYPE_INVALID)
+				if (pdev->flash_erase_area)
 				{
-					eprintf("invalid memory area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
-					exit(1);
+					if (pdev->flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
+					{
+						eprintf("error erasing flash\n");
+						job_exit(1);
+					}
 				}
-				else if (memtype == MEM_TYPE_FLASH)
+				else
 				{
-					if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+					printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
+					if (generic_flash_erase_area(pdev, ctx, addr, wordcnt * sizeof(uint32_t)))
 					{
-						eprintf("error unlocking target flash, target may need reset\n");
-						return - 1;
+						eprintf("error erasing flash\n");
+						job_exit(1);
 					}
-					if (pdev->flash_erase_area)
+				}
+				*/
+
+				if (pdev->flash_mass_erase)
+				{
+					if (pdev->flash_mass_erase(pdev, ctx))
 					{
-						if (pdev->flash_erase_area(pdev, ctx, s->addr, s->len))
-						{
-							eprintf("error erasing flash\n");
-							exit(1);
-						}
+						eprintf("error mass erasing target flash, target may need reset\n");
+						job_exit(1);
 					}
-					else
+				}
+				else if (pdev->flash_erase_sector)
+				{
+					printf("flash_mass_erase() routine unavailable, invoking generic flash erase area routine\n");
+					for (i = 0; pdev->flash_areas[i].len; i ++)
 					{
-						printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
-						if (generic_flash_erase_area(pdev, ctx, s->addr, s->len))
+						if (generic_flash_erase_area(pdev, ctx, pdev->flash_areas[i].start, pdev->flash_areas[i].len))
 						{
 							eprintf("error erasing flash\n");
-							exit(1);
+							job_exit(1);
 						}
 					}
-					if (!pdev->flash_program_words)
+				}
+				else
+				{
+					eprintf("neither mass erase, nor erase sector routines specified\n");
+					eprintf("aborting mass erase request\n");
+					job_exit(1);
+				}
+				printf("ok, chip successfully mass erased\n");
+			}
+			else if (!strcmp(argv[argnr], "--cont"))
+			{
+				argnr ++;
+				connect_to_target();
+				/* let the target resume with its own settings */
+				if (close_device())
+					job_exit(1);
+				/* the target may change its ram once resumed */
+				libgdb_invalidate_resident_code(ctx);
+				libgdb_sendpacket(ctx, "c");
+				/* the session is only kept while the target is halted - the
+				 * next job connects anew, halting the target again */
+				drop_session();
+				return 0;
+			}
+			else if (!strcmp(argv[argnr], "--stop") || !strcmp(argv[argnr], "--halt"))
+			{
+
+				argnr ++;
+				/* connecting to the target halts it; a session kept by the
+				 * daemon is only kept while the target is halted */
+				connect_to_target();
+				return 0;
+			}
+			else if (!strcmp(argv[argnr], "--erase-area"))
+			{
+				/* write to flash */
+				int len;
+				char * s;
+
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+				connect_to_target();
+				if (open_device(pdev, ctx))
+					job_exit(1);
+
+				if (argnr == argc)
+				{
+					eprintf("missing destination address for erase command\n");
+					job_exit(1);
+				}
+				addr = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad destination address for erase command\n");
+					job_exit(1);
+				}
+
+				argnr ++;
+				if (argnr == argc)
+				{
+					eprintf("missing length argument for write command\n");
+					job_exit(1);
+				}
+				len = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad length argument for erase command\n");
+					job_exit(1);
+				}
+				argnr ++;
+
+				connect_to_target();
+				gettimeofday(&tv1, &tz);
+				if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+				{
+					eprintf("error unlocking target flash, target may need reset\n");
+					job_exit(1);
+				}
+
+				if (pdev->flash_erase_area)
+				{
+					if (pdev->flash_erase_area(pdev, ctx, addr, len))
 					{
-						eprintf("target flash write routine not specified, not performing flash write\n");
-						exit(1);
+						eprintf("error erasing flash\n");
+						job_exit(1);
 					}
-					else if (pdev->flash_program_words(pdev, ctx, s->addr, (uint32_t *) s->data, wlen))
+				}
+				else
+				{
+					printf("flash_erase_area() routine unavailable, invoking generic flash erase area routine\n");
+					if (generic_flash_erase_area(pdev, ctx, addr, len))
 					{
-						eprintf("error writing flash area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
-						exit(1);
+						eprintf("error erasing flash\n");
+						job_exit(1);
 					}
-					else
-						printf("flash area successfully programmed\n");
 				}
-				else if (memtype == MEM_TYPE_RAM)
+
+				gettimeofday(&tv2, &tz);
+
+				diff = tv2.tv_sec - tv1.tv_sec;
+				diff *= 1000000;
+				diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
+				printf("\n\n\nflash erase speed:\n");
+				dx = ((double) len) / (double) diff;
+				dx *= 1000000.;
+				printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
+				printf("\n\n\n");
+
+			}
+			else if (!strcmp(argv[argnr], "-w"))
+			{
+				/* write to flash */
+				struct filemap * fmap;
+				struct erase_plan plan;
+				uint32_t len, x;
+				char * s;
+
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+
+				if (argnr == argc)
+				{
+					eprintf("missing destination address for write command\n");
+					job_exit(1);
+				}
+				addr = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad destination address for write command\n");
+					job_exit(1);
+				}
+
+				argnr ++;
+				if (argnr == argc)
+				{
+					eprintf("missing filename for write command\n");
+					job_exit(1);
+				}
+				if (is_delta_enabled)
 				{
-					if (libgdb_writewords(ctx, s->addr, wlen, s->data))
+					/* only erase and program the flash sectors that change */
+					struct memimage * image;
+
+					if (!(image = binfile_read(argv[argnr ++], addr)))
+						job_exit(1);
+					job_hold(release_memimage, image);
+					connect_to_target();
+					if (open_device(pdev, ctx))
+						job_exit(1);
+					if (get_mem_type(pdev, ctx, image->areas->addr, image->areas->len) != MEM_TYPE_FLASH)
 					{
-						eprintf("error writing ram area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
-						exit(1);
+						eprintf("invalid flash area: start 0x%08x, size 0x%08x, aborting\n", image->areas->addr, image->areas->len);
+						job_exit(1);
 					}
+					if (program_flash_delta(pdev, ctx, image))
+						job_exit(1);
+					job_release(image);
+					continue;
 				}
-				else /* should never happen */
+				/* the file is mapped, and handed to the flash programming
+				 * routine in chunks - file pages are only read in as the
+				 * programming progresses */
+				if (!(fmap = filemap_open(argv[argnr])))
 				{
-					eprintf("bad memory area type: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
-					exit(1);
+					eprintf("error opening file for reading\n");
+					job_exit(1);
 				}
-				/* read back the memory area and verify it */
-				wbuf = (uint32_t *) malloc(wlen * sizeof * wbuf);
-				if (!wbuf)
+				job_hold(release_filemap, fmap);
+				argnr ++;
+				len = fmap->len;
+
+				connect_to_target();
+				if (open_device(pdev, ctx))
+					job_exit(1);
+				if (erase_plan_init(pdev, & plan))
+					job_exit(1);
+				if (erase_plan_add(pdev, & plan, addr, len))
 				{
-					eprintf("out of core\n");
-					exit(1);
+					free(plan.is_sector_erased);
+					job_exit(1);
 				}
-				if (!memcmp(wbuf, s->data, wlen * sizeof * wbuf))
+				if (erase_plan_run(pdev, ctx, & plan))
+					job_exit(1);
+			
+				gettimeofday(&tv1, &tz);
+				if (!pdev->flash_program_words)
 				{
-					eprintf("verification failed, memory read and written mismatch\n");
-					exit(1);
+					eprintf("target flash write routine not specified, not performing flash write\n");
+					job_exit(1);
+				}
+				/* a trailing partial word is padded into the last chunk by program_flash_bytes() */
+				for (i = 0; i < len; i += x)
+				{
+					x = len - i;
+					if (x > FILE_XFER_CHUNK_SIZE)
+						x = FILE_XFER_CHUNK_SIZE;
+					if (program_flash_bytes(pdev, ctx, addr + i, (uint8_t *) fmap->base + i, x))
+					{
+						eprintf("error writing flash\n");
+						job_exit(1);
+					}
+				}
+				printf("flash successfully programmed\n");
+				gettimeofday(&tv2, &tz);
+
+				diff = tv2.tv_sec - tv1.tv_sec;
+				diff *= 1000000;
+				diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
+				printf("\n\n\nflash write speed:\n");
+				printf("%i bytes written in %i.%i seconds\n", len, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
+				dx = ((double) len) / (double) diff;
+				dx *= 1000000.;
+				printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
+				printf("\n\n\n");
+
+				job_release(fmap);
+
+			}
+			else if (!strcmp(argv[argnr], "-x"))
+			{
+				/* write file to flash - file can be in intel hex format,
+				 * or an elf file; the file is loaded while connecting to
+				 * the target and opening the device, both of which can
+				 * take many round trips; if streaming is enabled, intel
+				 * hex files are programmed while they are being parsed */
+				struct memimage * image, * runs;
+				struct data_mem_area * s;
+				struct image_load load;
+				struct image_stream * stream;
+				struct erase_plan plan;
+				int res;
+
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
 				}
-				free(wbuf);
-			}
-			if (0) if (must_unlink)
-				unlink(hexfile_name);
-			free(hexfile_name);
-			hexfile_dealloc(mem_areas);
-		}
-		else if (!strcmp(argv[argnr], "--erase-sector"))
-		{
-			/* erase sector */
-			char * s;
-			static volatile int xxx = 0;
 
-			while (xxx == 1);
+				if (argnr == argc)
+				{
+					eprintf("missing filename for file write command\n");
+					job_exit(1);
+				}
+				if (is_streaming_enabled && !is_delta_enabled && !is_load_addr_specified && get_image_file_format(argv[argnr]) == IMAGE_FORMAT_IHEX)
+				{
+					if (!(stream = image_stream_open(argv[argnr ++])))
+						job_exit(1);
+					job_hold(release_image_stream, stream);
+					connect_to_target();
+					res = open_device(pdev, ctx);
+					if (!res)
+						res = stream_image_to_target(pdev, ctx, stream);
+					job_unhold(stream);
+					if (image_stream_close(stream) || res)
+					{
+						eprintf("error streaming image file to the target\n");
+						job_exit(1);
+					}
+					continue;
+				}
+				if (image_load_start(& load, argv[argnr ++]) == -1)
+					job_exit(1);
+				/* connecting to the target may fail, the image load must be joined then */
+				job_hold(release_image_load, & load);
+
+				connect_to_target();
+				res = open_device(pdev, ctx);
+				job_unhold(& load);
+				if (image_load_finish(& load) == -1)
+				{
+					memimage_destroy(load.image);
+					job_exit(1);
+				}
+				image = load.image;
+				job_hold(release_memimage, image);
+				if (res)
+					job_exit(1);
+				/* validate the image areas, and erase all flash sectors
+				 * that the image is programmed to in advance */
+				if (erase_plan_init(pdev, & plan))
+					job_exit(1);
+				for (s = image->areas; s; s = s->next)
+				{
+					int memtype;
 
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
+					memtype = get_mem_type(pdev, ctx, s->addr, s->len);
+					if (memtype == MEM_TYPE_INVALID)
+						eprintf("invalid memory area: start 0x%08x, size 0x%08x, aborting\n", s->addr, s->len);
+					if (memtype == MEM_TYPE_INVALID
+							|| (memtype == MEM_TYPE_FLASH && erase_plan_add(pdev, & plan, s->addr, s->len)))
+					{
+						free(plan.is_sector_erased);
+						job_exit(1);
+					}
+				}
+				if (is_delta_enabled)
+					/* flash sectors are erased as needed by program_flash_delta() */
+					free(plan.is_sector_erased);
+				else if (erase_plan_run(pdev, ctx, & plan))
+					job_exit(1);
+				/* the coalesced image refers to the original image data */
+				if (!(runs = coalesce_flash_areas(pdev, ctx, image)))
+					job_exit(1);
+				job_hold(release_memimage, runs);
+				/* program the flash areas first - the flash programming
+				 * routines use target ram, and would destroy any ram
+				 * areas of the image already written */
+				for (s = runs->areas; s; s = s->next)
+				{
+					if (get_mem_type(pdev, ctx, s->addr, s->len) != MEM_TYPE_FLASH)
+						continue;
+					printf("start: 0x%08x\tlen: 0x%08x\n", s->addr, s->len);
+					if (is_delta_enabled)
+						/* flash areas are programmed below */
+						continue;
+					if (program_mem_area(pdev, ctx, s, MEM_TYPE_FLASH))
+						job_exit(1);
+					printf("flash area successfully programmed\n");
+					/* read back the memory area and verify it */
+					if (verify_mem_area(ctx, s))
+						job_exit(1);
+				}
+				if (is_delta_enabled && program_flash_delta(pdev, ctx, runs))
+					job_exit(1);
+				/* now write the ram areas */
+				for (s = runs->areas; s; s = s->next)
+				{
+					int memtype;
+
+					if ((memtype = get_mem_type(pdev, ctx, s->addr, s->len)) == MEM_TYPE_FLASH)
+						continue;
+					printf("start: 0x%08x\tlen: 0x%08x\n", s->addr, s->len);
+					if (program_mem_area(pdev, ctx, s, memtype))
+						job_exit(1);
+					/* read back the memory area and verify it */
+					if (verify_mem_area(ctx, s))
+						job_exit(1);
+				}
+				job_release(runs);
+				job_release(image);
 			}
-
-
-			if (argnr == argc)
+			else if (!strcmp(argv[argnr], "--verify"))
 			{
-				eprintf("missing sector number for erase command\n");
-				exit(1);
+				/* verify target memory against a file - the file formats
+				 * accepted are the same as for the '-x' command */
+				struct memimage * image;
+				struct data_mem_area * s;
+
+				argnr ++;
+				if (argnr == argc)
+				{
+					eprintf("missing filename for verify command\n");
+					job_exit(1);
+				}
+				if (!(image = load_image_file(argv[argnr ++])))
+				{
+					eprintf("failed to read the file to verify target memory against\n");
+					job_exit(1);
+				}
+				job_hold(release_memimage, image);
+				connect_to_target();
+				for (s = image->areas; s; s = s->next)
+					if (verify_mem_area(ctx, s))
+						job_exit(1);
+				printf("verification successful\n");
+				job_release(image);
 			}
-			addr = strtoul(argv[argnr], & s, 0);
-			if (* s)
+			else if (!strcmp(argv[argnr], "--erase-sector"))
 			{
-				eprintf("bad source address for write command\n");
-				exit(1);
-			}
+				/* erase sector */
+				char * s;
+				static volatile int xxx = 0;
 
-			argnr ++;
+				while (xxx == 1);
 
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
 
-			gettimeofday(&tv1, &tz);
-			/*! \todo	properly unlock flash here */
-			if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
-			{
-				eprintf("error unlocking target flash, target may need reset\n");
-				return - 1;
-			}
-			if (!pdev->flash_erase_sector)
-			{
-				eprintf("flash sector erase routine unavailable, aborting\n");
-				exit(1);
-			}
-			else if (pdev->flash_erase_sector(pdev, ctx, addr))
-			{
-				eprintf("error erasing flash sector %i\n", addr);
-				exit(1);
-			}
 
-			gettimeofday(&tv2, &tz);
+				if (argnr == argc)
+				{
+					eprintf("missing sector number for erase command\n");
+					job_exit(1);
+				}
+				addr = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad source address for write command\n");
+					job_exit(1);
+				}
 
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("sector erased in %i.%i seconds\n", (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
-			printf("\n\n");
+				argnr ++;
 
-		}
-		else if (!strcmp(argv[argnr], "-r"))
-		{
-			/* read memory */
-			int fd, idx, len;
-			char * s;
-			struct stat stat;
+				connect_to_target();
+				if (open_device(pdev, ctx))
+					job_exit(1);
 
-			argnr ++;
-			if (!pdev)
-			{
-				eprintf("device not specified, use the '-d' switch to specify a target device\n");
-				exit(1);
-			}
+				gettimeofday(&tv1, &tz);
+				/*! \todo	properly unlock flash here */
+				if (pdev->flash_unlock_area && pdev->flash_unlock_area(pdev, ctx, 0))
+				{
+					eprintf("error unlocking target flash, target may need reset\n");
+					job_exit(1);
+				}
+				if (!pdev->flash_erase_sector)
+				{
+					eprintf("flash sector erase routine unavailable, aborting\n");
+					job_exit(1);
+				}
+				else if (pdev->flash_erase_sector(pdev, ctx, addr) || wait_flash_idle(pdev, ctx))
+				{
+					eprintf("error erasing flash sector %i\n", addr);
+					job_exit(1);
+				}
 
-			if (argnr == argc)
-			{
-				eprintf("missing source address for read command\n");
-				exit(1);
-			}
-			addr = strtoul(argv[argnr], & s, 0);
-			if (* s)
-			{
-				eprintf("bad source address for read command (%s)\n", argv[argnr]);
-				exit(1);
-			}
+				gettimeofday(&tv2, &tz);
 
-			argnr ++;
+				diff = tv2.tv_sec - tv1.tv_sec;
+				diff *= 1000000;
+				diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
+				printf("sector erased in %i.%i seconds\n", (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
+				printf("\n\n");
 
-			if (argnr == argc)
-			{
-				eprintf("missing word count for read command\n");
-				exit(1);
 			}
-			wordcnt = strtoul(argv[argnr], & s, 0);
-			if (* s)
+			else if (!strcmp(argv[argnr], "-r"))
 			{
-				eprintf("bad word count for read command\n");
-				exit(1);
-			}
+				/* read memory */
+				struct filemap * fmap;
+				uint32_t len, x;
+				char * s;
 
-			argnr ++;
-			if (argnr == argc)
-			{
-				eprintf("missing filename for read command\n");
-				exit(1);
-			}
-			if ((fd = open(argv[argnr], O_CREAT | O_BINARY | O_TRUNC | O_RDWR, 0666)) == -1)
-			{
-				eprintf("error opening file for writing\n");
-				exit(1);
-			}
-			argnr ++;
-			/* allocate buffer memory */
-			if (!(buf = malloc(wordcnt * sizeof(uint32_t))))
-			{
-				eprintf("cannot allocate buffer memory for reading input file\n");
-				exit(1);
-			}
+				argnr ++;
+				if (!pdev)
+				{
+					eprintf("device not specified, use the '-d' switch to specify a target device\n");
+					job_exit(1);
+				}
+
+				if (argnr == argc)
+				{
+					eprintf("missing source address for read command\n");
+					job_exit(1);
+				}
+				addr = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad source address for read command (%s)\n", argv[argnr]);
+					job_exit(1);
+				}
+
+				argnr ++;
+
+				if (argnr == argc)
+				{
+					eprintf("missing word count for read command\n");
+					job_exit(1);
+				}
+				wordcnt = strtoul(argv[argnr], & s, 0);
+				if (* s)
+				{
+					eprintf("bad word count for read command\n");
+					job_exit(1);
+				}
+
+				argnr ++;
+				if (argnr == argc)
+				{
+					eprintf("missing filename for read command\n");
+					job_exit(1);
+				}
+				/* the target memory is read directly into the mapped output
+				 * file, in chunks - the host operating system writes the
+				 * data read to the file while later chunks are still being
+				 * transferred */
+				len = wordcnt * sizeof(uint32_t);
+				if (!(fmap = filemap_create(argv[argnr], len)))
+				{
+					eprintf("error opening file for writing\n");
+					job_exit(1);
+				}
+				job_hold(release_filemap, fmap);
+				argnr ++;
+
+				connect_to_target();
+				if (open_device(pdev, ctx))
+					job_exit(1);
+				gettimeofday(&tv1, &tz);
+				for (i = 0; i < len; i += x)
+				{
+					x = len - i;
+					if (x > FILE_XFER_CHUNK_SIZE)
+						x = FILE_XFER_CHUNK_SIZE;
+					if (libgdb_readmem(ctx, addr + i, x, (uint8_t *) fmap->base + i))
+					{
+						eprintf("error reading target memory\n");
+						job_exit(1);
+					}
+				}
+				gettimeofday(&tv2, &tz);
+
+				diff = tv2.tv_sec - tv1.tv_sec;
+				diff *= 1000000;
+				diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
+				printf("\n\n\nmemory read speed:\n");
+				printf("%i bytes read in %i.%i seconds\n", len, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
+				dx = ((double) len) / (double) diff;
+				dx *= 1000000.;
+				printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
+				printf("\n\n\n");
+
+				job_unhold(fmap);
+				if (filemap_close(fmap))
+				{
+					eprintf("error writing output file\n");
+					job_exit(1);
+				}
+				printf("ok\n");
 
-			connect_to_target();
-			if (open_device(pdev, ctx))
-				exit(1);
-			gettimeofday(&tv1, &tz);
-			if (libgdb_readwords(ctx, addr, wordcnt, buf))
-			{
-				eprintf("error reading target memory\n");
-				exit(1);
 			}
-			gettimeofday(&tv2, &tz);
-
-			diff = tv2.tv_sec - tv1.tv_sec;
-			diff *= 1000000;
-			diff += (int) tv2.tv_usec - (int) tv1.tv_usec;
-			printf("\n\n\nmemory read speed:\n");
-			printf("%i bytes read in %i.%i seconds\n", wordcnt * 4, (diff + 5000) / 1000000, ((diff + 5000) % 1000000) / 10000);
-			dx = ((double) (wordcnt * 4)) / (double) diff;
-			dx *= 1000000.;
-			printf("average speed: %i.%i bytes/second\n", (int)(dx), (int)((fmod(dx, 1.)) * 100.));
-			printf("\n\n\n");
-
-			len = write(fd, buf, wordcnt * sizeof(uint32_t));
-			if (len == -1)
+			else
 			{
-				eprintf("error writing output file, error %i (%s)\n", errno, strerror(errno));
-				exit(1);
+				/* attempt to parse a target specific command line option */
+				if (!pdev)
+				{
+					eprintf("command line option %s not recognized, and no target specified\n", argv[argnr]);
+					eprintf("if you intended to specify a target specific command line option, "
+							"you must first specify the target with '-d device'\n");
+					job_exit(1);
+				}
+				if (fill_in_cmdline_option(pdev, argv[argnr]))
+					job_exit(1);
+				argnr ++;
 			}
-			printf("ok\n");
 
-			free(buf);
-			close(fd);
+		}
+
+	return 0;
+}
+
+int serve_jobs(const char * endpoint)
+{
+int listen_sock, job_sock, job_argc, status, saved_stdout, saved_stderr;
+char * cwd, ** job_argv;
+FILE * output;
+jmp_buf jmpbuf;
+
+	if ((listen_sock = daemon_listen(endpoint)) == -1)
+		return -1;
+	printf("scribe daemon listening on %s\n", endpoint);
+	fflush(stdout);
+	while (1)
+	{
+		if (daemon_recv_job(listen_sock, & job_sock, & cwd, & job_argc, & job_argv))
+			continue;
+		/* capture the job output, to be sent to the client when the job completes */
+		fflush(stdout);
+		fflush(stderr);
+		saved_stdout = saved_stderr = -1;
+		if (!(output = tmpfile()) || (saved_stdout = dup(1)) == -1 || (saved_stderr = dup(2)) == -1)
+		{
+			eprintf("error redirecting job output\n");
+			if (saved_stdout != -1)
+				close(saved_stdout);
+			if (output)
+				fclose(output);
+			daemon_finish_job(job_sock, 0, 2);
+			free(cwd);
+			continue;
+		}
+		dup2(fileno(output), 1);
+		dup2(fileno(output), 2);
 
+		if (chdir(cwd))
+		{
+			eprintf("error changing to directory %s\n", cwd);
+			status = 1;
 		}
 		else
 		{
-			/* attempt to parse a target specific command line option */
-			if (!pdev)
-			{
-				eprintf("command line option %s not recognized, and no target specified\n", argv[argnr]);
-				eprintf("if you intended to specify a target specific command line option, "
-						"you must first specify the target with '-d device'\n");
-				exit(1);
-			}
-			if (fill_in_cmdline_option(pdev, argv[argnr]))
-				exit(1);
-			argnr ++;
+			/* the device and the options are specified anew by each job,
+			 * the gdbserver session and the opened device are kept */
+			devname = 0;
+			pdev = 0;
+			is_vx_annotation_enabled = false;
+			must_retune_link = false;
+			is_streaming_enabled = false;
+			is_load_addr_specified = false;
+			is_delta_enabled = false;
+			is_mass_erase_allowed = false;
+			is_double_buffering_enabled = false;
+			/* device specific options are not inherited from previous jobs */
+			clear_device_cmdline_options(devs);
+			job_jmpbuf = & jmpbuf;
+			if (!(status = setjmp(jmpbuf)))
+				status = run_commands(job_argc, job_argv);
+			else
+				status --;
+			job_jmpbuf = 0;
 		}
 
+		fflush(stdout);
+		fflush(stderr);
+		dup2(saved_stdout, 1);
+		dup2(saved_stderr, 2);
+		close(saved_stdout);
+		close(saved_stderr);
+		if (status)
+			/* the target state is unknown after a failed job - start
+			 * a new gdbserver session for the next job */
+			drop_session();
+		daemon_finish_job(job_sock, output, status);
+		fclose(output);
+		printf("job finished, status %i\n", status);
+		fflush(stdout);
+		free(cwd);
 	}
-
 	return 0;
 }
 
+	if (0) test_objcopy("c:/shopov/src/vxgen0/vxgen0.elf", "c:/shopov/vx.hex");
+
+	/* build a list of supported devices */
+	devs = 0;
+	devs = merge_dev_lists(devs, stm32f10x_get_devs());
+	devs = merge_dev_lists(devs, stm32f4x_get_devs());
+	devs = merge_dev_lists(devs, stm32f0x_get_devs());
+	devs = merge_dev_lists(devs, lpc17xx_get_devs());
+	is_target_connected = false;
+	is_vx_annotation_enabled = false;
+	must_retune_link = false;
+	is_streaming_enabled = false;
+	is_load_addr_specified = false;
+	is_delta_enabled = false;
+	is_mass_erase_allowed = false;
+	is_double_buffering_enabled = false;
+
+	devname = 0;
+	pdev = 0;
+
+	/* check for the daemon mode switches - these must precede any other switches */
+	endpoint = DAEMON_DEFAULT_ENDPOINT;
+	argnr = 1;
+	if (argnr + 1 < argc && !strcmp(argv[argnr], "--daemon-endpoint"))
+		endpoint = argv[argnr + 1], argnr += 2;
+	if (argnr < argc && !strcmp(argv[argnr], "--daemon"))
+		/* keep the gdbserver session open, and run jobs submitted by clients */
+		return serve_jobs(endpoint) ? 1 : 0;
+	if (argnr < argc && !strcmp(argv[argnr], "--job"))
+	{
+		/* submit the rest of the command line as a job to a running daemon */
+		argv[argnr] = argv[0];
+		i = daemon_submit_job(endpoint, argc - argnr, argv + argnr);
+		return (i == -1) ? 2 : i;
+	}
+
+	i = run_commands(argc, argv);
+	/* restore the target settings changed by the opened device, if any */
+	if (close_device())
+		i = 1;
+	return i;
+}
@@ -79,9 +79,11 @@ volatile uint16_t * hwd, * hws;
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/time.h>
 
 #include "devices.h"
 #include "devctl.h"
+#include "ramplan.h"
 
 
 static int stm32f0x_dev_open(struct struct_devctl * dev, struct libgdb_ctx * ctx);
@@ -154,6 +156,14 @@ enum
 
 };
 
+enum
+{
+	/*! flash operation timeouts, in microseconds; these are well
+	 * above the maximum erase times in the device datasheet */
+	SECTOR_ERASE_TIMEOUT_USEC	= 1000000,
+	MASS_ERASE_TIMEOUT_USEC	= 1000000,
+};
+
 static struct struct_devctl stm32f0x_devs[NR_SUPPORTED_DEVICES] =
 {
 	{
@@ -202,12 +212,13 @@ static struct struct_devctl stm32f0x_devs[NR_SUPPORTED_DEVICES] =
 		.flash_erase_sector = stm32f0x_flash_erase_sector,
 		.flash_mass_erase = stm32f0x_flash_mass_erase,
 		.flash_program_words = stm32f0x_flash_program_words,
+		.sector_erase_usec = 20000,
+		.sector_erase_usec_per_kb = 0,
+		.mass_erase_usec = 20000,
 		.validate_cmdline_options = 0,
 		.pdev = &(struct pdev)
 			{
-				.code_load_addr = 0x20000000,
-				.write_buf_addr = 0x20000000 + 0x100,
-				.write_buf_size = 4000,
+				/* the other fields are computed by ramplan_layout() */
 				.stack_size = 0x200,
 		       	},
 	},
@@ -449,13 +460,8 @@ uint32_t x;
 		eprintf("%s(): target flash is locked, aborting mass erase operation\n", __func__);
 		return -1;
 	}
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, 0, SECTOR_ERASE_TIMEOUT_USEC, & x))
+		return -1;
 	if (check_error_flags(x))
 	{
 		printf("target flash errors detected, attempting flash error recovery\n");
@@ -472,15 +478,8 @@ uint32_t x;
 		return -1;
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = MER | STRT, }))
 		return -1;
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		if (check_error_flags(x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, dev->mass_erase_usec, MASS_ERASE_TIMEOUT_USEC, & x) || check_error_flags(x))
+		return -1;
 	return 0;
 }
 
@@ -496,16 +495,8 @@ uint32_t x;
 		return -1;
 	}
 
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		/* check error flags */
-		if (check_error_flags(x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, 0, SECTOR_ERASE_TIMEOUT_USEC, & x) || check_error_flags(x))
+		return -1;
 	printf("erasing flash sector %i...\n", sector_nr);
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = PER, }))
 		return -1;
@@ -513,16 +504,9 @@ uint32_t x;
 		return -1;
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = PER | STRT, }))
 		return -1;
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		/* check error flags */
-		if (check_error_flags(x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, dev->sector_erase_usec + dev->sector_erase_usec_per_kb,
+				SECTOR_ERASE_TIMEOUT_USEC, & x) || check_error_flags(x))
+		return -1;
 
 	return 0;
 
@@ -544,19 +528,27 @@ struct pdev * pdev;
 	}
 
 	pdev = (struct pdev *) dev->pdev;
+	/* place the flash write routine, the write buffer and the stack in target ram */
+	if (ramplan_layout(dev->ram_areas, sizeof stm32f0x_flash_write_routine, false, pdev))
+		return -1;
 
 	is_annotation_enabled = libgdb_set_annotation(ctx, false);
 	total = wordcnt * sizeof(uint32_t);
 	cur = 0;
-	/* load the flash write routine */
-	if (libgdb_writewords(ctx,
-				pdev->code_load_addr,
-				sizeof stm32f0x_flash_write_routine >> 2,
-				(uint32_t *) stm32f0x_flash_write_routine))
+	/* load the flash write routine, unless it is still resident in
+	 * target ram from a previous call */
+	if (!libgdb_is_code_resident(ctx, pdev->code_load_addr, sizeof stm32f0x_flash_write_routine, stm32f0x_flash_write_routine))
 	{
-		eprintf("error loading flash writing routine into target\n");
-		libgdb_set_annotation(ctx, is_annotation_enabled);
-		return - 1;
+		if (libgdb_writewords(ctx,
+					pdev->code_load_addr,
+					sizeof stm32f0x_flash_write_routine >> 2,
+					(uint32_t *) stm32f0x_flash_write_routine))
+		{
+			eprintf("error loading flash writing routine into target\n");
+			libgdb_set_annotation(ctx, is_annotation_enabled);
+			return - 1;
+		}
+		libgdb_set_resident_code(ctx, pdev->code_load_addr, sizeof stm32f0x_flash_write_routine, stm32f0x_flash_write_routine);
 	}
 
 	idx = 0;
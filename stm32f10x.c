@@ -76,14 +76,19 @@ uint16_t * hws, * hwd;
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/time.h>
 
 #include "devices.h"
 #include "devctl.h"
+#include "ramplan.h"
 
 
+static int stm32f10x_dev_open(struct struct_devctl * dev, struct libgdb_ctx * ctx);
+static int stm32f10x_dev_close(struct struct_devctl * dev, struct libgdb_ctx * ctx);
 static int stm32f10x_flash_unlock_area(struct struct_devctl * dev, struct libgdb_ctx * ctx, const struct struct_memarea * area);
 static int stm32f10x_flash_mass_erase(struct struct_devctl * dev, struct libgdb_ctx * ctx);
 static int stm32f10x_flash_program_words(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t dest, uint32_t * src, int wordcnt);
+static int stm32f10x_flash_wait_idle(struct struct_devctl * dev, struct libgdb_ctx * ctx);
 static int stm32f10x_flash_erase_sector(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t sector_nr);
 
 enum
@@ -109,15 +114,63 @@ enum
 	MER	= 1 << 2,
 	PER	= 1 << 1,
 	LOCK	= 1 << 7,
+
+	/* bits in the flash access control register */
+	PRFTBE	= 1 << 4,
+
+	/* reset and clock control (rcc) registers */
+	RCC_BASE	= 0x40021000,
+	/* rcc clock control register */
+	RCC_CR		= RCC_BASE + 0,
+	/* bits in the rcc clock control register */
+	PLLRDY	= 1 << 25,
+	PLLON	= 1 << 24,
+	/* rcc clock configuration register */
+	RCC_CFGR	= RCC_BASE + 4,
+	/* fields in the rcc clock configuration register */
+	PLLMUL	= 15 << 18,
+	PLLXTPRE	= 1 << 17,
+	PLLSRC	= 1 << 16,
+	PPRE2	= 7 << 11,
+	PPRE1	= 7 << 8,
+	HPRE	= 15 << 4,
+	SWS	= 3 << 2,
+	SW	= 3 << 0,
+	SW_HSI	= 0,
+	SW_PLL	= 2,
+
+	/* the programming clock profile - half the 8 MHz internal rc
+	 * oscillator (hsi) frequency drives the pll: 8 MHz / 2 * 6 = 24 MHz
+	 * core and bus clocks, the maximum for the value line devices, which
+	 * need no flash wait states */
+	BOOST_PLLMUL	= (6 - 2) << 18,
+	BOOST_FACR	= PRFTBE | 0,
+
+	/* index of the clock boost option in the 'cmdline_options' table below */
+	CLOCK_BOOST_PARAM_IDX	= 0,
 };
 
 
+enum
+{
+	/*! flash operation timeouts, in microseconds; these are well
+	 * above the maximum erase times in the device datasheet */
+	SECTOR_ERASE_TIMEOUT_USEC	= 1000000,
+	MASS_ERASE_TIMEOUT_USEC	= 1000000,
+	/*! pll lock and system clock switch timeout, in microseconds */
+	CLOCK_SWITCH_TIMEOUT_USEC	= 100000,
+};
+
 static struct struct_devctl stm32f10x_devs[NR_SUPPORTED_DEVICES] =
 {
 	{
 		.next = 0,
 		.name = "stm32f100xb",
-                .cmdline_options = 0,
+		.cmdline_options = (struct cmdline_option_info[])
+			{
+				[0] = { .description = "if nonzero, run the core at 24 MHz while the device is open", .cmdstr = "clock-boost", .type = PARAM_TYPE_NUMERIC, .is_mandatory = false, },
+				[1] = { .cmdstr = 0, .type = PARAM_TYPE_INVALID, },
+			},
 		.ram_areas = (const struct struct_memarea[2])
 			{
 				{ .start = 0x20000000,	.len = 1024 * 8,	.sizes = 0,	},
@@ -149,20 +202,22 @@ static struct struct_devctl stm32f10x_devs[NR_SUPPORTED_DEVICES] =
 				},
 				{ .start = 0,		.len = 0,		.sizes = 0,	},
 			},
-		.dev_open = 0,
-		.dev_close = 0,
+		.dev_open = stm32f10x_dev_open,
+		.dev_close = stm32f10x_dev_close,
 		.flash_unlock_area = stm32f10x_flash_unlock_area,
 		.flash_erase_area = 0,
                 /*! \todo	code the erase_area() function */
 		.flash_erase_sector = stm32f10x_flash_erase_sector,
 		.flash_mass_erase = stm32f10x_flash_mass_erase,
 		.flash_program_words = stm32f10x_flash_program_words,
+		.flash_wait_idle = stm32f10x_flash_wait_idle,
+		.sector_erase_usec = 20000,
+		.sector_erase_usec_per_kb = 0,
+		.mass_erase_usec = 20000,
 		.validate_cmdline_options = 0,
 		.pdev = &(struct pdev)
 			{
-				.code_load_addr = 0x20000000,
-				.write_buf_addr = 0x20000000 + 0x100,
-				.write_buf_size = 0x1800,
+				/* the other fields are computed by ramplan_layout() */
 				.stack_size = 0x200,
 		       	},
 	},
@@ -175,6 +230,108 @@ static uint32_t stm32f10x_flash_write_routine[] =
 #include "stm32f10x-flash-write-mcode.h"
 };
 
+/*! the target clock and flash settings saved by stm32f10x_dev_open(), to be restored by stm32f10x_dev_close() */
+static struct
+{
+	/*! if true, the fields below hold the target settings at the time the device was opened */
+	bool		is_saved;
+	/*! if true, the target core runs on the programming clock profile, see boost_clock() */
+	bool		is_clock_boosted;
+	uint32_t	facr;
+	uint32_t	rcc_cr;
+	uint32_t	rcc_cfgr;
+}
+saved_regs;
+
+static int boost_clock(struct libgdb_ctx * ctx)
+{
+uint32_t x;
+int res;
+
+	if ((saved_regs.rcc_cfgr & SWS) != SW_HSI << 2 || (saved_regs.rcc_cr & PLLON))
+	{
+		/* the clocks have already been configured, e.g. by the
+		 * target firmware - leave them alone */
+		printf("target core not running on its reset clock, clock boost not performed\n");
+		return 0;
+	}
+	/* from here on, the clock settings must be restored even if raising the clock fails midway */
+	saved_regs.is_clock_boosted = true;
+	res = 0;
+	res += libgdb_writewords(ctx, FACR, 1, (uint32_t[1]) { [0] = BOOST_FACR, });
+	/* the pll can only be configured while it is disabled */
+	x = (saved_regs.rcc_cfgr & ~ (PLLMUL | PLLXTPRE | PLLSRC | PPRE2 | PPRE1 | HPRE)) | BOOST_PLLMUL;
+	res += libgdb_writewords(ctx, RCC_CFGR, 1, & x);
+	res += libgdb_writewords(ctx, RCC_CR, 1, (uint32_t[1]) { [0] = saved_regs.rcc_cr | PLLON, });
+	if (res || libgdb_poll_word(ctx, RCC_CR, PLLRDY, PLLRDY, 0, CLOCK_SWITCH_TIMEOUT_USEC, & x))
+		return -1;
+	/* switch the system clock to the pll */
+	if (libgdb_readwords(ctx, RCC_CFGR, 1, & x))
+		return -1;
+	x = (x & ~ SW) | SW_PLL;
+	if (libgdb_writewords(ctx, RCC_CFGR, 1, & x)
+			|| libgdb_poll_word(ctx, RCC_CFGR, SWS, SW_PLL << 2, 0, CLOCK_SWITCH_TIMEOUT_USEC, & x))
+		return -1;
+	return 0;
+}
+
+static int restore_clock(struct libgdb_ctx * ctx)
+{
+uint32_t x;
+int res;
+
+	/* switch the system clock back, and only then disable the pll */
+	res = 0;
+	res += libgdb_readwords(ctx, RCC_CFGR, 1, & x);
+	x = (x & ~ SW) | (saved_regs.rcc_cfgr & SW);
+	res += libgdb_writewords(ctx, RCC_CFGR, 1, & x);
+	if (res || libgdb_poll_word(ctx, RCC_CFGR, SWS, (saved_regs.rcc_cfgr & SW) << 2, 0, CLOCK_SWITCH_TIMEOUT_USEC, & x))
+		return -1;
+	res += libgdb_writewords(ctx, RCC_CR, 1, (uint32_t[1]) { [0] = saved_regs.rcc_cr & ~ PLLON, });
+	if (res || libgdb_poll_word(ctx, RCC_CR, PLLRDY, 0, 0, CLOCK_SWITCH_TIMEOUT_USEC, & x))
+		return -1;
+	if (libgdb_writewords(ctx, RCC_CFGR, 1, & saved_regs.rcc_cfgr))
+		return -1;
+	saved_regs.is_clock_boosted = false;
+	return 0;
+}
+
+static int stm32f10x_dev_open(struct struct_devctl * dev, struct libgdb_ctx * ctx)
+{
+	/* save the settings changed while the device is open */
+	saved_regs.is_saved = false;
+	saved_regs.is_clock_boosted = false;
+	if (libgdb_readwords(ctx, FACR, 1, & saved_regs.facr)
+			|| libgdb_readwords(ctx, RCC_CR, 1, & saved_regs.rcc_cr)
+			|| libgdb_readwords(ctx, RCC_CFGR, 1, & saved_regs.rcc_cfgr))
+		return -1;
+	saved_regs.is_saved = true;
+	if (dev->cmdline_options[CLOCK_BOOST_PARAM_IDX].is_specified && dev->cmdline_options[CLOCK_BOOST_PARAM_IDX].num)
+		if (boost_clock(ctx))
+		{
+			eprintf("error raising the target core clock\n");
+			stm32f10x_dev_close(dev, ctx);
+			return -1;
+		}
+
+	return 0;
+}
+
+static int stm32f10x_dev_close(struct struct_devctl * dev, struct libgdb_ctx * ctx)
+{
+	if (!saved_regs.is_saved)
+		return 0;
+	if (saved_regs.is_clock_boosted && restore_clock(ctx))
+	{
+		eprintf("error restoring the target clock settings\n");
+		return -1;
+	}
+	if (libgdb_writewords(ctx, FACR, 1, & saved_regs.facr))
+		return -1;
+	saved_regs.is_saved = false;
+	return 0;
+}
+
 
 static int check_error_flags(uint32_t flags)
 {
@@ -208,22 +365,25 @@ int res;
 	res = 0;
 	res += libgdb_writewords(ctx, FKEYR, 1, (uint32_t[1]) { [0] = 0x45670123, });
 	res += libgdb_writewords(ctx, FKEYR, 1, (uint32_t[1]) { [0] = 0xcdef89ab, });
-	res += libgdb_writewords(ctx, FACR, 1, (uint32_t[1]) { [0] = 0x32, });
+	if (!saved_regs.is_clock_boosted)
+		/* the original setting is restored by stm32f10x_dev_close() */
+		res += libgdb_writewords(ctx, FACR, 1, (uint32_t[1]) { [0] = 0x32, });
 	if (res)
 		return -1;
 	return 0;
 }
 
+/*! true if a flash erase has been started, and has not yet been waited for, see stm32f10x_flash_erase_sector() */
+static bool is_erase_pending;
+/*! the time the pending flash erase was started, and its expected duration, in microseconds */
+static struct timeval erase_start_time;
+static uint32_t erase_expected_usec;
+
 static int stm32f10x_flash_mass_erase(struct struct_devctl * dev, struct libgdb_ctx * ctx)
 {
 uint32_t x;
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, 0, SECTOR_ERASE_TIMEOUT_USEC, & x))
+		return -1;
 	if (0)
 	{
 		printf("mass erase status (prior to mass erase): 0x%08x\n", x);
@@ -235,13 +395,10 @@ uint32_t x;
 		return -1;
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = MER | STRT, }))
 		return -1;
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, dev->mass_erase_usec, MASS_ERASE_TIMEOUT_USEC, & x))
+		return -1;
+	/* any sector erase still pending has completed before the mass erase started */
+	is_erase_pending = false;
 	if (0)
 	{
 		printf("mass erase status (after mass erase): 0x%08x\n", x);
@@ -253,6 +410,26 @@ uint32_t x;
 }
 
 
+static int stm32f10x_flash_wait_idle(struct struct_devctl * dev, struct libgdb_ctx * ctx)
+{
+uint32_t x;
+struct timeval now;
+int64_t remaining_usec;
+
+	if (!is_erase_pending)
+		return 0;
+	/* sleep only through the part of the erase that has not
+	 * elapsed while target ram was being loaded */
+	gettimeofday(& now, 0);
+	remaining_usec = (int64_t) erase_expected_usec
+		- ((int64_t) (now.tv_sec - erase_start_time.tv_sec) * 1000000 + (now.tv_usec - erase_start_time.tv_usec));
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, (remaining_usec > 0) ? remaining_usec : 0, SECTOR_ERASE_TIMEOUT_USEC, & x)
+			|| check_error_flags(x))
+		return -1;
+	is_erase_pending = false;
+	return 0;
+}
+
 static int stm32f10x_flash_erase_sector(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t sector_nr)
 {
 
@@ -265,16 +442,11 @@ uint32_t x;
 		return -1;
 	}
 
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		/* check error flags */
-		if (check_error_flags(x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	/* wait for a previous erase, if still in progress */
+	if (stm32f10x_flash_wait_idle(dev, ctx))
+		return -1;
+	if (libgdb_poll_word(ctx, FSR, BSY, 0, 0, SECTOR_ERASE_TIMEOUT_USEC, & x) || check_error_flags(x))
+		return -1;
 	printf("erasing flash sector %i...\n", sector_nr);
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = PER, }))
 		return -1;
@@ -282,16 +454,12 @@ uint32_t x;
 		return -1;
 	if (libgdb_writewords(ctx, FCTRL, 1, (uint32_t[1]) { [0] = PER | STRT, }))
 		return -1;
-	while (1)
-	{
-		if (libgdb_readwords(ctx, FSR, 1, &x))
-			return -1;
-		/* check error flags */
-		if (check_error_flags(x))
-			return -1;
-		if (!(x & BSY))
-			break;
-	}
+	/* do not wait for the erase to complete - the target ram can be loaded
+	 * in the meantime, see stm32f10x_flash_program_words() */
+	is_erase_pending = true;
+	gettimeofday(& erase_start_time, 0);
+	/* flash pages are 1 kilobyte in size */
+	erase_expected_usec = dev->sector_erase_usec + dev->sector_erase_usec_per_kb;
 
 	return 0;
 
@@ -299,7 +467,10 @@ uint32_t x;
 
 static int stm32f10x_flash_program_words(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t dest, uint32_t * src, int wordcnt)
 {
-int idx, wcnt, i;
+int idx, wcnt, i, next;
+int buf, nr_bufs;
+bool is_next_staged;
+uint32_t buf_addrs[2];
 uint32_t res;
 uint32_t stackbase;
 struct pdev * pdev;
@@ -307,55 +478,126 @@ uint32_t total, cur;
 bool is_annotation_enabled;
 
 	pdev = (struct pdev *) dev->pdev;
+	/* place the flash write routine, the write buffers and the stack in target ram */
+	if (ramplan_layout(dev->ram_areas, sizeof stm32f10x_flash_write_routine, dev->is_double_buffering_enabled, pdev))
+		return -1;
 
 	is_annotation_enabled = libgdb_set_annotation(ctx, false);
 	total = wordcnt * sizeof(uint32_t);
 	cur = 0;
-	/* load the flash write routine */
-	if (libgdb_writewords(ctx,
-				pdev->code_load_addr,
-				sizeof stm32f10x_flash_write_routine >> 2,
-				(uint32_t *) stm32f10x_flash_write_routine))
+	/* load the flash write routine, unless it is still resident in
+	 * target ram from a previous call */
+	if (!libgdb_is_code_resident(ctx, pdev->code_load_addr, sizeof stm32f10x_flash_write_routine, stm32f10x_flash_write_routine))
 	{
-		eprintf("error loading flash writing routine into target\n");
-		return - 1;
+		if (libgdb_writewords(ctx,
+					pdev->code_load_addr,
+					sizeof stm32f10x_flash_write_routine >> 2,
+					(uint32_t *) stm32f10x_flash_write_routine))
+		{
+			eprintf("error loading flash writing routine into target\n");
+			libgdb_set_annotation(ctx, is_annotation_enabled);
+			return - 1;
+		}
+		libgdb_set_resident_code(ctx, pdev->code_load_addr, sizeof stm32f10x_flash_write_routine, stm32f10x_flash_write_routine);
 	}
 
 	idx = 0;
+	/* if double buffering is enabled, there are two write buffers - while
+	 * the target is programming the data in one of them, the next chunk of
+	 * data is uploaded to the other one; if ramplan_layout() has found no
+	 * room for a second buffer, the write buffer is split in two halves */
+	nr_bufs = dev->is_double_buffering_enabled ? 2 : 1;
 	wcnt = pdev->write_buf_size / sizeof(uint32_t);
+	buf_addrs[0] = pdev->write_buf_addr;
+	if (nr_bufs == 2 && !(buf_addrs[1] = pdev->alt_write_buf_addr))
+	{
+		wcnt /= 2;
+		buf_addrs[1] = pdev->write_buf_addr + wcnt * sizeof(uint32_t);
+	}
 	stackbase = pdev->write_buf_addr + pdev->write_buf_size + pdev->stack_size;
-	while (wordcnt)
+	buf = 0;
+	i = (wcnt < wordcnt) ? wcnt : wordcnt;
+	if (libgdb_writewords(ctx, buf_addrs[0], i, src))
+	{
+		eprintf("error writing target memory\n");
+		libgdb_set_annotation(ctx, is_annotation_enabled);
+		return -1;
+	}
+	is_next_staged = false;
+	if (is_erase_pending)
 	{
-		i = (wcnt < wordcnt) ? wcnt : wordcnt;
-		if (libgdb_writewords(ctx, pdev->write_buf_addr, i, src + idx))
+		/* a flash erase is still in progress - also stage the next chunk
+		 * of data, if there is room for it, and only then wait for the
+		 * erase to complete */
+		next = (wcnt < wordcnt - i) ? wcnt : wordcnt - i;
+		if (nr_bufs == 2 && next)
 		{
-			eprintf("error writing target memory\n");
+			if (libgdb_writewords(ctx, buf_addrs[1], next, src + i))
+			{
+				eprintf("error writing target memory\n");
+				libgdb_set_annotation(ctx, is_annotation_enabled);
+				return -1;
+			}
+			is_next_staged = true;
+		}
+		if (stm32f10x_flash_wait_idle(dev, ctx))
+		{
+			eprintf("error erasing target flash\n");
+			libgdb_set_annotation(ctx, is_annotation_enabled);
 			return -1;
 		}
-
-		if (libgdb_armv7m_run_target_routine(ctx,
+	}
+	while (wordcnt)
+	{
+		if (libgdb_armv7m_start_target_routine(ctx,
 					pdev->code_load_addr,
 					stackbase,
 					0,
-					& res,
 					dest + idx * sizeof(uint32_t),
-					pdev->write_buf_addr,
+					buf_addrs[buf],
 					i,
 					0))
 		{
 			eprintf("error executing flash writing routine\n");
+			libgdb_set_annotation(ctx, is_annotation_enabled);
+			return -1;
+		}
+		next = (wcnt < wordcnt - i) ? wcnt : wordcnt - i;
+		/* upload the next chunk to the other buffer while the target is running */
+		if (nr_bufs == 2 && next && !is_next_staged)
+			if (libgdb_writewords(ctx, buf_addrs[buf ^ 1], next, src + idx + i))
+			{
+				eprintf("error writing target memory\n");
+				libgdb_set_annotation(ctx, is_annotation_enabled);
+				return -1;
+			}
+		is_next_staged = false;
+		if (libgdb_armv7m_finish_target_routine(ctx, 0, & res))
+		{
+			eprintf("error executing flash writing routine\n");
+			libgdb_set_annotation(ctx, is_annotation_enabled);
 			return -1;
 		}
 		if (res)
 		{
 			eprintf("error writing target flash, target returned error code: %i\n", (int) res);
+			libgdb_set_annotation(ctx, is_annotation_enabled);
 			return -1;
 		}
+		if (nr_bufs == 1 && next)
+			if (libgdb_writewords(ctx, buf_addrs[0], next, src + idx + i))
+			{
+				eprintf("error writing target memory\n");
+				libgdb_set_annotation(ctx, is_annotation_enabled);
+				return -1;
+			}
 		idx += i;
 		wordcnt -= i;
 		printf("%i bytes written\n", idx * sizeof(uint32_t));
 		cur += i * sizeof(uint32_t);
 		printf("[VX-FLASH-WRITE-PROGRESS]\t%i\t%i\n", cur, total);
+		buf = (buf + 1) % nr_bufs;
+		i = next;
 	}
 
 	libgdb_set_annotation(ctx, is_annotation_enabled);
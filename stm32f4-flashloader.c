@@ -140,7 +140,7 @@ static uint8_t stm32f4_flash_write_routine[] =
 	libgdb_sendpacket(ctx, "c");
 	libgdb_sendbreak(ctx);
 	libgdb_waithalted(ctx);
-	libgdb_set_max_nr_words_xferred(ctx, 67);
+	libgdb_autotune_max_nr_words_xferred(ctx, STM32F4_RAM_BASE_ADDR, STM32F4_RAM_SIZE);
 
 	goto test_mem_read_speed;
 
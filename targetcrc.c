@@ -0,0 +1,124 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * target memory checksumming
+ */
+
+#ifdef COMPILING_TARGET_RESIDENT_CODE
+
+#include <stdint.h>
+
+/* computes the same crc32 checksum as libgdb_compute_crc32() */
+uint32_t crc32(const uint8_t * buf, uint32_t len, uint32_t crc)
+{
+int i;
+
+	while (len --)
+	{
+		crc ^= (uint32_t) * buf ++ << 24;
+		for (i = 0; i < 8; i ++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+	}
+	return crc;
+}
+
+#else
+
+#ifndef __LINUX__
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libgdb.h"
+#include "devctl.h"
+#include "ramplan.h"
+#include "targetcrc.h"
+
+/* uint32_t crc32(const uint8_t * buf, uint32_t len, uint32_t crc) */
+static uint32_t crc32_routine[] =
+{
+/* directly include the machine code of the target 'crc32()' routine */
+#include "targetcrc-mcode.h"
+};
+
+int target_crc32(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc)
+{
+struct pdev layout;
+uint32_t res, code_addr;
+
+	switch (libgdb_crc32(ctx, addr, len, crc))
+	{
+		case 0:
+			return 0;
+		case 1:
+			/* not supported by the gdbserver - run the checksum routine on the target */
+			break;
+		default:
+			return -1;
+	}
+	/* the routine has no data buffer of its own - it is loaded at the end
+	 * of the write buffer placed by ramplan_layout(), just below its stack;
+	 * the start of target ram is thus left intact, as this is where the flash
+	 * programming routines are placed (and kept resident, see libgdb_set_resident_code()),
+	 * so that checksumming flash sectors in between programming them does not
+	 * force reloading the flash programming routine every time */
+	layout.stack_size = MIN_CRC32_STACK_SIZE;
+	if (ramplan_layout(dev->ram_areas, sizeof crc32_routine, false, & layout))
+	{
+		eprintf("no target ram available for running the checksum routine\n");
+		return -1;
+	}
+	if (layout.write_buf_size >= sizeof crc32_routine)
+		code_addr = layout.write_buf_addr + layout.write_buf_size - sizeof crc32_routine;
+	else
+		code_addr = layout.code_load_addr;
+	if (libgdb_writewords(ctx, code_addr, sizeof crc32_routine >> 2, crc32_routine))
+	{
+		eprintf("error loading checksum routine into target\n");
+		return -1;
+	}
+	if (libgdb_armv7m_run_target_routine(ctx,
+				code_addr,
+				layout.write_buf_addr + layout.write_buf_size + layout.stack_size,
+				0,
+				& res,
+				addr,
+				len,
+				0xffffffff,
+				0))
+	{
+		eprintf("error executing checksum routine\n");
+		return -1;
+	}
+	* crc = res;
+	return 0;
+}
+
+#endif /* COMPILING_TARGET_RESIDENT_CODE */
+
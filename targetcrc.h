@@ -0,0 +1,55 @@
+/*
+
+Copyright (C) 2012 stoyan shopov
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+/*
+ * target memory checksumming
+ */
+
+enum
+{
+	/*! the minimum stack size needed by the target checksum routine, in bytes */
+	MIN_CRC32_STACK_SIZE	= 64,
+};
+
+/*!
+ *	\fn	int target_crc32(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc)
+ *	\brief	computes the crc32 checksum of target memory, without reading the memory over the link
+ *
+ *	the checksum is computed by the gdbserver, if it supports the 'qCRC'
+ *	packet (see libgdb_crc32()); otherwise, a checksum routine is loaded
+ *	in target ram (see ramplan_layout()), and run on the target - the
+ *	contents of target ram are destroyed in this case, except for the
+ *	start of the ram block used, where the flash programming routines
+ *	are kept resident (see libgdb_set_resident_code()); either
+ *	way, the checksum is the same as the one computed by
+ *	libgdb_compute_crc32() with an initial value of 0xffffffff
+ *
+ *	\param	dev	the target device, must have already been opened
+ *	\param	ctx	libgdb library context, connected to a gdbserver, with the target halted
+ *	\param	addr	target address of the memory to checksum
+ *	\param	len	number of bytes to checksum
+ *	\param	crc	a pointer to where to store the checksum computed
+ *	\return	0 on success, -1 if an error occurs */
+int target_crc32(struct struct_devctl * dev, struct libgdb_ctx * ctx, uint32_t addr, uint32_t len, uint32_t * crc);